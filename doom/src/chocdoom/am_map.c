@@ -23,6 +23,7 @@
 
 #include "z_zone.h"
 #include "doomkeys.h"
+#include "m_bbox.h"
 #include "doomdef.h"
 #include "st_stuff.h"
 #include "p_local.h"
@@ -44,6 +45,7 @@
 #include "dstrings.h"
 
 #include "am_map.h"
+#include "hu_stuff.h"
 #include <misc_utils.h>
 
 
@@ -264,6 +266,60 @@ cheatseq_t cheat_amap = CHEAT("iddt", 0);
 
 static boolean stopped = true;
 
+//
+// Line grid, built by AM_LevelInit.
+// Each cell lists the lines whose bounding box touches it, the
+// mapped ones first, so that without the cheat or the computer map
+// only the lines seen so far are visited.
+//
+#define AMCELLSHIFT	(FRACBITS+9)	// 512 map units a cell
+
+static fixed_t		amcellorgx;
+static fixed_t		amcellorgy;
+static int		amcellcols;
+static int		amcellrows;
+static int*		amcellofs;	// first entry of each cell, and the end
+static int*		amcellmapped;	// mapped lines at the start of each cell
+static unsigned short*	amcelllines;
+
+// Per frame stamps, so that a line in several cells is drawn once
+// and a vertex is transformed to frame buffer coordinates once.
+static unsigned short	amstamp;
+static unsigned short*	amlinestamp;
+static unsigned short*	amvertexstamp;
+static fpoint_t*	amvertex;
+
+// Lines found visible this frame, and their color classes.
+enum
+{
+    AMC_WALL,
+    AMC_TELEPORT,
+    AMC_SECRET,
+    AMC_FLOOR,
+    AMC_CEILING,
+    AMC_TWOSIDED,
+    AMC_ALLMAP,
+    AMC_NUM
+};
+
+static unsigned short*	ambatchlines;
+static byte*		ambatchclass;
+static int		ambatchcount;
+
+// What the last drawn frame showed, see AM_needsRedraw.
+static boolean		amredraw = true;
+static fixed_t		amdrawn_x;
+static fixed_t		amdrawn_y;
+static fixed_t		amdrawn_scale;
+static fixed_t		amdrawn_plrx;
+static fixed_t		amdrawn_plry;
+static angle_t		amdrawn_plrangle;
+static int		amdrawn_cheating;
+static int		amdrawn_grid;
+static int		amdrawn_allmap;
+static boolean		amdrawn_overlaid;
+static int		amdrawn_planemoves;
+
 // Calculates the slope and slope according to the x-axis of a line
 // segment in map coordinates (with the upright y-axis n' all) so
 // that it can be used with the brain-dead drawing stuff.
@@ -342,6 +398,7 @@ void AM_addMark(void)
     markpoints[markpointnum].x = m_x + m_w/2;
     markpoints[markpointnum].y = m_y + m_h/2;
     markpointnum = (markpointnum + 1) % AM_NUMMARKPOINTS;
+    amredraw = true;
 
 }
 
@@ -503,22 +560,180 @@ void AM_clearMarks(void)
     for (i=0;i<AM_NUMMARKPOINTS;i++)
 	markpoints[i].x = -1; // means empty
     markpointnum = 0;
+    amredraw = true;
 }
 
 //
-// should be called at the start of every level
-// right now, i figure it out myself
+// Cells of the line grid the line's bounding box touches.
+//
+static void
+AM_lineCells
+( line_t*	ld,
+  int*		x1,
+  int*		y1,
+  int*		x2,
+  int*		y2 )
+{
+    *x1 = (ld->bbox[BOXLEFT] - amcellorgx) >> AMCELLSHIFT;
+    *x2 = (ld->bbox[BOXRIGHT] - amcellorgx) >> AMCELLSHIFT;
+    *y1 = (ld->bbox[BOXBOTTOM] - amcellorgy) >> AMCELLSHIFT;
+    *y2 = (ld->bbox[BOXTOP] - amcellorgy) >> AMCELLSHIFT;
+
+    // AM_findMinMaxBoundaries can miss the first vertex
+    if (*x1 < 0) *x1 = 0;
+    if (*y1 < 0) *y1 = 0;
+    if (*x2 >= amcellcols) *x2 = amcellcols-1;
+    if (*y2 >= amcellrows) *y2 = amcellrows-1;
+}
+
+//
+// Puts the mapped lines of every cell first, after a savegame or a
+// save state has set the ML_MAPPED flags behind our back.
+//
+void AM_SyncMapped(void)
+{
+    int			c;
+    int			i;
+    int			j;
+    unsigned short	n;
+
+    if (!amcelllines)
+	return;
+
+    for (c=0;c<amcellcols*amcellrows;c++)
+    {
+	j = amcellofs[c];
+	for (i=amcellofs[c];i<amcellofs[c+1];i++)
+	{
+	    n = amcelllines[i];
+	    if (lines[n].flags & ML_MAPPED)
+	    {
+		amcelllines[i] = amcelllines[j];
+		amcelllines[j++] = n;
+	    }
+	}
+	amcellmapped[c] = j - amcellofs[c];
+    }
+    amredraw = true;
+}
+
+//
+// Called by the renderer the first time it sets ML_MAPPED on a line,
+// moves the line into the mapped part of its cells.
+//
+void AM_LineMapped(line_t* ld)
+{
+    int			x1, y1, x2, y2;
+    int			x, y;
+    int			c;
+    int			i;
+    int			first;
+    unsigned short	n;
+
+    if (!amcelllines)
+	return;
+
+    n = ld - lines;
+    AM_lineCells(ld, &x1, &y1, &x2, &y2);
+
+    for (y=y1;y<=y2;y++)
+    {
+	for (x=x1;x<=x2;x++)
+	{
+	    c = y*amcellcols + x;
+	    first = amcellofs[c] + amcellmapped[c];
+	    for (i=first;i<amcellofs[c+1];i++)
+	    {
+		if (amcelllines[i] == n)
+		{
+		    amcelllines[i] = amcelllines[first];
+		    amcelllines[first] = n;
+		    amcellmapped[c]++;
+		    break;
+		}
+	    }
+	}
+    }
+    amredraw = true;
+}
+
+//
+// Builds the line grid and the per frame caches of the level.
+// Called by P_SetupLevel; the grid is PU_LEVEL.
 //
 void AM_LevelInit(void)
 {
+    int		numcells;
+    int		x1, y1, x2, y2;
+    int		x, y;
+    int		c;
+    int		i;
 
     f_x = f_y = 0;
     f_w = finit_width;
     f_h = finit_height;
 
+    AM_findMinMaxBoundaries();
+
+    amcellorgx = min_x;
+    amcellorgy = min_y;
+    amcellcols = (max_w >> AMCELLSHIFT) + 1;
+    amcellrows = (max_h >> AMCELLSHIFT) + 1;
+    numcells = amcellcols * amcellrows;
+
+    amcellofs = Z_Malloc((numcells+1)*sizeof(*amcellofs), PU_LEVEL, 0);
+    amcellmapped = Z_Malloc(numcells*sizeof(*amcellmapped), PU_LEVEL, 0);
+    memset(amcellofs, 0, (numcells+1)*sizeof(*amcellofs));
+    memset(amcellmapped, 0, numcells*sizeof(*amcellmapped));
+
+    // count the lines of each cell, then lay the cells out
+    for (i=0;i<numlines;i++)
+    {
+	AM_lineCells(&lines[i], &x1, &y1, &x2, &y2);
+	for (y=y1;y<=y2;y++)
+	    for (x=x1;x<=x2;x++)
+		amcellofs[y*amcellcols + x + 1]++;
+    }
+    for (c=0;c<numcells;c++)
+	amcellofs[c+1] += amcellofs[c];
+
+    amcelllines = Z_Malloc(amcellofs[numcells]*sizeof(*amcelllines),
+			   PU_LEVEL, 0);
+
+    for (i=0;i<numlines;i++)
+    {
+	AM_lineCells(&lines[i], &x1, &y1, &x2, &y2);
+	for (y=y1;y<=y2;y++)
+	{
+	    for (x=x1;x<=x2;x++)
+	    {
+		c = y*amcellcols + x;
+		amcelllines[amcellofs[c] + amcellmapped[c]++] = i;
+	    }
+	}
+    }
+
+    amstamp = 0;
+    amlinestamp = Z_Malloc(numlines*sizeof(*amlinestamp), PU_LEVEL, 0);
+    amvertexstamp = Z_Malloc(numvertexes*sizeof(*amvertexstamp), PU_LEVEL, 0);
+    amvertex = Z_Malloc(numvertexes*sizeof(*amvertex), PU_LEVEL, 0);
+    memset(amlinestamp, 0, numlines*sizeof(*amlinestamp));
+    memset(amvertexstamp, 0, numvertexes*sizeof(*amvertexstamp));
+
+    ambatchlines = Z_Malloc(numlines*sizeof(*ambatchlines), PU_LEVEL, 0);
+    ambatchclass = Z_Malloc(numlines*sizeof(*ambatchclass), PU_LEVEL, 0);
+
+    AM_SyncMapped();
+}
+
+//
+// should be called at the start of every level
+// right now, i figure it out myself
+//
+static void AM_initScale(void)
+{
     AM_clearMarks();
 
-    AM_findMinMaxBoundaries();
     scale_mtof = FixedDiv(min_scale_mtof, (int) (0.7*FRACUNIT));
     if (scale_mtof > max_scale_mtof)
 	scale_mtof = min_scale_mtof;
@@ -552,12 +767,13 @@ void AM_Start (void)
     stopped = false;
     if (lastlevel != gamemap || lastepisode != gameepisode)
     {
-	AM_LevelInit();
+	AM_initScale();
 	lastlevel = gamemap;
 	lastepisode = gameepisode;
     }
     AM_initVariables();
     AM_loadPics();
+    amredraw = true;
 }
 
 //
@@ -830,6 +1046,8 @@ void AM_clearFB(int color)
 }
 
 
+static boolean AM_clipFline(fline_t* fl);
+
 //
 // Automap clipping of lines.
 //
@@ -852,11 +1070,6 @@ AM_clipMline
     
     register int	outcode1 = 0;
     register int	outcode2 = 0;
-    register int	outside;
-    
-    fpoint_t	tmp;
-    int		dx;
-    int		dy;
 
     
 #define DOOUTCODE(oc, mx, my) \
@@ -900,6 +1113,33 @@ AM_clipMline
     fl->b.x = CXMTOF(ml->b.x);
     fl->b.y = CYMTOF(ml->b.y);
 
+    return AM_clipFline(fl);
+}
+
+//
+// The frame buffer half of AM_clipMline, for lines already
+// transformed.
+//
+static boolean
+AM_clipFline
+( fline_t*	fl )
+{
+    enum
+    {
+	LEFT	=1,
+	RIGHT	=2,
+	BOTTOM	=4,
+	TOP	=8
+    };
+    
+    register int	outcode1 = 0;
+    register int	outcode2 = 0;
+    register int	outside;
+    
+    fpoint_t	tmp;
+    int		dx;
+    int		dy;
+
     DOOUTCODE(outcode1, fl->a.x, fl->a.y);
     DOOUTCODE(outcode2, fl->b.x, fl->b.y);
 
@@ -972,14 +1212,17 @@ AM_clipMline
 
 //
 // Classic Bresenham w/ whatever optimizations needed for speed
+// Steps a pointer through the frame buffer instead of working out
+// each dot's address, and fills straight lines directly.
 //
 void
 AM_drawFline
 ( fline_t*	fl,
   int		color )
 {
-    register int x;
-    register int y;
+    register pix_t* dest;
+    register pix_t c;
+    register int n;
     register int dx;
     register int dy;
     register int sx;
@@ -997,48 +1240,55 @@ AM_drawFline
 	return;
     }
 
-#define PUTDOT(xx,yy,cc) fb[(yy)*f_w+(xx)]=pixel(cc)
-
     dx = fl->b.x - fl->a.x;
     ax = 2 * (dx<0 ? -dx : dx);
     sx = dx<0 ? -1 : 1;
 
     dy = fl->b.y - fl->a.y;
     ay = 2 * (dy<0 ? -dy : dy);
-    sy = dy<0 ? -1 : 1;
+    sy = dy<0 ? -f_w : f_w;
 
-    x = fl->a.x;
-    y = fl->a.y;
+    dest = fb + fl->a.y*f_w + fl->a.x;
+    c = pixel(color);
+
+    if (!ay)
+    {
+	// horizontal
+	if (dx < 0)
+	    dest += dx;
+	memset(dest, c, (ax/2 + 1)*sizeof(pix_t));
+	return;
+    }
 
     if (ax > ay)
     {
 	d = ay - ax/2;
-	while (1)
+	for (n = ax/2; ; n--)
 	{
-	    PUTDOT(x,y,color);
-	    if (x == fl->b.x) return;
+	    *dest = c;
+	    if (!n) return;
 	    if (d>=0)
 	    {
-		y += sy;
+		dest += sy;
 		d -= ax;
 	    }
-	    x += sx;
+	    dest += sx;
 	    d += ay;
 	}
     }
     else
     {
 	d = ax - ay/2;
-	while (1)
+	for (n = ay/2; ; n--)
 	{
-	    PUTDOT(x, y, color);
-	    if (y == fl->b.y) return;
+	    *dest = c;
+	    if (!n) return;
 	    if (d >= 0)
 	    {
-		x += sx;
+		dest += sx;
 		d -= ay;
 	    }
-	    y += sy;
+	    dest += sy;
 	    d += ax;
 	}
     }
@@ -1106,56 +1356,148 @@ void AM_drawGrid(int color)
 
 }
 
+//
+// Frame buffer coordinates of a vertex, transformed once a frame.
+//
+static void AM_vertexToF(vertex_t* v, fpoint_t* p)
+{
+    int		n;
+
+    n = v - vertexes;
+    if (amvertexstamp[n] != amstamp)
+    {
+	amvertexstamp[n] = amstamp;
+	amvertex[n].x = CXMTOF(v->x);
+	amvertex[n].y = CYMTOF(v->y);
+    }
+    *p = amvertex[n];
+}
+
+//
+// Queues a line under its color class, if it is drawn at all.
+//
+static void AM_batchLine(line_t* ld)
+{
+    int		class;
+
+    if (cheating || (ld->flags & ML_MAPPED))
+    {
+	if ((ld->flags & LINE_NEVERSEE) && !cheating)
+	    return;
+	if (!ld->backsector)
+	    class = AMC_WALL;
+	else if (ld->special == 39)
+	    class = AMC_TELEPORT; // teleporters
+	else if (ld->flags & ML_SECRET) // secret door
+	    class = cheating ? AMC_SECRET : AMC_WALL;
+	else if (ld->backsector->floorheight
+		   != ld->frontsector->floorheight)
+	    class = AMC_FLOOR; // floor level change
+	else if (ld->backsector->ceilingheight
+		   != ld->frontsector->ceilingheight)
+	    class = AMC_CEILING; // ceiling level change
+	else if (cheating)
+	    class = AMC_TWOSIDED;
+	else
+	    return;
+    }
+    else if (plr->powers[pw_allmap])
+    {
+	if (ld->flags & LINE_NEVERSEE)
+	    return;
+	class = AMC_ALLMAP;
+    }
+    else
+	return;
+
+    // trivially outside the window
+    if (ld->bbox[BOXTOP] < m_y || ld->bbox[BOXBOTTOM] > m_y2
+     || ld->bbox[BOXRIGHT] < m_x || ld->bbox[BOXLEFT] > m_x2)
+	return;
+
+    ambatchlines[ambatchcount] = ld - lines;
+    ambatchclass[ambatchcount] = class;
+    ambatchcount++;
+}
+
 //
 // Determines visible lines, draws them.
 // This is LineDef based, not LineSeg based.
+// Only the cells of the line grid under the window are visited, and
+// the lines are drawn a color at a time.
 //
 void AM_drawWalls(void)
 {
-    int i;
-    static mline_t l;
+    static int	classcolors[AMC_NUM];
+    int		x1, y1, x2, y2;
+    int		x, y;
+    int		c;
+    int		i;
+    int		end;
+    int		class;
+    boolean	all;
+    line_t*	ld;
+    fline_t	fl;
 
-    for (i=0;i<numlines;i++)
+    if (!++amstamp)
+    {
+	memset(amlinestamp, 0, numlines*sizeof(*amlinestamp));
+	memset(amvertexstamp, 0, numvertexes*sizeof(*amvertexstamp));
+	amstamp = 1;
+    }
+
+    x1 = (m_x - amcellorgx) >> AMCELLSHIFT;
+    x2 = (m_x2 - amcellorgx) >> AMCELLSHIFT;
+    y1 = (m_y - amcellorgy) >> AMCELLSHIFT;
+    y2 = (m_y2 - amcellorgy) >> AMCELLSHIFT;
+    if (x1 < 0) x1 = 0;
+    if (y1 < 0) y1 = 0;
+    if (x2 >= amcellcols) x2 = amcellcols-1;
+    if (y2 >= amcellrows) y2 = amcellrows-1;
+
+    // unmapped lines only show with the cheat or the computer map
+    all = cheating || plr->powers[pw_allmap];
+
+    ambatchcount = 0;
+    for (y=y1;y<=y2;y++)
     {
-	l.a.x = lines[i].v1->x;
-	l.a.y = lines[i].v1->y;
-	l.b.x = lines[i].v2->x;
-	l.b.y = lines[i].v2->y;
-	if (cheating || (lines[i].flags & ML_MAPPED))
+	for (x=x1;x<=x2;x++)
 	{
-	    if ((lines[i].flags & LINE_NEVERSEE) && !cheating)
-		continue;
-	    if (!lines[i].backsector)
-	    {
-		AM_drawMline(&l, WALLCOLORS+lightlev);
-	    }
-	    else
+	    c = y*amcellcols + x;
+	    end = all ? amcellofs[c+1] : amcellofs[c] + amcellmapped[c];
+
+	    for (i=amcellofs[c];i<end;i++)
 	    {
-		if (lines[i].special == 39)
-		{ // teleporters
-		    AM_drawMline(&l, WALLCOLORS+WALLRANGE/2);
-		}
-		else if (lines[i].flags & ML_SECRET) // secret door
-		{
-		    if (cheating) AM_drawMline(&l, SECRETWALLCOLORS + lightlev);
-		    else AM_drawMline(&l, WALLCOLORS+lightlev);
-		}
-		else if (lines[i].backsector->floorheight
-			   != lines[i].frontsector->floorheight) {
-		    AM_drawMline(&l, FDWALLCOLORS + lightlev); // floor level change
-		}
-		else if (lines[i].backsector->ceilingheight
-			   != lines[i].frontsector->ceilingheight) {
-		    AM_drawMline(&l, CDWALLCOLORS+lightlev); // ceiling level change
-		}
-		else if (cheating) {
-		    AM_drawMline(&l, TSWALLCOLORS+lightlev);
-		}
+		ld = &lines[amcelllines[i]];
+		if (amlinestamp[amcelllines[i]] == amstamp)
+		    continue;
+		amlinestamp[amcelllines[i]] = amstamp;
+		AM_batchLine(ld);
 	    }
 	}
-	else if (plr->powers[pw_allmap])
+    }
+
+    classcolors[AMC_WALL] = WALLCOLORS+lightlev;
+    classcolors[AMC_TELEPORT] = WALLCOLORS+WALLRANGE/2;
+    classcolors[AMC_SECRET] = SECRETWALLCOLORS+lightlev;
+    classcolors[AMC_FLOOR] = FDWALLCOLORS+lightlev;
+    classcolors[AMC_CEILING] = CDWALLCOLORS+lightlev;
+    classcolors[AMC_TWOSIDED] = TSWALLCOLORS+lightlev;
+    classcolors[AMC_ALLMAP] = GRAYS+3;
+
+    for (class=0;class<AMC_NUM;class++)
+    {
+	for (i=0;i<ambatchcount;i++)
 	{
-	    if (!(lines[i].flags & LINE_NEVERSEE)) AM_drawMline(&l, GRAYS+3);
+	    if (ambatchclass[i] != class)
+		continue;
+
+	    ld = &lines[ambatchlines[i]];
+	    AM_vertexToF(ld->v1, &fl.a);
+	    AM_vertexToF(ld->v2, &fl.b);
+
+	    if (AM_clipFline(&fl))
+		AM_drawFline(&fl, classcolors[class]);
 	}
     }
 }
@@ -1325,10 +1667,53 @@ void AM_drawCrosshair(int color)
 
 }
 
+//
+// The automap is only drawn again when something it shows has
+// changed, or when something was drawn over it last frame.
+//
+static boolean AM_needsRedraw(void)
+{
+    boolean	overlaid;
+    boolean	redraw;
+
+    overlaid = menuactive || paused || HU_Overlaid();
+
+    redraw = amredraw || overlaid || amdrawn_overlaid
+	|| netgame || cheating == 2
+	|| amdrawn_x != m_x
+	|| amdrawn_y != m_y
+	|| amdrawn_scale != scale_mtof
+	|| amdrawn_plrx != plr->mo->x
+	|| amdrawn_plry != plr->mo->y
+	|| amdrawn_plrangle != plr->mo->angle
+	|| amdrawn_cheating != cheating
+	|| amdrawn_grid != grid
+	|| amdrawn_allmap != (plr->powers[pw_allmap] != 0)
+	|| amdrawn_planemoves != planemovecount;
+
+    amredraw = false;
+    amdrawn_x = m_x;
+    amdrawn_y = m_y;
+    amdrawn_scale = scale_mtof;
+    amdrawn_plrx = plr->mo->x;
+    amdrawn_plry = plr->mo->y;
+    amdrawn_plrangle = plr->mo->angle;
+    amdrawn_cheating = cheating;
+    amdrawn_grid = grid;
+    amdrawn_planemoves = planemovecount;
+    amdrawn_allmap = plr->powers[pw_allmap] != 0;
+    amdrawn_overlaid = overlaid;
+
+    return redraw;
+}
+
 void AM_Drawer (void)
 {
     if (!automapactive) return;
 
+    if (!AM_needsRedraw())
+	return;
+
     AM_clearFB(BACKGROUND);
     if (grid)
 	AM_drawGrid(GRIDCOLORS);
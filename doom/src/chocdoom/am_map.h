@@ -42,6 +42,15 @@ void AM_Drawer (void);
 // if the level is completed while it is up.
 void AM_Stop (void);
 
+// Called by P_SetupLevel, builds the line grid.
+void AM_LevelInit (void);
+
+// Called by the renderer when it maps a line, and after the
+// ML_MAPPED flags have been loaded.
+struct line_s;
+void AM_LineMapped (struct line_s *ld);
+void AM_SyncMapped (void);
+
 
 extern cheatseq_t cheat_amap;
 
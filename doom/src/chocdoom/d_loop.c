@@ -30,6 +30,7 @@
 #include "i_video.h"
 
 #include "m_argv.h"
+#include "m_profile.h"
 #include "m_fixed.h"
 
 #include "net_client.h"
@@ -721,7 +722,7 @@ void TryRunTics (void)
     int	availabletics;
     int	counts;
 
-    profiler_enter();
+    PROF_ENTER();
     // get real tics
     entertic = I_GetTime() / ticdup;
     realtics = entertic - oldentertics;
@@ -827,7 +828,7 @@ void TryRunTics (void)
 
 	NetUpdate ();	// check for new console commands
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 void D_RegisterLoopCallbacks(loop_interface_t *i)
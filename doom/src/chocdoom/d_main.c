@@ -49,6 +49,8 @@
 #include "m_controls.h"
 #include "m_misc.h"
 #include "m_menu.h"
+#include "m_snapshot.h"
+#include "m_profile.h"
 #include "p_saveg.h"
 
 #include "i_endoom.h"
@@ -182,14 +184,15 @@ void D_Display (void)
     static  boolean		fullscreen = false;
     static  gamestate_t		oldgamestate = (gamestate_t)-1;
     static  int			borderdrawcount;
+    static  lumpref_t		pauseref;
     int				tics;
     int				y;
     boolean			done;
     boolean			wipe;
     boolean			redrawsbar;
-    profiler_enter();
+    PROF_ENTER();
     if (nodrawers) {
-        profiler_exit();
+        PROF_EXIT();
     	return;                    // for comparative timing / profiling
     }
     redrawsbar = false;
@@ -249,7 +252,10 @@ void D_Display (void)
     	R_RenderPlayerView (&players[displayplayer]);
 
     if (gamestate == GS_LEVEL && gametic)
+    {
     	HU_Drawer ();
+    	HU_DrawPerf ();
+    }
     
     // clean up border stuff
     if (gamestate != oldgamestate && gamestate != GS_LEVEL)
@@ -294,7 +300,7 @@ void D_Display (void)
 		else
 			y = viewwindowy+4;
 		V_DrawPatchDirect(viewwindowx + (scaledviewwidth - 68) / 2, y,
-							  (patch_t *)W_CacheLumpName (DEH_String("M_PAUSE"), PU_CACHE));
+							  (patch_t *)W_CacheLumpRef (&pauseref, DEH_String("M_PAUSE"), PU_CACHE));
     }
     if (wipe) {
         wipe_StartScreen(0, 0, SCREENWIDTH, SCREENHEIGHT);
@@ -310,7 +316,7 @@ void D_Display (void)
     if (!wipe)
     {
         I_FinishUpdate ();              // page flip or blit buffer
-        profiler_exit();
+        PROF_EXIT();
         return;
     }
     
@@ -325,7 +331,7 @@ void D_Display (void)
 	M_Drawer ();                            // menu is drawn even on top of wipes
 	I_FinishUpdate ();                      // page flip or blit buffer
     } while (!done);
-    profiler_exit();
+    PROF_EXIT();
 }
 
 //
@@ -453,14 +459,26 @@ void D_DoomLoop (void)
         DD_FrameBegin();
         I_StartFrame ();
 
-        TryRunTics (); // will run at least one tic
-        S_UpdateSounds (players[consoleplayer].mo);// move positional sounds
-
-        // Update display, next frame, with current state.
-        if (screenvisible)
+        if (demoseeking)
         {
-            D_Display ();
+            G_SeekDemo ();
+        }
+        else
+        {
+            TryRunTics (); // will run at least one tic
+            S_UpdateSounds (players[consoleplayer].mo);// move positional sounds
+
+            // Update display, next frame, with current state.
+            if (screenvisible)
+            {
+                D_Display ();
+            }
+            R_Prefetch (&players[displayplayer]);
         }
+        Z_PollDump ();
+        M_PollProfile ();
+        G_PollDemo ();
+        G_PollSaveState ();
         DD_ProcGameAct();
         DD_FrameEnd();
         DD_FpsUpdate();
@@ -1637,6 +1655,40 @@ void D_DoomMain (void)
     DEH_printf("I_Init: Setting up machine state.\n");
     I_CheckIsScreensaver();
     I_InitTimer();
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Look every lump name up <n> times with the linear scan, the lump
+    // directory and cached lump refs, and print the timings.
+    //
+
+    p = M_CheckParmWithArgs("-benchlumps", 1);
+
+    if (p)
+    {
+        W_BenchLookups(atoi(myargv[p+1]));
+    }
+
+    //!
+    // @arg <files>
+    // @category obscure
+    //
+    // Read every lump of each WAD in turn, plain or LZ4 packed, and
+    // print the load time and bytes read from the card.
+    //
+
+    p = M_CheckParmWithArgs("-benchwad", 1);
+
+    if (p)
+    {
+        while (++p != myargc && myargv[p][0] != '-')
+        {
+            W_BenchFile(D_TryFindWADByName(myargv[p]));
+        }
+    }
+
     I_InitJoystick();
     I_InitSound(true);
     I_InitMusic();
@@ -1784,6 +1836,9 @@ void D_DoomMain (void)
         startloadgame = -1;
     }
 
+    // Load the derived tables of the loaded WADs, if they are cached
+    M_SnapshotInit ();
+
     DEH_printf("M_Init: Init miscellaneous info.\n");
     M_Init ();
 
@@ -1793,6 +1848,8 @@ void D_DoomMain (void)
     DEH_printf("\nP_Init: Init Playloop state.\n");
     P_Init ();
 
+    M_SnapshotFinish ();
+
     DD_LoadAltPkgGame();
 
     DEH_printf("S_Init: Setting up sound.\n");
@@ -1808,6 +1865,8 @@ void D_DoomMain (void)
 
     DEH_printf("ST_Init: Init status bar.\n");
     ST_Init ();
+
+    wipe_Init ();
     DEH_printf("Memory left: [0x%08x] bytes\n", heap_avail());
 
     // If Doom II without a MAP01 lump, this is a store demo.
@@ -1839,6 +1898,10 @@ void D_DoomMain (void)
 		autostart = true;
     }
 
+    G_InitDemoSeek ();
+    G_InitSaveStates ();
+    M_ProfileInit ();
+
     p = M_CheckParmWithArgs("-playdemo", 1);
     if (p)
     {
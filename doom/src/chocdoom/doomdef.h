@@ -41,6 +41,10 @@
 // most parameter validation debugging code will not be compiled
 //#define RANGECHECK
 
+// Compact BSP nodes and seg vertices for the BSP walk (see r_defs.h).
+// Set to 0 for the original pointer and fixed_t layout.
+#define COMPACTLEVEL 1
+
 // The maximum number of players, multiplayer/networking.
 #define MAXPLAYERS 4
 
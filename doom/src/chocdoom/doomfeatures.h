@@ -35,6 +35,10 @@
 
 #undef FEATURE_SOUND
 
+// Enables the scoped profiler (PROF_ENTER/PROF_EXIT, m_profile.c);
+// without it the instrumentation compiles to nothing.  Left undefined
+// here: the build targets that want it pass -DFEATURE_PROFILER
+
 #endif /* #ifndef DOOM_FEATURES_H */
 
 
@@ -189,6 +189,12 @@ extern  boolean	usergame;
 extern  boolean	demoplayback;
 extern  boolean	demorecording;
 
+// Running a demo ahead without drawing or sound, see G_SeekDemo.
+extern  boolean	demoseeking;
+
+// Tics played or recorded of the current demo.
+extern  int32_t	demotic;
+
 // Round angleturn in ticcmds to the nearest 256.  This is used when
 // recording Vanilla demos in netgames.
 
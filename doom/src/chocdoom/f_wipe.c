@@ -22,11 +22,14 @@
 #include "i_video.h"
 #include "v_video.h"
 #include "m_random.h"
+#include "i_timer.h"
 
 #include "doomtype.h"
 
 #include "f_wipe.h"
 
+#include <bsp_cmd.h>
+
 //
 //                       SCREEN WIPE PACKAGE
 //
@@ -38,29 +41,60 @@ static pix_t*	wipe_scr_start;
 static pix_t*	wipe_scr_end;
 static pix_t*	wipe_scr;
 
+//
+// WIPE BUFFERS
+// The start and end screens are allocated once by wipe_Init and kept
+// between wipes as PU_CACHE, so a wipe normally allocates nothing.
+// If the zone had to purge them they are taken back on the next wipe.
+//
+#define WIPESCREENSIZE	(SCREENWIDTH * SCREENHEIGHT * sizeof(pix_t))
 
-void
-wipe_shittyColMajorXform
-( short*	array,
-  int		width,
-  int		height )
-{
-    int		x;
-    int		y;
-    short*	dest;
+// The melt moves the screen in columns two pixels wide.
+#define WIPECOLWIDTH	(2 * sizeof(pix_t))
+
+//
+// WIPE STATISTICS
+// How long the last wipe took from its first frame to its last, the
+// number of frames, and the zone bytes it had to allocate to run.
+//
+int32_t		wipemsec;
+int32_t		wipeframes;
+int32_t		wipezone;
 
-    dest = (short*) Z_Malloc(width*height*2, PU_STATIC, 0);
+static int	wipestarttime;
 
-    for(y=0;y<height;y++)
-	for(x=0;x<width;x++)
-	    dest[x*height+y] = array[y*width+x];
 
-    d_memcpy(array, dest, width*height*2);
+static void wipe_GetBuffer (pix_t** buffer)
+{
+    if (*buffer)
+    {
+	Z_ChangeTag(*buffer, PU_STATIC);
+	return;
+    }
 
-    Z_Free(dest);
+    *buffer = Z_Malloc(WIPESCREENSIZE, PU_STATIC, buffer);
+    wipezone += WIPESCREENSIZE;
+}
+
+static void wipe_ReleaseBuffers (void)
+{
+    Z_ChangeTag(wipe_scr_start, PU_CACHE);
+    Z_ChangeTag(wipe_scr_end, PU_CACHE);
+}
 
+void wipe_Init (void)
+{
+    wipe_GetBuffer(&wipe_scr_start);
+    wipe_GetBuffer(&wipe_scr_end);
+    wipe_ReleaseBuffers();
+    wipezone = 0;
+
+    cmd_register_i32(&wipemsec, "wipemsec");
+    cmd_register_i32(&wipeframes, "wipeframes");
+    cmd_register_i32(&wipezone, "wipezone");
 }
 
+
 int
 wipe_initColorXForm
 ( int	width,
@@ -71,6 +105,27 @@ wipe_initColorXForm
     return 0;
 }
 
+//
+// wipe_ColorXFormPixel
+// Steps one pixel toward its end value.
+//
+static inline pix_t
+wipe_ColorXFormPixel
+( int	w,
+  int	e,
+  int	ticks )
+{
+    if (w > e)
+	return (w - ticks < e) ? e : w - ticks;
+
+    return (w + ticks > e) ? e : w + ticks;
+}
+
+//
+// wipe_doColorXForm
+// Compares four pixels at a time and only looks at the single pixels
+// of the words that still differ from the end screen.
+//
 int
 wipe_doColorXForm
 ( int	width,
@@ -78,39 +133,32 @@ wipe_doColorXForm
   int	ticks )
 {
     boolean	changed;
-    pix_t*	w;
-    pix_t*	e;
-    int		newval;
+    uint32_t*	w;
+    uint32_t*	e;
+    uint32_t*	stop;
+    pix_t*	wp;
+    pix_t*	ep;
+    int		i;
 
     changed = false;
-    w = wipe_scr;
-    e = wipe_scr_end;
-    
-    while (w!=wipe_scr+width*height)
+    w = (uint32_t *) wipe_scr;
+    e = (uint32_t *) wipe_scr_end;
+    stop = w + width*height*sizeof(pix_t)/sizeof(uint32_t);
+
+    for ( ; w != stop; w++, e++)
     {
-	if (*w != *e)
+	if (*w == *e)
+	    continue;
+
+	wp = (pix_t *) w;
+	ep = (pix_t *) e;
+
+	for (i = 0; i < (int) (sizeof(uint32_t)/sizeof(pix_t)); i++)
 	{
-	    if (*w > *e)
-	    {
-		newval = *w - ticks;
-		if (newval < *e)
-		    *w = *e;
-		else
-		    *w = newval;
-		changed = true;
-	    }
-	    else if (*w < *e)
-	    {
-		newval = *w + ticks;
-		if (newval > *e)
-		    *w = *e;
-		else
-		    *w = newval;
-		changed = true;
-	    }
+	    if (wp[i] != ep[i])
+		wp[i] = wipe_ColorXFormPixel(wp[i], ep[i], ticks);
 	}
-	w++;
-	e++;
+	changed = true;
     }
 
     return !changed;
@@ -127,7 +175,11 @@ wipe_exitColorXForm
 }
 
 
-static int*	y;
+// Column positions, and where each column was when the current
+// frame started.  Only the first half is used by the melt, the rest
+// is set up so the random number sequence is the same as it was.
+static int	y[SCREENWIDTH];
+static int	oldy[SCREENWIDTH / 2];
 
 int
 wipe_initMelt
@@ -140,14 +192,8 @@ wipe_initMelt
     // copy start screen to main screen
     d_memcpy(wipe_scr, wipe_scr_start, width*height*sizeof(pix_t));
     
-    // makes this wipe faster (in theory)
-    // to have stuff in column-major format
-    wipe_shittyColMajorXform((short*)wipe_scr_start, width/2, height);
-    wipe_shittyColMajorXform((short*)wipe_scr_end, width/2, height);
-    
     // setup initial column positions
     // (y<0 => not ready to scroll yet)
-    y = (int *) Z_Malloc(width*sizeof(int), PU_STATIC, 0);
     y[0] = -(M_Random()%16);
     for (i=1;i<width;i++)
     {
@@ -160,6 +206,43 @@ wipe_initMelt
     return 0;
 }
 
+//
+// wipe_MeltColumns
+// Redraws a run of adjacent columns that moved from oldpos to pos
+// this frame: the end screen rows they uncovered, and the start
+// screen shifted down below them.  Both buffers are row-major, so
+// every row is one span copy for the whole run.
+//
+static void
+wipe_MeltColumns
+( int	x,
+  int	count,
+  int	oldpos,
+  int	pos,
+  int	width,
+  int	height )
+{
+    pix_t*	s;
+    pix_t*	d;
+    int		bytes;
+    int		row;
+
+    bytes = count * WIPECOLWIDTH;
+    x *= 2;
+
+    if (oldpos < 0)
+	oldpos = 0;
+
+    s = wipe_scr_end + oldpos*width + x;
+    d = wipe_scr + oldpos*width + x;
+    for (row = oldpos; row < pos; row++, s += width, d += width)
+	d_memcpy(d, s, bytes);
+
+    s = wipe_scr_start + x;
+    for ( ; row < height; row++, s += width, d += width)
+	d_memcpy(d, s, bytes);
+}
+
 int
 wipe_doMelt
 ( int	width,
@@ -169,17 +252,17 @@ wipe_doMelt
     int		i;
     int		j;
     int		dy;
-    int		idx;
-    
-    uint32_t*	s;
-    uint32_t*	d;
+    int		cols;
     boolean	done = true;
 
-    width/=2;
+    cols = width/2;
+
+    for (i=0;i<cols;i++)
+	oldy[i] = y[i];
 
     while (ticks--)
     {
-	for (i=0;i<width;i++)
+	for (i=0;i<cols;i++)
 	{
 	    if (y[i]<0)
 	    {
@@ -189,28 +272,25 @@ wipe_doMelt
 	    {
 		dy = (y[i] < 16) ? y[i]+1 : 8;
 		if (y[i]+dy >= height) dy = height - y[i];
-		s = &((uint32_t *)wipe_scr_end)[i*height+y[i]];
-		d = &((uint32_t *)wipe_scr)[y[i]*width+i];
-		idx = 0;
-		for (j=dy;j;j--)
-		{
-		    d[idx] = *(s++);
-		    idx += width;
-		}
 		y[i] += dy;
-		s = &((uint32_t *)wipe_scr_start)[i*height];
-		d = &((uint32_t *)wipe_scr)[y[i]*width+i];
-		idx = 0;
-		for (j=height-y[i];j;j--)
-		{
-		    d[idx] = *(s++);
-		    idx += width;
-		}
 		done = false;
 	    }
 	}
     }
 
+    // redraw the columns that moved, a run of equal ones at a time
+    for (i=0;i<cols;i=j)
+    {
+	for (j=i+1;j<cols;j++)
+	{
+	    if (y[j] != y[i] || oldy[j] != oldy[i])
+		break;
+	}
+
+	if (y[i] > 0 && y[i] != oldy[i])
+	    wipe_MeltColumns(i, j-i, oldy[i], y[i], width, height);
+    }
+
     return done;
 
 }
@@ -221,9 +301,6 @@ wipe_exitMelt
   int	height,
   int	ticks )
 {
-    Z_Free(y);
-    Z_Free(wipe_scr_start);
-    Z_Free(wipe_scr_end);
     return 0;
 }
 
@@ -234,7 +311,8 @@ wipe_StartScreen
   int	width,
   int	height )
 {
-    wipe_scr_start = (pix_t *)Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(pix_t), PU_STATIC, NULL);
+    wipezone = 0;
+    wipe_GetBuffer(&wipe_scr_start);
     I_ReadScreen(wipe_scr_start);
     return 0;
 }
@@ -246,7 +324,7 @@ wipe_EndScreen
   int	width,
   int	height )
 {
-    wipe_scr_end = (pix_t *)Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(pix_t), PU_STATIC, NULL);
+    wipe_GetBuffer(&wipe_scr_end);
     I_ReadScreen(wipe_scr_end);
     V_DrawBlock(x, y, width, height, wipe_scr_start); // restore start scr.
     return 0;
@@ -274,12 +352,16 @@ wipe_ScreenWipe
 	go = 1;
 	// wipe_scr = (byte *) Z_Malloc(width*height, PU_STATIC, 0); // DEBUG
 	wipe_scr = I_VideoBuffer;
+	wipemsec = 0;
+	wipeframes = 0;
+	wipestarttime = I_GetTimeMS();
 	(*wipes[wipeno*3])(width, height, ticks);
     }
 
     // do a piece of wipe-in
     V_MarkRect(0, 0, width, height);
     rc = (*wipes[wipeno*3+1])(width, height, ticks);
+    wipeframes++;
     //  V_DrawBlock(x, y, 0, width, height, wipe_scr); // DEBUG
 
     // final stuff
@@ -287,6 +369,8 @@ wipe_ScreenWipe
     {
 	go = 0;
 	(*wipes[wipeno*3+2])(width, height, ticks);
+	wipe_ReleaseBuffers();
+	wipemsec = I_GetTimeMS() - wipestarttime;
     }
 
     return !go;
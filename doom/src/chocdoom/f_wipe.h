@@ -35,6 +35,8 @@ enum
     wipe_NUMWIPES
 };
 
+void wipe_Init (void);
+
 int
 wipe_StartScreen
 ( int		x,
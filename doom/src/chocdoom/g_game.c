@@ -44,6 +44,7 @@
 #include "p_tick.h"
 
 #include "d_main.h"
+#include "d_loop.h"
 
 #include "wi_stuff.h"
 #include "hu_stuff.h"
@@ -71,9 +72,11 @@
 
 
 #include "g_game.h"
+#include "p_tichash.h"
 
 #include "misc_utils.h"
 #include <dev_io.h>
+#include <bsp_cmd.h>
 #define SAVEGAMESIZE	0x2c000
 
 void	G_ReadDemoTiccmd (ticcmd_t* cmd); 
@@ -212,6 +215,24 @@ int		bodyqueslot;
  
 int             vanilla_savegame_limit = 1;
 int             vanilla_demo_limit = 1;
+
+// Seeking runs the demo up to a tic as fast as it will go, with no
+// drawing or sound, then plays on or stays paused.
+
+#define DEMOSEEKSLICE		100		// msec of tics between frames
+
+boolean		demoseeking;
+int32_t		demoseek;		// console: demo tic to seek to
+int32_t		demoseekpause;		// stay paused after a seek
+int32_t		demopaused;
+int32_t		demotic;		// tics played or recorded of the demo
+
+static int	demoseektic;
+static int	demoseekstart;		// demotic when the seek started
+static int	demoseekmsec;
+
+static boolean	G_SeekSaveState (int tic);
+static void	G_AutoSaveState (void);
  
 int G_CmdChecksum (ticcmd_t* cmd) 
 { 
@@ -553,6 +574,14 @@ void G_DoLoadLevel (void)
 // 
 boolean G_Responder (event_t* ev) 
 { 
+    // the pause key lets a demo stopped by a seek go on
+    if (demoplayback && demopaused
+     && ev->type == ev_keydown && ev->data1 == key_pause)
+    {
+	demopaused = false;
+	return true;
+    }
+
     // allow spy mode changes even during the demo
     if (gamestate == GS_LEVEL && ev->type == ev_keydown 
      && ev->data1 == key_spy && (singledemo || !deathmatch) )
@@ -719,9 +748,18 @@ void G_Ticker (void)
         gameaction = gameaction_next;
         gameaction_next = ga_nothing;
     }
+
+    // a demo left paused by a seek neither reads tics nor runs the
+    // game, but menu actions above still go through
+    if (demoplayback && demopaused)
+	return;
+
     // get commands, check consistancy,
     // and build new consistancy check
     buf = (gametic/ticdup)%BACKUPTICS; 
+
+    if (demoplayback || demorecording)
+	demotic++;
  
     for (i=0 ; i<MAXPLAYERS ; i++)
     {
@@ -1669,10 +1707,185 @@ G_InitNew
 // 
 #define DEMOMARKER		0x80
 
+// Demos are streamed to and from the card through one small buffer
+// rather than held whole in the zone.  The recorder flushes it between
+// frames, and every few seconds even if it is not full, ending what it
+// wrote with the demo marker.  This is a timed flush only: the file
+// stays open until the recording ends, so the length on the card is
+// not updated before then.
+
+#define DEMOBUFSIZE		4096
+#define DEMOFLUSHSIZE		512		// flush between frames from here
+#define DEMOREFILLSIZE		(DEMOBUFSIZE/2)	// refill between frames below here
+#define DEMOFLUSHTICS		(TICRATE*5)	// flush at least this often
+
+static byte	demostreambuf[DEMOBUFSIZE];
+
+static int	demofile = -1;		// recording
+static int	demofilelen;		// bytes on the card, without the marker
+static int	demomaxlen;		// -maxdemo, with vanilla_demo_limit
+static int	demoflushtic;
+
+static int	demolump = -1;		// playing back
+static int	demolumppos;		// bytes of the lump read so far
+static int	demoheaderlen;		// bytes of the lump before the first tic
+
+
+//
+// G_FlushDemo
+// Writes out the buffered tics, followed by a marker that the next
+// flush writes over.  timed is set by the periodic flush.
+//
+static void G_FlushDemo (boolean timed)
+{
+    static byte	marker = DEMOMARKER;
+    int		len;
+
+    len = demo_p - demobuffer;
+
+    if (len > 0)
+    {
+	if (d_write (demofile, demobuffer, len) < 0)
+	    I_Error ("G_FlushDemo: write error on %s", demoname);
+
+	d_write (demofile, &marker, 1);
+	demofilelen += len;
+	d_seek (demofile, demofilelen, DSEEK_SET);
+	demo_p = demobuffer;
+    }
+
+    if (timed)
+	demoflushtic = gametic;
+}
+
+
+//
+// G_RefillDemo
+// Tops up the playback buffer from the demo lump.
+//
+static void G_RefillDemo (void)
+{
+    int		left;
+    int		len;
+
+    if (demolump < 0)
+	return;
+
+    left = demoend - demo_p;
+    memmove (demobuffer, demo_p, left);
+
+    len = W_ReadLumpPart (demolump, demolumppos,
+			  demobuffer + left, DEMOBUFSIZE - left);
+    demolumppos += len;
+
+    demo_p = demobuffer;
+    demoend = demobuffer + left + len;
+}
+
+
+//
+// G_StartSeek
+// Seeking back starts the demo over.
+//
+static void G_StartSeek (int tic)
+{
+    if (G_SeekSaveState (tic))
+    {
+	// went to the latest save state before tic
+	demoseekstart = demotic;
+    }
+    else if (tic < demotic)
+    {
+	gameaction = ga_playdemo;
+	demoseekstart = 0;
+    }
+    else
+    {
+	demoseekstart = demotic;
+    }
+
+    demoseektic = tic;
+    demoseekmsec = 0;
+    demoseeking = true;
+    demopaused = false;
+}
+
+
+void G_SeekDemo (void)
+{
+    boolean	oldsingletics;
+    int		start;
+    int		msec;
+    int		tics;
+
+    oldsingletics = singletics;
+    singletics = true;
+    start = I_GetTimeMS ();
+
+    // a restart is pending while gameaction is ga_playdemo
+    while (gameaction == ga_playdemo
+        || (demoplayback && demotic < demoseektic))
+    {
+	TryRunTics ();
+	G_AutoSaveState ();
+
+	if (I_GetTimeMS () - start >= DEMOSEEKSLICE)
+	    break;
+    }
+
+    singletics = oldsingletics;
+    demoseekmsec += I_GetTimeMS () - start;
+
+    if (!demoplayback && gameaction != ga_playdemo)
+    {
+	// the demo ran out first
+	demoseeking = false;
+	return;
+    }
+
+    if (gameaction != ga_playdemo && demotic >= demoseektic)
+    {
+	tics = demotic - demoseekstart;
+	msec = demoseekmsec > 0 ? demoseekmsec : 1;
+
+	printf ("G_SeekDemo: tic %i, ran %i tics in %i ms (%i tics/sec)\n",
+		demotic, tics, msec, tics * 1000 / msec);
+
+	demoseeking = false;
+	demopaused = demoseekpause;
+    }
+}
+
+
+void G_PollDemo (void)
+{
+    if (demoseek > 0 && demoplayback && !demoseeking)
+    {
+	G_StartSeek (demoseek);
+	demoseek = 0;
+    }
+
+    if (demorecording && demofile >= 0)
+    {
+	if (gametic - demoflushtic >= DEMOFLUSHTICS)
+	    G_FlushDemo (true);
+	else if (demo_p - demobuffer >= DEMOFLUSHSIZE)
+	    G_FlushDemo (false);
+    }
+    else if (demoplayback && demoend - demo_p < DEMOREFILLSIZE)
+    {
+	G_RefillDemo ();
+    }
+}
+
 
 void G_ReadDemoTiccmd (ticcmd_t* cmd) 
 { 
-    if (*demo_p == DEMOMARKER) 
+    // a tic is at most 5 bytes
+    if (demoplayback && demoend - demo_p < 5)
+	G_RefillDemo ();
+
+    if (demo_p >= demoend || *demo_p == DEMOMARKER) 
     {
 	// end of demo data stream 
 	G_CheckDemoStatus (); 
@@ -1696,38 +1909,6 @@ void G_ReadDemoTiccmd (ticcmd_t* cmd)
     cmd->buttons = (unsigned char)*demo_p++; 
 } 
 
-// Increase the size of the demo buffer to allow unlimited demos
-
-static void IncreaseDemoBuffer(void)
-{
-    int current_length;
-    byte *new_demobuffer;
-    byte *new_demop;
-    int new_length;
-
-    // Find the current size
-
-    current_length = demoend - demobuffer;
-    
-    // Generate a new buffer twice the size
-    new_length = current_length * 2;
-    
-    new_demobuffer = (byte *)Z_Malloc(new_length, PU_STATIC, 0);
-    new_demop = new_demobuffer + (demo_p - demobuffer);
-
-    // Copy over the old data
-
-    d_memcpy(new_demobuffer, demobuffer, current_length);
-
-    // Free the old buffer and point the demo pointers at the new buffer.
-
-    Z_Free(demobuffer);
-
-    demobuffer = new_demobuffer;
-    demo_p = new_demop;
-    demoend = demobuffer + new_length;
-}
-
 void G_WriteDemoTiccmd (ticcmd_t* cmd) 
 { 
     byte *demo_start;
@@ -1735,6 +1916,18 @@ void G_WriteDemoTiccmd (ticcmd_t* cmd)
     if (gamekeydown[key_demo_quit])           // press q to end demo recording 
 	G_CheckDemoStatus (); 
 
+    if (vanilla_demo_limit
+     && demofilelen + (demo_p - demobuffer) > demomaxlen - 16)
+    {
+        // no more space 
+        G_CheckDemoStatus (); 
+        return; 
+    }
+
+    // The frame loop did not get to flush it in time
+    if (demo_p > demoend - 16)
+	G_FlushDemo (false);
+
     demo_start = demo_p;
 
     *demo_p++ = cmd->forwardmove; 
@@ -1757,23 +1950,6 @@ void G_WriteDemoTiccmd (ticcmd_t* cmd)
     // reset demo pointer back
     demo_p = demo_start;
 
-    if (demo_p > demoend - 16)
-    {
-        if (vanilla_demo_limit)
-        {
-            // no more space 
-            G_CheckDemoStatus (); 
-            return; 
-        }
-        else
-        {
-            // Vanilla demo limit disabled: unlimited
-            // demo lengths!
-
-            IncreaseDemoBuffer();
-        }
-    } 
-	
     G_ReadDemoTiccmd (cmd);         // make SURE it is exactly the same 
 } 
  
@@ -1799,18 +1975,59 @@ void G_RecordDemo (char *name)
     // @category demo
     // @vanilla
     //
-    // Specify the demo buffer size (KiB)
+    // Specify the largest demo to record (KiB), unless
+    // vanilla_demo_limit is turned off.
     //
 
     i = M_CheckParmWithArgs("-maxdemo", 1);
     if (i)
 	maxsize = atoi(myargv[i+1])*1024;
-    demobuffer = (byte *)Z_Malloc (maxsize,PU_STATIC,NULL); 
-    demoend = demobuffer + maxsize;
+    demomaxlen = maxsize;
+
+    d_open (demoname, &demofile, "+w");
+    if (demofile < 0)
+	I_Error ("G_RecordDemo: can't create %s", demoname);
+    demofilelen = 0;
+
+    demobuffer = demo_p = demostreambuf;
+    demoend = demobuffer + DEMOBUFSIZE;
 	
     demorecording = true; 
 } 
 
+//
+// G_InitDemoSeek
+//
+void G_InitDemoSeek (void)
+{
+    int		p;
+
+    //!
+    // @arg <tic>
+    // @category demo
+    //
+    // Run the demo played back up to the given tic as fast as
+    // possible, without drawing or sound, then play on.
+    //
+
+    p = M_CheckParmWithArgs ("-demoseek", 1);
+    if (p)
+	demoseek = atoi (myargv[p+1]);
+
+    //!
+    // @category demo
+    //
+    // Stay paused once -demoseek gets there; the pause key goes on.
+    //
+
+    demoseekpause = M_CheckParm ("-demoseekpause") > 0;
+
+    cmd_register_i32 (&demoseek, "demoseek");
+    cmd_register_i32 (&demoseekpause, "demoseekpause");
+    cmd_register_i32 (&demopaused, "demopaused");
+    cmd_register_i32 (&demotic, "demotic");
+}
+
 // Get the demo version code appropriate for the version set in gameversion.
 int G_VanillaVersionCode(void)
 {
@@ -1847,6 +2064,8 @@ void G_BeginRecording (void)
     lowres_turn = !longtics;
     
     demo_p = demobuffer;
+    demoflushtic = gametic;
+    demotic = 0;
 	
     // Save the right version code for this demo
  
@@ -1870,6 +2089,8 @@ void G_BeginRecording (void)
 	 
     for (i=0 ; i<MAXPLAYERS ; i++) 
 	*demo_p++ = playeringame[i]; 		 
+
+    P_TicHashRecord (demoname);
 } 
  
 
@@ -1934,7 +2155,11 @@ void G_DoPlayDemo (void)
     int demoversion;
 	 
     gameaction = ga_nothing; 
-    demobuffer = demo_p = (byte *)W_CacheLumpName (defdemoname, PU_STATIC); 
+    demolump = W_GetNumForName (defdemoname);
+    demolumppos = 0;
+    demotic = 0;
+    demobuffer = demo_p = demoend = demostreambuf;
+    G_RefillDemo ();
 
     demoversion = *demo_p++;
 
@@ -1973,6 +2198,9 @@ void G_DoPlayDemo (void)
     for (i=0 ; i<MAXPLAYERS ; i++) 
 	playeringame[i] = *demo_p++; 
 
+    // the buffer holds the lump from its start
+    demoheaderlen = demo_p - demobuffer;
+
     if (playeringame[1] || M_CheckParm("-solo-net") > 0
                         || M_CheckParm("-netdemo") > 0)
     {
@@ -1988,6 +2216,8 @@ void G_DoPlayDemo (void)
 
     usergame = false; 
     demoplayback = true; 
+
+    P_TicHashVerify (defdemoname);
 } 
 
 //
@@ -2025,6 +2255,8 @@ boolean G_CheckDemoStatus (void)
 { 
     int             endtime; 
 	 
+    P_TicHashEnd ();
+
     if (timingdemo) 
     { 
         float fps;
@@ -2044,7 +2276,7 @@ boolean G_CheckDemoStatus (void)
 	 
     if (demoplayback) 
     { 
-        W_ReleaseLumpName(defdemoname);
+        demolump = -1;
 	demoplayback = false; 
 	netdemo = false;
 	netgame = false;
@@ -2065,15 +2297,403 @@ boolean G_CheckDemoStatus (void)
  
     if (demorecording) 
     { 
-	*demo_p++ = DEMOMARKER; 
-	M_WriteFile (demoname, demobuffer, demo_p - demobuffer); 
-	Z_Free (demobuffer); 
+	G_FlushDemo (false);
+	d_close (demofile);
+	demofile = -1;
 	demorecording = false; 
 	I_Error ("Demo %s recorded",demoname); 
     } 
 	 
     return false; 
-} 
+}
  
  
  
+//
+// SAVE STATES
+// A ring of in memory snapshots of the level (see P_ArchiveSaveState)
+// for quick saves and loads, rewinding, and seeking back in demos.
+// The snapshots are PU_CACHE, so the zone may take the older ones
+// back when it runs short.
+//
+
+#define MAXSAVESTATES	32
+
+typedef struct
+{
+    byte*	data;		// NULL once purged
+    int		size;
+    skill_t	skill;
+    int		episode;
+    int		map;
+    int		demolump;	// -1 unless taken in demo playback
+    int		demotic;
+    boolean	locked;		// kept PU_STATIC, not purgable
+} savestate_t;
+
+static savestate_t	savestates[MAXSAVESTATES];
+static int		savestatehead;	// slot the next state goes in
+static int		savestatetic;	// demotic or gametic of the last one
+
+int32_t		numsavestates = 8;	// slots in the ring in use
+int32_t		savestatetics;		// take one this often, 0 for never
+int32_t		statesave;		// console: take one now
+int32_t		stateload;		// console: go back to the n-th last
+int32_t		statebench;		// console: time n saves and loads
+
+
+//
+// G_TakeSaveState
+// Takes a save state into st, over the one it held.
+//
+static boolean G_TakeSaveState (savestate_t *st)
+{
+    int		size;
+
+    if (gamestate != GS_LEVEL || netgame)
+	return false;
+
+    if (st->data)
+	Z_Free (st->data);
+
+    // measure it, then write it
+    size = P_ArchiveSaveState (NULL, 0);
+    Z_Malloc (size, PU_STATIC, &st->data);
+    if (P_ArchiveSaveState (st->data, size) != size)
+	I_Error ("G_SaveState: save state changed size");
+    if (!st->locked)
+	Z_ChangeTag (st->data, PU_CACHE);
+
+    st->size = size;
+    st->skill = gameskill;
+    st->episode = gameepisode;
+    st->map = gamemap;
+    st->demolump = demoplayback ? demolump : -1;
+    st->demotic = demotic;
+
+    return true;
+}
+
+
+//
+// G_SaveState
+// Takes a save state into the next slot of the ring.
+//
+static savestate_t *G_SaveState (void)
+{
+    savestate_t*	st;
+
+    if (numsavestates < 1 || numsavestates > MAXSAVESTATES)
+	numsavestates = MAXSAVESTATES;
+
+    st = &savestates[savestatehead % numsavestates];
+
+    if (!G_TakeSaveState (st))
+	return NULL;
+
+    savestatehead = (savestatehead + 1) % numsavestates;
+    savestatetic = demoplayback ? demotic : gametic;
+
+    return st;
+}
+
+
+//
+// G_SetDemoTic
+// Moves demo playback to the start of a tic.
+//
+static void G_SetDemoTic (int tic)
+{
+    int		players;
+    int		ticsize;
+    int		i;
+
+    players = 0;
+    for (i=0 ; i<MAXPLAYERS ; i++)
+	if (playeringame[i])
+	    players++;
+
+    ticsize = longtics ? 5 : 4;
+
+    demolumppos = demoheaderlen + tic * ticsize * players;
+    demo_p = demoend = demobuffer;
+    G_RefillDemo ();
+
+    demotic = tic;
+    P_TicHashSeek (tic);
+}
+
+
+//
+// G_LoadState
+// Puts the level back as a save state left it, loading the map first
+// if it is another one.
+//
+static boolean G_LoadState (savestate_t *st)
+{
+    boolean	oldusergame;
+    boolean	olddemoplayback;
+    boolean	ok;
+
+    if (!st->data || netgame || demorecording)
+	return false;
+
+    Z_ChangeTag (st->data, PU_STATIC);
+
+    if (gamestate != GS_LEVEL || st->skill != gameskill
+     || st->episode != gameepisode || st->map != gamemap)
+    {
+	oldusergame = usergame;
+	olddemoplayback = demoplayback;
+	precache = false;
+	G_InitNew (st->skill, st->episode, st->map);
+	precache = true;
+	usergame = oldusergame;
+	demoplayback = olddemoplayback;
+    }
+
+    ok = P_UnArchiveSaveState (st->data, st->size);
+    if (!st->locked)
+	Z_ChangeTag (st->data, PU_CACHE);
+
+    if (!ok)
+	return false;
+
+    if (demoplayback && st->demolump == demolump)
+	G_SetDemoTic (st->demotic);
+
+    savestatetic = demoplayback ? demotic : gametic;
+
+    if (setsizeneeded)
+	R_ExecuteSetViewSize ();
+
+    R_FillBackScreen ();
+
+    return true;
+}
+
+
+//
+// G_SeekSaveState
+// Loads the last save state of this demo at or before tic, unless
+// playing on from here gets there sooner.
+//
+static boolean G_SeekSaveState (int tic)
+{
+    savestate_t*	st;
+    savestate_t*	best;
+    int			i;
+
+    best = NULL;
+
+    for (i = 0, st = savestates; i < numsavestates; i++, st++)
+    {
+	if (!st->data || st->demolump != demolump || st->demotic > tic)
+	    continue;
+
+	if (!best || st->demotic > best->demotic)
+	    best = st;
+    }
+
+    if (!best || (best->demotic <= demotic && demotic <= tic))
+	return false;
+
+    return G_LoadState (best);
+}
+
+
+//
+// G_AutoSaveState
+// Takes a save state every savestatetics, for rewinding and for
+// seeking back in demos.
+//
+static void G_AutoSaveState (void)
+{
+    int		now;
+
+    if (savestatetics <= 0 || gamestate != GS_LEVEL
+     || (demoplayback && demopaused) || demorecording)
+	return;
+
+    now = demoplayback ? demotic : gametic;
+
+    if (now - savestatetic >= savestatetics || now < savestatetic)
+	G_SaveState ();
+}
+
+
+static void G_FreeSaveState (savestate_t *st)
+{
+    if (st->data)
+	Z_Free (st->data);
+    st->data = NULL;
+}
+
+
+//
+// G_BenchSaveState
+// Times savegames through the card against save states.  The states
+// go in a slot of their own, so the ring is left as it was, locked
+// so that loading the savegames can not purge them.
+//
+static void G_BenchSaveState (int count)
+{
+    static savestate_t	bench;
+    savestate_t*	st;
+    char*		tempfile;
+    int			start;
+    int			filesave, fileload, memsave, memload;
+    int			i;
+
+    if (demoplayback || demorecording)
+    {
+	printf ("G_BenchSaveState: not while a demo plays or records\n");
+	return;
+    }
+
+    st = &bench;
+    st->locked = true;
+    if (!G_TakeSaveState (st))
+    {
+	printf ("G_BenchSaveState: not in a level\n");
+	return;
+    }
+
+    tempfile = P_TempSaveGameFile ();
+
+    filesave = fileload = 0;
+    for (i = 0; i < count; i++)
+    {
+	start = I_GetTimeMS ();
+	d_open (tempfile, &save_stream, "+w");
+	if (save_stream < 0)
+	{
+	    printf ("G_BenchSaveState: can't create %s\n", tempfile);
+	    G_FreeSaveState (st);
+	    return;
+	}
+	savegame_error = false;
+	P_WriteSaveGameHeader ("bench");
+	P_ArchivePlayers ();
+	P_ArchiveWorld ();
+	P_ArchiveThinkers ();
+	P_ArchiveSpecials ();
+	P_WriteSaveGameEOF ();
+	d_close (save_stream);
+	filesave += I_GetTimeMS () - start;
+
+	start = I_GetTimeMS ();
+	M_StringCopy (savename, tempfile, sizeof(savename));
+	G_DoLoadGame ();
+	fileload += I_GetTimeMS () - start;
+
+	// a savegame drops state, so go back to the exact one
+	if (!G_LoadState (st))
+	{
+	    printf ("G_BenchSaveState: can't go back to the save state\n");
+	    d_unlink (tempfile);
+	    G_FreeSaveState (st);
+	    return;
+	}
+    }
+    d_unlink (tempfile);
+
+    memsave = memload = 0;
+    for (i = 0; i < count; i++)
+    {
+	start = I_GetTimeMS ();
+	G_TakeSaveState (st);
+	memsave += I_GetTimeMS () - start;
+
+	start = I_GetTimeMS ();
+	if (!G_LoadState (st))
+	{
+	    printf ("G_BenchSaveState: can't load the save state\n");
+	    G_FreeSaveState (st);
+	    return;
+	}
+	memload += I_GetTimeMS () - start;
+    }
+
+    printf ("G_BenchSaveState: %i times, file save %i ms load %i ms, "
+	    "memory save %i ms load %i ms, %i bytes a state\n",
+	    count, filesave, fileload, memsave, memload, st->size);
+
+    G_FreeSaveState (st);
+}
+
+
+void G_PollSaveState (void)
+{
+    savestate_t*	st;
+    int			slot;
+
+    if (statesave)
+    {
+	statesave = 0;
+	st = G_SaveState ();
+	if (st)
+	    printf ("G_SaveState: %i bytes\n", st->size);
+    }
+
+    if (stateload > 0)
+    {
+	if (stateload <= numsavestates)
+	{
+	    slot = (savestatehead - stateload + numsavestates) % numsavestates;
+	    if (!G_LoadState (&savestates[slot]))
+		printf ("G_LoadState: no save state %i\n", stateload);
+	}
+	stateload = 0;
+    }
+
+    if (statebench > 0)
+    {
+	G_BenchSaveState (statebench);
+	statebench = 0;
+    }
+
+    if (!demoseeking)
+	G_AutoSaveState ();
+}
+
+
+//
+// G_InitSaveStates
+//
+void G_InitSaveStates (void)
+{
+    int		p;
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Keep a ring of <n> save states in memory (8 by default).
+    //
+
+    p = M_CheckParmWithArgs ("-savestates", 1);
+    if (p)
+	numsavestates = atoi (myargv[p+1]);
+
+    if (numsavestates < 1 || numsavestates > MAXSAVESTATES)
+	numsavestates = MAXSAVESTATES;
+
+    //!
+    // @arg <secs>
+    // @category obscure
+    //
+    // Take a save state every <secs> seconds of play or demo, to
+    // rewind to with stateload and to speed up demo seeks.
+    //
+
+    p = M_CheckParmWithArgs ("-rewind", 1);
+    if (p)
+	savestatetics = atoi (myargv[p+1]) * TICRATE;
+
+    cmd_register_i32 (&numsavestates, "savestates");
+    cmd_register_i32 (&savestatetics, "savestatetics");
+    cmd_register_i32 (&statesave, "statesave");
+    cmd_register_i32 (&stateload, "stateload");
+    cmd_register_i32 (&statebench, "statebench");
+}
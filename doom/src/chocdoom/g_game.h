@@ -57,6 +57,19 @@ void G_PlayDemo (char* name);
 void G_TimeDemo (char* name);
 boolean G_CheckDemoStatus (void);
 
+// Called between frames to move demo data to and from the card.
+void G_PollDemo (void);
+
+// Sets up demo seeking, before a demo is started.
+void G_InitDemoSeek (void);
+
+// Runs the demo ahead for a while; called instead of a frame.
+void G_SeekDemo (void);
+
+// In memory save states: set up, then polled between frames.
+void G_InitSaveStates (void);
+void G_PollSaveState (void);
+
 void G_ExitLevel (void);
 void G_SecretExitLevel (void);
 
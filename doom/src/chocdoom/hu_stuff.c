@@ -25,12 +25,18 @@
 
 #include "deh_main.h"
 #include "i_swap.h"
+#include "i_timer.h"
 #include "i_video.h"
 
 #include "hu_stuff.h"
 #include "hu_lib.h"
+#include "m_argv.h"
 #include "m_controls.h"
 #include "m_misc.h"
+#include "r_local.h"
+#include "r_plane.h"
+#include "v_video.h"
+#include "w_file.h"
 #include "w_wad.h"
 
 #include "s_sound.h"
@@ -40,7 +46,9 @@
 // Data.
 #include "dstrings.h"
 #include "sounds.h"
+#include "m_profile.h"
 #include <bsp_sys.h>
+#include <bsp_cmd.h>
 //
 // Locally used constants, shortcuts.
 //
@@ -104,6 +112,39 @@ extern int		showMessages;
 
 static boolean		headsupactive = false;
 
+//
+// PERFORMANCE OVERLAY
+// Figures over the top right of the view while perfoverlay is set:
+// a graph of the last PERFSAMPLES frame times at one pixel per ms,
+// their percentiles, the zone, the renderer counts, the SD bytes of
+// the last second and the most palette loads in one frame.  The text
+// is formatted once a second, so a frame only pays for the patches.
+//
+#define PERFSAMPLES	128
+#define PERFLINES	5
+#define PERFLINELEN	24
+#define PERFLINEHEIGHT	8
+#define PERFGRAPHHEIGHT	40
+#define PERFCOLOR_OK	112	// green
+#define PERFCOLOR_SLOW	176	// red, slower than a tic
+#define PERFCOLOR_TIC	209	// white
+
+int32_t			perfoverlay;
+
+static byte		perfsamples[PERFSAMPLES];
+static int		perfsample;
+static int		perfcount;
+static int		perflasttime;
+static int		perfsecond;
+static int		perfframes;
+static int		perfplanes;
+static int		perfsegs;
+static int		perfsprites;
+static int		perfpalettes;
+static unsigned int	perfpalettesets;
+static unsigned int	perfbytes;
+static char		perftext[PERFLINES][PERFLINELEN];
+
 //
 // Builtin map names.
 // The actual names can be found in DStrings.h.
@@ -298,6 +339,16 @@ void HU_Init(void)
 	hu_font[i] = (patch_t *) W_CacheLumpName(buffer, PU_STATIC);
     }
 
+    //!
+    // @category obscure
+    //
+    // Show the performance overlay from the start.
+    //
+
+    if (M_CheckParm("-perfoverlay"))
+	perfoverlay = 1;
+
+    cmd_register_i32(&perfoverlay, "perfoverlay");
 }
 
 void HU_Stop(void)
@@ -390,13 +441,173 @@ void HU_Drawer(void)
 
 }
 
+// True while the message, chat line or performance overlay is drawn
+// over the view.
+boolean HU_Overlaid(void)
+{
+    return message_on || chat_on || perfoverlay;
+}
+
+//
+// HU_PerfWrite
+// One line of the overlay in the heads-up font.
+//
+static void HU_PerfWrite(int x, int y, char *s)
+{
+    int		c;
+    int		w;
+
+    for ( ; *s; s++)
+    {
+	c = toupper(*s) - HU_FONTSTART;
+	if (c < 0 || c >= HU_FONTSIZE)
+	{
+	    x += 4;
+	    continue;
+	}
+
+	w = READ_LE_I16(hu_font[c]->width);
+	if (x + w > SCREENWIDTH)
+	    break;
+	V_DrawPatchDirect(x, y, hu_font[c]);
+	x += w;
+    }
+}
+
+//
+// HU_PerfFormat
+// Formats the figures of the second that just ended.
+//
+static void HU_PerfFormat(int now)
+{
+    static const int	cut[3] = { 50, 95, 99 };
+    int		counts[256];
+    int		pct[3];
+    int		i;
+    int		n;
+    int		sum;
+    int		freebytes;
+    int		largest;
+
+    // percentiles of the frame times in the graph
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < perfcount; i++)
+	counts[perfsamples[i]]++;
+
+    memset(pct, 0, sizeof(pct));
+    for (i = n = sum = 0; i < 256 && n < 3; i++)
+    {
+	sum += counts[i];
+	while (n < 3 && sum * 100 >= cut[n] * perfcount)
+	    pct[n++] = i;
+    }
+
+    Z_FreeStats(&freebytes, &largest);
+
+    M_snprintf(perftext[0], PERFLINELEN, "FPS %d  AVG %d MS",
+	       perfframes, perfframes ? (now - perfsecond) / perfframes : 0);
+    M_snprintf(perftext[1], PERFLINELEN, "P50 %d P95 %d P99 %d",
+	       pct[0], pct[1], pct[2]);
+    M_snprintf(perftext[2], PERFLINELEN, "ZONE %dK BLOCK %dK",
+	       freebytes >> 10, largest >> 10);
+    M_snprintf(perftext[3], PERFLINELEN, "VP %d DS %d VS %d",
+	       perfplanes, perfsegs, perfsprites);
+    M_snprintf(perftext[4], PERFLINELEN, "SD %dK PAL %d",
+	       (w_bytesread - perfbytes) >> 10, perfpalettes);
+
+    perfsecond = now;
+    perfframes = 0;
+    perfbytes = w_bytesread;
+    perfplanes = perfsegs = perfsprites = perfpalettes = 0;
+}
+
+//
+// HU_DrawPerf
+// The performance overlay, drawn after HU_Drawer.
+//
+void HU_DrawPerf(void)
+{
+    int		now;
+    int		x;
+    int		y;
+    int		i;
+    int		ms;
+    int		h;
+
+    if (!perfoverlay)
+    {
+	perflasttime = 0;
+	return;
+    }
+
+    PROF_ENTER();
+
+    now = I_GetTimeMS();
+
+    // this frame
+    if (perflasttime)
+    {
+	ms = now - perflasttime;
+	perfsamples[perfsample] = ms > 255 ? 255 : ms;
+	perfsample = (perfsample + 1) % PERFSAMPLES;
+	if (perfcount < PERFSAMPLES)
+	    perfcount++;
+    }
+    else
+    {
+	perfsecond = now;
+	perfbytes = w_bytesread;
+    }
+    perflasttime = now;
+    perfframes++;
+
+    // the most of each in one frame this second
+    if (perfplanes < lastvisplane - visplanes)
+	perfplanes = lastvisplane - visplanes;
+    if (perfsegs < ds_p - drawsegs)
+	perfsegs = ds_p - drawsegs;
+    if (perfsprites < vissprite_p - vissprites)
+	perfsprites = vissprite_p - vissprites;
+    if (perfpalettes < i_palettesets - perfpalettesets)
+	perfpalettes = i_palettesets - perfpalettesets;
+    perfpalettesets = i_palettesets;
+
+    if (now - perfsecond >= 1000)
+	HU_PerfFormat(now);
+
+    // top right of the view
+    x = viewwindowx + scaledviewwidth - PERFSAMPLES;
+    if (x < viewwindowx)
+	x = viewwindowx;
+    y = viewwindowy + 1;
+
+    for (i = 0; i < PERFLINES; i++, y += PERFLINEHEIGHT)
+	HU_PerfWrite(x, y, perftext[i]);
+
+    // frame times, oldest first, with the line at one tic
+    y += PERFGRAPHHEIGHT;
+    V_DrawHorizLine(x, y - 1000 / TICRATE, PERFSAMPLES, PERFCOLOR_TIC);
+
+    for (i = 0; i < perfcount; i++)
+    {
+	ms = perfsamples[(perfsample - perfcount + i + PERFSAMPLES) % PERFSAMPLES];
+	h = ms > PERFGRAPHHEIGHT ? PERFGRAPHHEIGHT : ms;
+	V_DrawVertLine(x + PERFSAMPLES - perfcount + i, y - h, h,
+		       ms > 1000 / TICRATE ? PERFCOLOR_SLOW : PERFCOLOR_OK);
+    }
+
+    V_MarkRect(x, viewwindowy, PERFSAMPLES, y - viewwindowy);
+
+    PROF_EXIT();
+}
+
 void HU_Erase(void)
 {
-    profiler_enter();
+    PROF_ENTER();
     HUlib_eraseSText(&w_message);
     HUlib_eraseIText(&w_chat);
     HUlib_eraseTextLine(&w_title);
-    profiler_exit();
+    PROF_EXIT();
 }
 
 extern uint32_t fps_prev;
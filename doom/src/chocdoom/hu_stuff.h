@@ -50,8 +50,10 @@ boolean HU_Responder(event_t* ev);
 
 void HU_Ticker(void);
 void HU_Drawer(void);
+void HU_DrawPerf(void);
 char HU_dequeueChatChar(void);
 void HU_Erase(void);
+boolean HU_Overlaid(void);
 
 extern char *chat_macros[10];
 
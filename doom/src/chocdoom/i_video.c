@@ -22,6 +22,7 @@
 //
 //-----------------------------------------------------------------------------
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -36,6 +37,7 @@
 
 #include "v_video.h"
 #include "m_argv.h"
+#include "m_snapshot.h"
 #include "d_event.h"
 #include "d_main.h"
 #include "i_video.h"
@@ -263,6 +265,37 @@ pix_t I_BlendPixMap (pix_t fg, pix_t bg)
     return map[aclut[fg]];
 }
 
+// Builds the blend table the fuzz and translucent columns read, from
+// the play palette.  Called once by ST_Init, before anything is drawn.
+void I_InitBlendTable (void)
+{
+    byte *snap;
+    int size;
+
+    if (!rgb_palette) {
+        fatal_error("");
+    }
+    if (g_color_lookup_table) {
+        return;
+    }
+
+    // Read for every translucent pixel: fast RAM if it still fits.
+    g_color_lookup_table = Z_MallocTier(sizeof(*g_color_lookup_table), PU_STATIC, NULL, Z_TIER_FAST);
+
+    // The snapshot table is only good for the palette it was
+    // built from (the gamma level may have changed since).
+    snap = M_SnapshotGet(snap_blut, &size);
+    if (snap && size == clut_num_bytes + sizeof(*g_color_lookup_table) &&
+        !memcmp(snap, rgb_palette, clut_num_bytes)) {
+        d_memcpy(g_color_lookup_table, snap + clut_num_bytes, sizeof(*g_color_lookup_table));
+        return;
+    }
+    I_GenBlut8(g_color_lookup_table, rgb_palette, clut_num_entries);
+    M_SnapshotAdd(snap_blut, rgb_palette, clut_num_bytes);
+    M_SnapshotAdd(snap_blut, g_color_lookup_table, sizeof(*g_color_lookup_table));
+    M_SnapshotEnd(snap_blut);
+}
+
 void I_SetPlayPal (void)
 {
     if (!rgb_palette) {
@@ -270,13 +303,6 @@ void I_SetPlayPal (void)
     }
     prev_clut = p_palette;
     p_palette = rgb_palette;
-
-    if (g_color_lookup_table == NULL) {
-        g_color_lookup_table = Z_Malloc(sizeof(*g_color_lookup_table), PU_STATIC, NULL);
-        if (g_color_lookup_table) {
-            I_GenBlut8(g_color_lookup_table, p_palette, clut_num_entries);
-        }
-    }
 }
 
 void I_RestorePal (void)
@@ -287,6 +313,10 @@ void I_RestorePal (void)
     p_palette = prev_clut;
 }
 
+// Palette loads so far, for the performance overlay.
+
+unsigned int i_palettesets;
+
 void I_SetPalette (byte* palette, int idx)
 {
     unsigned int i;
@@ -296,6 +326,7 @@ void I_SetPalette (byte* palette, int idx)
     if (idx > arrlen(palettes)) {
         fatal_error("");
     }
+    i_palettesets++;
     if (palettes[idx]) {
         p_palette = palettes[idx];
         goto sw_done;
@@ -107,6 +107,7 @@ void I_ShutdownGraphics(void);
 
 // Takes full 8 bit values.
 void I_SetPalette (byte* palette, int idx);
+extern unsigned int i_palettesets;
 int I_GetPaletteIndex(int r, int g, int b);
 
 void I_UpdateNoBlit (void);
@@ -143,6 +144,7 @@ void I_StartTic (void);
 void I_EnableLoadingDisk(void);
 
 void I_RefreshClutsButPlaypal (void);
+void I_InitBlendTable (void);
 void I_SetPlayPal (void);
 void I_RestorePal (void);
 
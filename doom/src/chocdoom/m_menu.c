@@ -57,6 +57,7 @@
 #include "sounds.h"
 
 #include "m_menu.h"
+#include "m_profile.h"
 #include "d_iwad.h"
 #include "p_saveg.h"
 #include <misc_utils.h>
@@ -589,7 +590,7 @@ void M_ReadSaveStrings(void)
 void M_DrawLoad(void)
 {
     int             i;
-    profiler_enter();
+    PROF_ENTER();
     V_DrawPatchDirect(72, 28, 
                           (patch_t *)W_CacheLumpName(DEH_String("M_LOADG"), PU_CACHE));
     for (i = 0;i < load_end; i++)
@@ -597,7 +598,7 @@ void M_DrawLoad(void)
         M_DrawSaveLoadBorder(LoadDef.x,LoadDef.y+LINEHEIGHT*i);
         M_WriteText(LoadDef.x,LoadDef.y+LINEHEIGHT*i,savegamestrings[i]);
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 
@@ -609,7 +610,7 @@ void M_DrawSaveLoadBorder(int x,int y)
 {
 #ifndef STM32_SDK
     int             i;
-	profiler_enter();
+	PROF_ENTER();
     V_DrawPatchDirect(x - 8, y + 7,
                       (patch_t *)W_CacheLumpName(DEH_String("M_LSLEFT"), PU_CACHE));
     for (i = 0;i < 24;i++)
@@ -620,7 +621,7 @@ void M_DrawSaveLoadBorder(int x,int y)
     }
     V_DrawPatchDirect(x, y + 7, 
                       (patch_t *)W_CacheLumpName(DEH_String("M_LSRGHT"), PU_CACHE));
-    profiler_exit();
+    PROF_EXIT();
 #endif
 }
 
@@ -1309,21 +1310,22 @@ M_DrawThermo
   int	thermWidth,
   int	thermDot )
 {
+    static lumpref_t	thermref[4];
     int		xx;
     int		i;
 
     xx = x;
-    V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpName(DEH_String("M_THERML"), PU_CACHE));
+    V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpRef(&thermref[0], DEH_String("M_THERML"), PU_CACHE));
     xx += 8;
     for (i=0;i<thermWidth;i++)
     {
-	V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpName(DEH_String("M_THERMM"), PU_CACHE));
+	V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpRef(&thermref[1], DEH_String("M_THERMM"), PU_CACHE));
 	xx += 8;
     }
-    V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpName(DEH_String("M_THERMR"), PU_CACHE));
+    V_DrawPatchDirect(xx, y, (patch_t *)W_CacheLumpRef(&thermref[2], DEH_String("M_THERMR"), PU_CACHE));
 
     V_DrawPatchDirect((x + 8) + thermDot * 8, y,
-		      (patch_t *)W_CacheLumpName(DEH_String("M_THERMO"), PU_CACHE));
+		      (patch_t *)W_CacheLumpRef(&thermref[3], DEH_String("M_THERMO"), PU_CACHE));
 }
 
 
@@ -1431,7 +1433,7 @@ M_WriteText
     ch = string;
     cx = x;
     cy = y;
-	profiler_enter();
+	PROF_ENTER();
     while(1)
     {
 	c = *ch++;
@@ -1457,7 +1459,7 @@ M_WriteText
 	V_DrawPatchDirect(cx, cy, hu_font[c]);
 	cx+=w;
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 // These keys evaluate to a "null" key in Vanilla Doom that allows weird
@@ -2032,7 +2034,7 @@ void M_Drawer (void)
     char               *name;
     int			start;
 
-    profiler_enter();
+    PROF_ENTER();
 
     inhelpscreens = false;
     
@@ -2073,7 +2075,7 @@ void M_Drawer (void)
 	    y += READ_LE_I16(hu_font[0]->height);
 	}
 
-    profiler_exit();
+    PROF_EXIT();
     return;
     }
 
@@ -2083,7 +2085,7 @@ void M_Drawer (void)
     }
 
     if (!menuactive) {
-        profiler_exit();
+        PROF_EXIT();
         return;
     }
 
@@ -2110,7 +2112,7 @@ void M_Drawer (void)
     V_DrawPatchDirect(x + SKULLXOFF, currentMenu->y - 5 + itemOn*LINEHEIGHT,
 		      (patch_t *)W_CacheLumpName(DEH_String(skullName[whichSkull]),
 				      PU_CACHE));
-    profiler_exit();
+    PROF_EXIT();
 }
 
 
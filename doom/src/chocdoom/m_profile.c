@@ -0,0 +1,355 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Scoped profiler: per-site counters and an event ring that
+//      can be exported as a Chrome trace.
+//
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "doomtype.h"
+#include "d_main.h"
+#include "i_timer.h"
+#include "m_misc.h"
+#include "m_profile.h"
+#include <dev_io.h>
+#include <bsp_cmd.h>
+
+#if defined(STM32F769xx)
+#include "stm32f7xx.h"
+#elif defined(STM32H747xx)
+#include "stm32h7xx.h"
+#else
+#include <time.h>
+#endif
+
+#if defined(STM32F769xx) || defined(STM32H747xx)
+#define PROF_DWT
+#endif
+
+#define PROF_MAXSITES	64
+#define PROF_MAXDEPTH	32
+#define PROF_TRACEFILE	"trace.json"
+
+// Must be a power of two.
+#define PROF_EVENTS	2048
+
+enum
+{
+    PROF_BEGIN,
+    PROF_END
+};
+
+typedef struct
+{
+    uint32_t	time;
+    uint16_t	site;
+    uint16_t	phase;
+} profevent_t;
+
+//
+// EVENT RING
+// Written only by the game loop, which moves profhead on after each
+// event is complete, so a reader only has to stop recording to see
+// a consistent copy of the last PROF_EVENTS events.
+//
+static profevent_t		profring[PROF_EVENTS];
+static volatile uint32_t	profhead;
+
+// Site 0 is never used, so an unregistered site has index 0.
+static profsite_t*	profsites[PROF_MAXSITES];
+static int		numprofsites = 1;
+
+// Sites currently being timed, innermost last.
+static profsite_t*	profstack[PROF_MAXDEPTH];
+static int		profdepth;
+
+// Clock ticks per microsecond.
+static uint32_t		proftickrate;
+static int		profresettime;
+
+//
+// PROFILER CONTROL
+// profrecord turns the event ring on and off, and starts off.  Set profdump to 1 to
+// print the per-site counters and start them over, to 2 to write the
+// ring to trace.json, or to 3 to print it on the console.  The trace
+// loads in chrome://tracing or Perfetto.
+//
+int32_t		profrecord;
+int32_t		profdump;
+
+
+static inline uint32_t M_ProfileClock (void)
+{
+#ifdef PROF_DWT
+    return DWT->CYCCNT;
+#else
+    struct timespec	ts;
+
+    clock_gettime (CLOCK_MONOTONIC, &ts);
+    return (uint32_t) ts.tv_sec * 1000000000u + (uint32_t) ts.tv_nsec;
+#endif
+}
+
+static void M_ProfileEvent (profsite_t* site, uint32_t time, int phase)
+{
+    profevent_t*	ev;
+
+    if (!profrecord || !site->index)
+	return;
+
+    ev = &profring[profhead & (PROF_EVENTS - 1)];
+    ev->time = time;
+    ev->site = site->index;
+    ev->phase = phase;
+    profhead++;
+}
+
+static void M_RegisterSite (profsite_t* site, const char* name)
+{
+    site->name = name;
+
+    if (numprofsites < PROF_MAXSITES)
+    {
+	site->index = numprofsites;
+	profsites[numprofsites++] = site;
+    }
+}
+
+//
+// M_ProfileEnter
+// A site entered again before it exits is only counted, so a
+// recursive function is timed once from the outermost call.
+//
+void M_ProfileEnter (profsite_t* site, const char* name)
+{
+    if (site->depth++)
+    {
+	site->calls++;
+	return;
+    }
+
+    if (!site->name)
+	M_RegisterSite (site, name);
+
+    if (profdepth < PROF_MAXDEPTH)
+	profstack[profdepth++] = site;
+
+    site->child = 0;
+    site->start = M_ProfileClock ();
+    M_ProfileEvent (site, site->start, PROF_BEGIN);
+}
+
+void M_ProfileExit (profsite_t* site)
+{
+    uint32_t	now;
+    uint32_t	elapsed;
+
+    // an exit without its enter would leave the site stuck
+    if (site->depth <= 0 || --site->depth)
+	return;
+
+    now = M_ProfileClock ();
+    elapsed = now - site->start;
+
+    site->calls++;
+    site->total += elapsed;
+    site->self += elapsed - site->child;
+
+    if (profdepth && profstack[profdepth - 1] == site)
+	profdepth--;
+    if (profdepth)
+	profstack[profdepth - 1]->child += elapsed;
+
+    M_ProfileEvent (site, now, PROF_END);
+}
+
+
+//
+// M_ProfileInit
+//
+void M_ProfileInit (void)
+{
+#ifdef PROF_DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->LAR = 0xC5ACCE55;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    proftickrate = SystemCoreClock / 1000000;
+#else
+    proftickrate = 1000;
+#endif
+    profresettime = I_GetTimeMS ();
+
+    cmd_register_i32 (&profrecord, "profrecord");
+    cmd_register_i32 (&profdump, "profdump");
+}
+
+//
+// M_ProfilePrintf
+// Prints to the console if f < 0, else writes to file f.
+//
+static void M_ProfilePrintf (int f, char *s, ...)
+{
+    char	buf[160];
+    va_list	args;
+    int		len;
+
+    va_start (args, s);
+    len = M_vsnprintf (buf, sizeof(buf), s, args);
+    va_end (args);
+
+    if (f < 0)
+	printf ("%s", buf);
+    else
+	d_write (f, buf, len);
+}
+
+//
+// M_PrintProfile
+// Counters of every site since the last dump, then starts them over.
+//
+static void M_PrintProfile (void)
+{
+    profsite_t*	site;
+    int		i;
+
+    printf ("profile over %d ms\n", I_GetTimeMS () - profresettime);
+    printf ("%-24s %8s %10s %10s\n", "site", "calls", "total us", "self us");
+
+    for (i = 1; i < numprofsites; i++)
+    {
+	site = profsites[i];
+	printf ("%-24s %8u %10u %10u\n", site->name, (unsigned) site->calls,
+		(unsigned) (site->total / proftickrate),
+		(unsigned) (site->self / proftickrate));
+
+	site->calls = 0;
+	site->total = 0;
+	site->self = 0;
+    }
+
+    profresettime = I_GetTimeMS ();
+}
+
+//
+// M_WriteTrace
+// The event ring in the Chrome trace event format, timed from its
+// oldest event.  Ends left over from events the ring already dropped
+// are skipped.
+//
+static void M_WriteTrace (int f)
+{
+    profevent_t*	ev;
+    uint32_t		head;
+    uint32_t		i;
+    uint32_t		last;
+    uint64_t		stamp;
+    uint32_t		usec;
+    byte		open[PROF_MAXSITES];
+    boolean		first;
+
+    head = profhead;
+    i = head > PROF_EVENTS ? head - PROF_EVENTS : 0;
+
+    memset (open, 0, sizeof(open));
+    first = true;
+    stamp = 0;
+    last = profring[i & (PROF_EVENTS - 1)].time;
+
+    M_ProfilePrintf (f, "{\"traceEvents\":[\n");
+
+    for ( ; i != head; i++)
+    {
+	ev = &profring[i & (PROF_EVENTS - 1)];
+
+	// 64-bit time from the wrapping clock
+	stamp += ev->time - last;
+	last = ev->time;
+
+	if (ev->phase == PROF_END)
+	{
+	    if (!open[ev->site])
+		continue;
+	    open[ev->site]--;
+	}
+	else
+	{
+	    open[ev->site]++;
+	}
+
+	usec = (uint32_t) (stamp / proftickrate);
+
+	M_ProfilePrintf (f, "%s{\"name\":\"%s\",\"ph\":\"%c\","
+			 "\"ts\":%u.%03u,\"pid\":1,\"tid\":1}",
+			 first ? "" : ",\n",
+			 profsites[ev->site]->name,
+			 ev->phase == PROF_END ? 'E' : 'B',
+			 (unsigned) usec,
+			 (unsigned) ((stamp % proftickrate) * 1000 / proftickrate));
+	first = false;
+    }
+
+    M_ProfilePrintf (f, "\n],\"displayTimeUnit\":\"ms\"}\n");
+}
+
+static void M_WriteTraceFile (void)
+{
+    char	path[D_MAX_PATH];
+    int		f;
+
+    DD_GETPATH (path, PROF_TRACEFILE);
+
+    d_open (path, &f, "+w");
+    if (f < 0)
+    {
+	printf ("M_WriteTraceFile: can't create %s\n", path);
+	return;
+    }
+
+    M_WriteTrace (f);
+    d_close (f);
+
+    printf ("M_WriteTraceFile: wrote %s\n", path);
+}
+
+//
+// M_PollProfile
+// Once per frame: acts on profdump set from the console.  Recording
+// stops while the ring is read.
+//
+void M_PollProfile (void)
+{
+    int32_t	record;
+
+    if (!profdump)
+	return;
+
+    record = profrecord;
+    profrecord = 0;
+
+    if (profdump == 1)
+	M_PrintProfile ();
+    else if (profdump == 2)
+	M_WriteTraceFile ();
+    else
+	M_WriteTrace (-1);
+
+    profrecord = record;
+    profdump = 0;
+}
+
@@ -0,0 +1,77 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Scoped profiler: per-site counters and an event ring that
+//      can be exported as a Chrome trace.
+//
+
+
+#ifndef __M_PROFILE__
+#define __M_PROFILE__
+
+#include "doomtype.h"
+#include "doomfeatures.h"
+
+//
+// One instrumented function.  PROF_ENTER declares it static in the
+// function it profiles; it is registered the first time it is entered.
+//
+typedef struct
+{
+    const char*	name;
+    int		index;		// in the site table, 0 until registered
+    int		depth;		// recursion, only the outermost call is timed
+
+    uint32_t	start;
+    uint32_t	child;		// time spent in nested sites this call
+
+    uint32_t	calls;
+    uint64_t	total;		// clock ticks, nested sites included
+    uint64_t	self;		// clock ticks, nested sites excluded
+} profsite_t;
+
+#ifdef FEATURE_PROFILER
+
+#define PROF_ENTER()							\
+    static profsite_t prof_site;					\
+    M_ProfileEnter (&prof_site, __func__)
+
+#define PROF_EXIT()	M_ProfileExit (&prof_site)
+
+// Times a call rather than a whole function, under the given name.
+#define PROF_ENTER_AS(name)						\
+    static profsite_t prof_##name;					\
+    M_ProfileEnter (&prof_##name, #name)
+
+#define PROF_EXIT_AS(name)	M_ProfileExit (&prof_##name)
+
+#else
+
+#define PROF_ENTER()
+#define PROF_EXIT()
+#define PROF_ENTER_AS(name)
+#define PROF_EXIT_AS(name)
+
+#endif
+
+void M_ProfileInit (void);
+void M_ProfileEnter (profsite_t* site, const char* name);
+void M_ProfileExit (profsite_t* site);
+
+// Once per frame: acts on profdump set from the console.
+void M_PollProfile (void);
+
+#endif
+
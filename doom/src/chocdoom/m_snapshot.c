@@ -0,0 +1,430 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Boot snapshot of the tables derived from the WADs at startup.
+//
+//	A cold boot builds the texture, sprite, animation and blend
+//	tables as usual and hands them to M_SnapshotAdd.  Once every
+//	section is in, they are written to bootsnap.bin next to the
+//	WADs.  The file is keyed by the W_Checksum digest of the loaded
+//	lump directory and the decor package, so a warm boot with the
+//	same WADs reads it back in a few large reads and the init code
+//	just points its tables into the buffer.
+//
+//	Layout:
+//	    header   "BSNP", version, key, cold boot msec, numsections
+//	    index    numsections x { section, offset, size }
+//	    data     sections, each padded to 8 bytes
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <misc_utils.h>
+#include <debug.h>
+#include <dev_io.h>
+
+#include "doomstat.h"
+#include "d_main.h"
+#include "i_system.h"
+#include "i_timer.h"
+#include "m_argv.h"
+#include "sha1.h"
+#include "w_checksum.h"
+#include "z_zone.h"
+
+#include "m_snapshot.h"
+
+#define SNAPSHOT_ID		"BSNP"
+#define SNAPSHOT_VERSION	1
+#define SNAPSHOT_FILE		"bootsnap.bin"
+
+// Largest single d_read/d_write
+
+#define SNAPSHOT_IOSIZE		0x8000
+
+typedef struct
+{
+    char		id[4];
+    int			version;
+    sha1_digest_t	key;
+    int			coldmsec;
+    int			numsections;
+} snapheader_t;
+
+typedef struct
+{
+    int			section;
+    int			offset;		// from the start of the data
+    int			size;
+} snapentry_t;
+
+typedef struct
+{
+    snapsection_t	section;
+    void*		data;
+    int			size;
+} snapchunk_t;
+
+extern DoomDecorPkg_t game_alt_pkg;
+
+static sha1_digest_t	snapkey;
+static int		snapstart;
+static int		snapcoldmsec;
+static boolean		snapdisabled;
+static boolean		snapwritten;
+
+// warm boot
+
+static byte*		snapdata;
+static snapentry_t	snapindex[NUMSNAPSECTIONS];
+
+// cold boot
+
+static snapchunk_t*	snapchunks;
+static int		numsnapchunks;
+static int		maxsnapchunks;
+static boolean		snappresent[NUMSNAPSECTIONS];
+
+
+static void M_SnapshotKey (sha1_digest_t key)
+{
+    sha1_context_t	sha1_context;
+    sha1_digest_t	wads;
+
+    W_Checksum (wads);
+
+    SHA1_Init (&sha1_context);
+    SHA1_Update (&sha1_context, wads, sizeof(wads));
+    SHA1_UpdateInt32 (&sha1_context, SNAPSHOT_VERSION);
+    SHA1_UpdateInt32 (&sha1_context, game_alt_pkg);
+    SHA1_UpdateInt32 (&sha1_context, gamemode);
+    SHA1_UpdateInt32 (&sha1_context, gamemission);
+    SHA1_UpdateInt32 (&sha1_context, modifiedgame);
+    SHA1_Final (key, &sha1_context);
+}
+
+static boolean M_SnapshotRead (int f, void *buf, int size)
+{
+    byte*	p = buf;
+    int		len;
+
+    while (size > 0)
+    {
+	len = size < SNAPSHOT_IOSIZE ? size : SNAPSHOT_IOSIZE;
+
+	if (d_read (f, p, len) != len)
+	    return false;
+
+	p += len;
+	size -= len;
+    }
+
+    return true;
+}
+
+static boolean M_SnapshotWrite (int f, void *buf, int size)
+{
+    byte*	p = buf;
+    int		len;
+
+    while (size > 0)
+    {
+	len = size < SNAPSHOT_IOSIZE ? size : SNAPSHOT_IOSIZE;
+
+	if (d_write (f, p, len) != len)
+	    return false;
+
+	p += len;
+	size -= len;
+    }
+
+    return true;
+}
+
+
+//
+// M_SnapshotLoad
+// Reads the snapshot file, if it matches snapkey.
+//
+static boolean M_SnapshotLoad (void)
+{
+    char		path[D_MAX_PATH];
+    snapheader_t	header;
+    snapentry_t		index[NUMSNAPSECTIONS];
+    int			f, length, datalen, i;
+
+    DD_GETPATH (path, SNAPSHOT_FILE);
+
+    length = d_open (path, &f, "r");
+    if (f < 0)
+	return false;
+
+    if (length < (int)sizeof(header)
+     || d_read (f, &header, sizeof(header)) != sizeof(header)
+     || memcmp (header.id, SNAPSHOT_ID, 4)
+     || header.version != SNAPSHOT_VERSION
+     || header.numsections != NUMSNAPSECTIONS
+     || memcmp (header.key, snapkey, sizeof(snapkey))
+     || d_read (f, index, sizeof(index)) != sizeof(index))
+    {
+	d_close (f);
+	return false;
+    }
+
+    datalen = length - sizeof(header) - sizeof(index);
+
+    for (i = 0; i < NUMSNAPSECTIONS; i++)
+    {
+	if (index[i].section != i
+	 || index[i].offset < 0 || index[i].size < 0
+	 || index[i].offset + index[i].size > datalen)
+	{
+	    d_close (f);
+	    return false;
+	}
+    }
+
+    snapdata = Z_Malloc (datalen, PU_STATIC, 0);
+
+    if (!M_SnapshotRead (f, snapdata, datalen))
+    {
+	d_close (f);
+	Z_Free (snapdata);
+	snapdata = NULL;
+	return false;
+    }
+    d_close (f);
+
+    memcpy (snapindex, index, sizeof(index));
+    snapcoldmsec = header.coldmsec;
+
+    return true;
+}
+
+
+//
+// M_SnapshotInit
+// Called once the WADs are loaded and before the tables are built.
+//
+void M_SnapshotInit (void)
+{
+    snapstart = I_GetTimeMS ();
+
+    //!
+    // @category obscure
+    //
+    // Don't load or write the boot snapshot (bootsnap.bin).
+    //
+
+    if (M_CheckParm ("-nosnapshot"))
+    {
+	snapdisabled = true;
+	return;
+    }
+
+    M_SnapshotKey (snapkey);
+
+    if (M_SnapshotLoad ())
+	printf ("M_Snapshot: loaded " SNAPSHOT_FILE "\n");
+}
+
+
+void *M_SnapshotGet (snapsection_t section, int *size)
+{
+    if (!snapdata)
+	return NULL;
+
+    *size = snapindex[section].size;
+    return snapdata + snapindex[section].offset;
+}
+
+
+//
+// M_SnapshotSave
+// Writes the sections in order.  The chunks of a section are
+// contiguous in the file even if they were added interleaved.
+//
+static void M_SnapshotSave (void)
+{
+    static const byte	pad[8];
+    char		path[D_MAX_PATH];
+    snapheader_t	header;
+    snapentry_t		index[NUMSNAPSECTIONS];
+    int			f, i, j, offset;
+    boolean		ok;
+
+    offset = 0;
+
+    for (i = 0; i < NUMSNAPSECTIONS; i++)
+    {
+	index[i].section = i;
+	index[i].offset = offset;
+	index[i].size = 0;
+
+	for (j = 0; j < numsnapchunks; j++)
+	{
+	    if (snapchunks[j].section == i)
+		index[i].size += snapchunks[j].size;
+	}
+
+	offset += (index[i].size + 7) & ~7;
+    }
+
+    memcpy (header.id, SNAPSHOT_ID, 4);
+    header.version = SNAPSHOT_VERSION;
+    memcpy (header.key, snapkey, sizeof(snapkey));
+    header.coldmsec = snapcoldmsec;
+    header.numsections = NUMSNAPSECTIONS;
+
+    DD_GETPATH (path, SNAPSHOT_FILE);
+
+    d_open (path, &f, "+w");
+    if (f < 0)
+    {
+	printf ("M_Snapshot: can't create %s\n", path);
+	return;
+    }
+
+    ok = M_SnapshotWrite (f, &header, sizeof(header))
+      && M_SnapshotWrite (f, index, sizeof(index));
+
+    for (i = 0; ok && i < NUMSNAPSECTIONS; i++)
+    {
+	for (j = 0; ok && j < numsnapchunks; j++)
+	{
+	    if (snapchunks[j].section == i)
+		ok = M_SnapshotWrite (f, snapchunks[j].data, snapchunks[j].size);
+	}
+
+	if (ok && (index[i].size & 7))
+	    ok = M_SnapshotWrite (f, (void *)pad, 8 - (index[i].size & 7));
+    }
+
+    d_close (f);
+
+    if (!ok)
+    {
+	// Never leave a truncated snapshot behind
+
+	d_unlink (path);
+	printf ("M_Snapshot: write error on %s\n", path);
+	return;
+    }
+
+    printf ("M_Snapshot: wrote %s, %i bytes\n", path,
+	    (int)(sizeof(header) + sizeof(index)) + offset);
+}
+
+
+//
+// M_SnapshotComplete
+// Writes the file once all sections are in and the cold boot time is
+// known.  The blend table only comes in with ST_Init, after
+// M_SnapshotFinish.
+//
+static void M_SnapshotComplete (void)
+{
+    int		i;
+
+    if (!snapcoldmsec)
+	return;
+
+    for (i = 0; i < NUMSNAPSECTIONS; i++)
+    {
+	if (!snappresent[i])
+	    return;
+    }
+
+    M_SnapshotSave ();
+    snapwritten = true;
+
+    Z_Free (snapchunks);
+    snapchunks = NULL;
+    numsnapchunks = maxsnapchunks = 0;
+}
+
+
+void M_SnapshotAdd (snapsection_t section, void *data, int size)
+{
+    snapchunk_t*	newchunks;
+
+    if (snapdisabled || snapdata || snapwritten)
+	return;
+
+    if (numsnapchunks == maxsnapchunks)
+    {
+	maxsnapchunks = maxsnapchunks ? maxsnapchunks * 2 : 256;
+	newchunks = Z_Malloc (maxsnapchunks * sizeof(*newchunks), PU_STATIC, 0);
+	if (snapchunks)
+	{
+	    memcpy (newchunks, snapchunks, numsnapchunks * sizeof(*newchunks));
+	    Z_Free (snapchunks);
+	}
+	snapchunks = newchunks;
+    }
+
+    snapchunks[numsnapchunks].section = section;
+    snapchunks[numsnapchunks].data = data;
+    snapchunks[numsnapchunks].size = size;
+    numsnapchunks++;
+}
+
+
+//
+// M_SnapshotEnd
+// A section added in several chunks only counts once its last one is
+// in, so the file is never written without it.
+//
+void M_SnapshotEnd (snapsection_t section)
+{
+    if (snapdisabled || snapdata || snapwritten)
+	return;
+
+    snappresent[section] = true;
+
+    M_SnapshotComplete ();
+}
+
+
+//
+// M_SnapshotFinish
+// Called when startup is done.
+//
+void M_SnapshotFinish (void)
+{
+    int		msec;
+
+    msec = I_GetTimeMS () - snapstart;
+
+    if (snapdisabled)
+    {
+	printf ("M_Snapshot: boot took %i ms\n", msec);
+	return;
+    }
+
+    if (snapdata)
+    {
+	printf ("M_Snapshot: warm boot took %i ms (cold %i ms)\n",
+		msec, snapcoldmsec);
+	return;
+    }
+
+    printf ("M_Snapshot: cold boot took %i ms\n", msec);
+
+    snapcoldmsec = msec > 0 ? msec : 1;
+
+    M_SnapshotComplete ();
+}
@@ -0,0 +1,55 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Boot snapshot of the tables derived from the WADs at startup.
+//
+
+
+#ifndef __M_SNAPSHOT__
+#define __M_SNAPSHOT__
+
+#include "doomtype.h"
+
+typedef enum
+{
+    snap_textures,		// texture_t records
+    snap_texturecolumns,	// texturecolumnlump[], then texturecolumnofs[]
+    snap_texturesizes,		// compositesize, widthmask, height
+    snap_spritelumps,		// spritewidth, spriteoffset, spritetopoffset
+    snap_spritedefs,		// numframes of each sprite, then the frames
+    snap_picanims,		// anims[]
+    snap_blut,			// palette, then the blend table built from it
+
+    NUMSNAPSECTIONS
+} snapsection_t;
+
+// Load the snapshot matching the loaded WADs, if there is one.
+void M_SnapshotInit (void);
+
+// Section from the snapshot, NULL when booting cold.
+void *M_SnapshotGet (snapsection_t section, int *size);
+
+// Append data to a section of the snapshot being built.  The data is
+// only written out once all sections are complete, so it must stay
+// allocated until then.
+void M_SnapshotAdd (snapsection_t section, void *data, int size);
+
+// Called after the last chunk of a section has been added.
+void M_SnapshotEnd (snapsection_t section);
+
+// Called once startup is done; reports the boot time.
+void M_SnapshotFinish (void);
+
+#endif
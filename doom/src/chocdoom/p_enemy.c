@@ -23,6 +23,7 @@
 
 #include "m_random.h"
 #include "i_system.h"
+#include "z_zone.h"
 
 #include "doomdef.h"
 #include "p_local.h"
@@ -88,22 +89,135 @@ void A_Fall (mobj_t *actor);
 
 
 //
-// Called by P_NoiseAlert.
-// Recursively traverse adjacent sectors,
-// sound blocking lines cut off traversal.
+// Sound propagation.
+// The flood used to recurse through adjacent sectors,
+//  which on big maps ran deep into the stack.
+// It now keeps its own stack of sectors being flooded,
+//  sized at level load, and visits sectors and lines in
+//  the same order the recursion did.
+// Sound blocking lines cut off traversal.
 //
 
 mobj_t*		soundtarget;
 
-void
-P_RecursiveSound
+typedef struct
+{
+    sector_t*	sec;
+    int		soundblocks;
+    int		portal;		// next portal to follow
+    
+} soundframe_t;
+
+// a sector is flooded at most twice,
+//  once through a sound block and once without
+static soundframe_t*	soundstack;
+static soundframe_t*	soundstack_p;
+
+
+//
+// P_InitSoundPortals
+// Collects the two sided lines of each sector,
+//  for P_NoiseAlert. Called by P_GroupLines.
+//
+void P_InitSoundPortals (void)
+{
+    soundportal_t*	portal;
+    sector_t*		sec;
+    line_t*		check;
+    int			total;
+    int			i;
+    int			j;
+
+    total = 0;
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->portalcount = 0;
+	for (j=0 ; j<sec->linecount ; j++)
+	{
+	    if (sec->lines[j]->flags & ML_TWOSIDED)
+		sec->portalcount++;
+	}
+	total += sec->portalcount;
+    }
+
+    portal = Z_Malloc (total*sizeof(soundportal_t) + 1, PU_LEVEL, 0);
+    soundstack = Z_Malloc ((2*numsectors+1)*sizeof(soundframe_t), PU_LEVEL, 0);
+
+    for (i=0, sec=sectors ; i<numsectors ; i++, sec++)
+    {
+	sec->portals = portal;
+	for (j=0 ; j<sec->linecount ; j++)
+	{
+	    check = sec->lines[j];
+	    if (! (check->flags & ML_TWOSIDED) )
+		continue;
+
+	    portal->line = check;
+	    portal->heightstamp = -1;
+	    portal->open = false;
+
+	    // one sided despite the flag,
+	    //  P_LineOpening never lets it through
+	    if (check->sidenum[1] == -1)
+		portal->other = NULL;
+	    else if ( sides[ check->sidenum[0] ].sector == sec)
+		portal->other = sides[ check->sidenum[1] ] .sector;
+	    else
+		portal->other = sides[ check->sidenum[0] ].sector;
+
+	    portal++;
+	}
+    }
+}
+
+
+//
+// P_PortalOpen
+// P_LineOpening openrange > 0, without touching
+//  the globals, recomputed only after a sector
+//  on either side moved.
+//
+static boolean P_PortalOpen (soundportal_t* portal)
+{
+    line_t*	line;
+    sector_t*	front;
+    sector_t*	back;
+    int		stamp;
+    fixed_t	top;
+    fixed_t	bottom;
+
+    if (!portal->other)
+	return false;
+
+    line = portal->line;
+    front = line->frontsector;
+    back = line->backsector;
+    stamp = front->heightcount + back->heightcount;
+
+    if (portal->heightstamp != stamp)
+    {
+	top = front->ceilingheight < back->ceilingheight ?
+	      front->ceilingheight : back->ceilingheight;
+	bottom = front->floorheight > back->floorheight ?
+		 front->floorheight : back->floorheight;
+
+	portal->open = top - bottom > 0;
+	portal->heightstamp = stamp;
+    }
+    return portal->open;
+}
+
+
+//
+// P_FloodSound
+// Marks sec as reached by the sound and pushes it,
+//  unless it was already flooded at this level.
+//
+static void
+P_FloodSound
 ( sector_t*	sec,
   int		soundblocks )
 {
-    int		i;
-    line_t*	check;
-    sector_t*	other;
-	
     // wake up all monsters in this sector
     if (sec->validcount == validcount
 	&& sec->soundtraversed <= soundblocks+1)
@@ -114,31 +228,11 @@ P_RecursiveSound
     sec->validcount = validcount;
     sec->soundtraversed = soundblocks+1;
     sec->soundtarget = soundtarget;
-	
-    for (i=0 ;i<sec->linecount ; i++)
-    {
-	check = sec->lines[i];
-	if (! (check->flags & ML_TWOSIDED) )
-	    continue;
-	
-	P_LineOpening (check);
 
-	if (openrange <= 0)
-	    continue;	// closed door
-	
-	if ( sides[ check->sidenum[0] ].sector == sec)
-	    other = sides[ check->sidenum[1] ] .sector;
-	else
-	    other = sides[ check->sidenum[0] ].sector;
-	
-	if (check->flags & ML_SOUNDBLOCK)
-	{
-	    if (!soundblocks)
-		P_RecursiveSound (other, 1);
-	}
-	else
-	    P_RecursiveSound (other, soundblocks);
-    }
+    soundstack_p->sec = sec;
+    soundstack_p->soundblocks = soundblocks;
+    soundstack_p->portal = 0;
+    soundstack_p++;
 }
 
 
@@ -153,9 +247,46 @@ P_NoiseAlert
 ( mobj_t*	target,
   mobj_t*	emmiter )
 {
+    soundframe_t*	frame;
+    soundportal_t*	portal;
+    line_t*		lastline;
+
     soundtarget = target;
     validcount++;
-    P_RecursiveSound (emmiter->subsector->sector, 0);
+
+    lastline = NULL;
+    soundstack_p = soundstack;
+    P_FloodSound (emmiter->subsector->sector, 0);
+
+    while (soundstack_p > soundstack)
+    {
+	frame = soundstack_p - 1;
+
+	if (frame->portal == frame->sec->portalcount)
+	{
+	    soundstack_p--;
+	    continue;
+	}
+
+	portal = &frame->sec->portals[frame->portal++];
+	lastline = portal->line;
+
+	if (!P_PortalOpen (portal))
+	    continue;	// closed door
+
+	if (portal->line->flags & ML_SOUNDBLOCK)
+	{
+	    if (!frame->soundblocks)
+		P_FloodSound (portal->other, 1);
+	}
+	else
+	    P_FloodSound (portal->other, frame->soundblocks);
+    }
+
+    // leave opentop and friends as the recursive
+    //  version did, from the last line it checked
+    if (lastline)
+	P_LineOpening (lastline);
 }
 
 
@@ -35,6 +35,8 @@
 // FLOORS
 //
 
+int	planemovecount;
+
 //
 // Move a plane (floor or ceiling) and check for crushing
 //
@@ -49,6 +51,10 @@ T_MovePlane
 {
     boolean	flag;
     fixed_t	lastpos;
+
+    // invalidates the cached sound openings
+    sector->heightcount++;
+    planemovecount++;
 	
     switch(floorOrCeiling)
     {
@@ -233,26 +233,20 @@ void EV_TurnTagLightsOff(line_t* line)
     int			min;
     sector_t*		sector;
     sector_t*		tsec;
-    line_t*		templine;
 	
-    sector = sectors;
+    j = -1;
     
-    for (j = 0;j < numsectors; j++, sector++)
+    while ((j = P_FindSectorFromLineTag(line,j)) >= 0)
     {
-	if (sector->tag == line->tag)
+	sector = &sectors[j];
+	min = sector->lightlevel;
+	for (i = 0;i < sector->neighbourcount; i++)
 	{
-	    min = sector->lightlevel;
-	    for (i = 0;i < sector->linecount; i++)
-	    {
-		templine = sector->lines[i];
-		tsec = getNextSector(templine,sector);
-		if (!tsec)
-		    continue;
-		if (tsec->lightlevel < min)
-		    min = tsec->lightlevel;
-	    }
-	    sector->lightlevel = min;
+	    tsec = sector->neighbours[i];
+	    if (tsec->lightlevel < min)
+		min = tsec->lightlevel;
 	}
+	sector->lightlevel = min;
     }
 }
 
@@ -269,33 +263,27 @@ EV_LightTurnOn
     int		j;
     sector_t*	sector;
     sector_t*	temp;
-    line_t*	templine;
 	
-    sector = sectors;
+    i = -1;
 	
-    for (i=0;i<numsectors;i++, sector++)
+    while ((i = P_FindSectorFromLineTag(line,i)) >= 0)
     {
-	if (sector->tag == line->tag)
+	sector = &sectors[i];
+
+	// bright = 0 means to search
+	// for highest light level
+	// surrounding sector
+	if (!bright)
 	{
-	    // bright = 0 means to search
-	    // for highest light level
-	    // surrounding sector
-	    if (!bright)
+	    for (j = 0;j < sector->neighbourcount; j++)
 	    {
-		for (j = 0;j < sector->linecount; j++)
-		{
-		    templine = sector->lines[j];
-		    temp = getNextSector(templine,sector);
-
-		    if (!temp)
-			continue;
+		temp = sector->neighbours[j];
 
-		    if (temp->lightlevel > bright)
-			bright = temp->lightlevel;
-		}
+		if (temp->lightlevel > bright)
+		    bright = temp->lightlevel;
 	    }
-	    sector-> lightlevel = bright;
 	}
+	sector-> lightlevel = bright;
     }
 }
 
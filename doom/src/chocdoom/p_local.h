@@ -124,6 +124,7 @@ void	P_SpawnPlayerMissile (mobj_t* source, mobjtype_t type);
 //
 // P_ENEMY
 //
+void P_InitSoundPortals (void);
 void P_NoiseAlert (mobj_t* target, mobj_t* emmiter);
 
 
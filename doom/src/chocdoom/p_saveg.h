@@ -55,6 +55,10 @@ void P_UnArchiveThinkers (void);
 void P_ArchiveSpecials (void);
 void P_UnArchiveSpecials (void);
 
+// In memory save states of the current level.
+int P_ArchiveSaveState (byte *buf, int size);
+boolean P_UnArchiveSaveState (byte *buf, int size);
+
 void P_SaveBegin (void);
 uint32_t P_SaveWriteFile (char *name);
 int P_LoadBegin (char *name);
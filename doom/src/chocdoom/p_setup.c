@@ -29,6 +29,7 @@
 #include "m_bbox.h"
 
 #include "g_game.h"
+#include "am_map.h"
 
 #include "i_system.h"
 #include "w_wad.h"
@@ -62,6 +63,10 @@ subsector_t*	subsectors;
 
 int		numnodes;
 node_t*		nodes;
+#if COMPACTLEVEL
+nodebbox_t*	nodebboxes;
+segvertex_t*	segverts;
+#endif
 
 int		numlines;
 line_t*		lines;
@@ -183,6 +188,9 @@ void P_LoadSegs (int lump)
     numsegs = W_LumpLength (lump) / sizeof(mapseg_t);
     segs = Z_Malloc (numsegs*sizeof(seg_t),PU_LEVEL,0);	
     memset (segs, 0, numsegs*sizeof(seg_t));
+#if COMPACTLEVEL
+    segverts = Z_Malloc (numsegs*sizeof(segvertex_t),PU_LEVEL,0);
+#endif
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     ml = (mapseg_t *)data;
@@ -192,6 +200,13 @@ void P_LoadSegs (int lump)
 	li->v1 = &vertexes[READ_LE_I16(ml->v1)];
 	li->v2 = &vertexes[READ_LE_I16(ml->v2)];
 
+#if COMPACTLEVEL
+	segverts[i].x1 = li->v1->x>>FRACBITS;
+	segverts[i].y1 = li->v1->y>>FRACBITS;
+	segverts[i].x2 = li->v2->x>>FRACBITS;
+	segverts[i].y2 = li->v2->y>>FRACBITS;
+#endif
+
 	li->angle = (READ_LE_I16(ml->angle))<<16;
 	li->offset = (READ_LE_I16(ml->offset))<<16;
 	linedef = READ_LE_I16(ml->linedef);
@@ -308,6 +323,9 @@ void P_LoadNodes (int lump)
 	
     numnodes = W_LumpLength (lump) / sizeof(mapnode_t);
     nodes = Z_Malloc (numnodes*sizeof(node_t),PU_LEVEL,0);	
+#if COMPACTLEVEL
+    nodebboxes = Z_Malloc (numnodes*sizeof(nodebbox_t),PU_LEVEL,0);
+#endif
     data = W_CacheLumpNum (lump,PU_STATIC);
 	
     mn = (mapnode_t *)data;
@@ -315,6 +333,18 @@ void P_LoadNodes (int lump)
     
     for (i=0 ; i<numnodes ; i++, no++, mn++)
     {
+#if COMPACTLEVEL
+	no->x = READ_LE_I16(mn->x);
+	no->y = READ_LE_I16(mn->y);
+	no->dx = READ_LE_I16(mn->dx);
+	no->dy = READ_LE_I16(mn->dy);
+	for (j=0 ; j<2 ; j++)
+	{
+	    no->children[j] = READ_LE_I16(mn->children[j]);
+	    for (k=0 ; k<4 ; k++)
+		nodebboxes[i][j][k] = READ_LE_I16(mn->bbox[j][k]);
+	}
+#else
 	no->x = READ_LE_I16(mn->x)<<FRACBITS;
 	no->y = READ_LE_I16(mn->y)<<FRACBITS;
 	no->dx = READ_LE_I16(mn->dx)<<FRACBITS;
@@ -325,6 +355,7 @@ void P_LoadNodes (int lump)
 	    for (k=0 ; k<4 ; k++)
 		no->bbox[j][k] = READ_LE_I16(mn->bbox[j][k])<<FRACBITS;
 	}
+#endif
     }
 	
     W_ReleaseLumpNum(lump);
@@ -538,10 +569,79 @@ void P_LoadBlockMap (int lump)
 
 
 
+//
+// P_InitTagLists
+// Hashes sectors by tag, so P_FindSectorFromLineTag
+//  does not scan all of them. Chains are built
+//  backwards to keep them in ascending order.
+//
+static void P_InitTagLists (void)
+{
+    int		i;
+    int		j;
+
+    for (i=0 ; i<numsectors ; i++)
+	sectors[i].firsttag = -1;
+
+    for (i=numsectors-1 ; i>=0 ; i--)
+    {
+	j = (unsigned) sectors[i].tag % (unsigned) numsectors;
+	sectors[i].nexttag = sectors[j].firsttag;
+	sectors[j].firsttag = i;
+    }
+}
+
+
+//
+// P_InitNeighbours
+// Caches getNextSector for every line of every sector.
+// One entry per two sided line, duplicates included,
+//  so the Vanilla overflow in P_FindNextHighestFloor
+//  still triggers on the same sectors.
+//
+static void P_InitNeighbours (void)
+{
+    sector_t**		buffer;
+    sector_t*		sector;
+    sector_t*		other;
+    int			total;
+    int			i;
+    int			j;
+
+    total = 0;
+    sector = sectors;
+    for (i=0 ; i<numsectors ; i++, sector++)
+    {
+	sector->neighbourcount = 0;
+	for (j=0 ; j<sector->linecount ; j++)
+	{
+	    if (getNextSector (sector->lines[j], sector))
+		sector->neighbourcount++;
+	}
+	total += sector->neighbourcount;
+    }
+
+    buffer = Z_Malloc (total*sizeof(sector_t *) + 1, PU_LEVEL, 0);
+
+    sector = sectors;
+    for (i=0 ; i<numsectors ; i++, sector++)
+    {
+	sector->neighbours = buffer;
+	for (j=0 ; j<sector->linecount ; j++)
+	{
+	    other = getNextSector (sector->lines[j], sector);
+	    if (other)
+		*buffer++ = other;
+	}
+    }
+}
+
+
 //
 // P_GroupLines
 // Builds sector line lists and subsector sector numbers.
 // Finds block bounding boxes for sectors.
+// Indexes sector tags and neighbours.
 //
 void P_GroupLines (void)
 {
@@ -653,7 +753,10 @@ void P_GroupLines (void)
 	block = block < 0 ? 0 : block;
 	sector->blockbox[BOXLEFT]=block;
     }
-	
+
+    P_InitTagLists ();
+    P_InitNeighbours ();
+    P_InitSoundPortals ();
 }
 
 // Pad the REJECT lump with extra data when the lump is too small,
@@ -736,6 +839,37 @@ static void P_LoadReject(int lumpnum)
     }
 }
 
+//
+// P_PrintLevelFootprint
+// Bytes taken by the level geometry, to compare the compact layout.
+//
+static void P_PrintLevelFootprint (char *lumpname)
+{
+    int		nodebytes;
+    int		segbytes;
+    int		total;
+
+    nodebytes = numnodes*sizeof(node_t);
+    segbytes = numsegs*sizeof(seg_t);
+#if COMPACTLEVEL
+    nodebytes += numnodes*sizeof(nodebbox_t);
+    segbytes += numsegs*sizeof(segvertex_t);
+#endif
+
+    total = numvertexes*sizeof(vertex_t)
+	  + segbytes
+	  + numlines*sizeof(line_t)
+	  + numsides*sizeof(side_t)
+	  + numsectors*sizeof(sector_t)
+	  + numsubsectors*sizeof(subsector_t)
+	  + nodebytes;
+
+    printf ("P_SetupLevel: %s geometry %i bytes (nodes %i, segs %i, lines %i)\n",
+	    lumpname, total, nodebytes, segbytes,
+	    numlines*(int)sizeof(line_t));
+}
+
+
 //
 // P_SetupLevel
 //
@@ -801,6 +935,10 @@ P_SetupLevel
     P_GroupLines ();
     P_LoadReject (lumpnum+ML_REJECT);
 
+    P_PrintLevelFootprint (lumpname);
+
+    AM_LevelInit ();
+
 #if 0/*(GFX_COLOR_MODE != GFX_COLOR_MODE_CLUT)*/
     ST_Setup();
 #endif
@@ -833,6 +971,8 @@ P_SetupLevel
     if (precache)
 	R_PrecacheLevel ();
 
+    R_PrefetchLevel ();
+
     //d_printf ("free memory: 0x%x\n", Z_FreeMemory());
 
     // Make sure all sounds are stopped before Z_FreeTags.
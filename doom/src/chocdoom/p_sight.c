@@ -256,7 +256,11 @@ boolean P_CrossSubsector (int num)
 boolean P_CrossBSPNode (int bspnum)
 {
     node_t*	bsp;
+    divline_t*	partition;
     int		side;
+#if COMPACTLEVEL
+    divline_t	dl;
+#endif
 
     if (bspnum & NF_SUBSECTOR)
     {
@@ -267,9 +271,20 @@ boolean P_CrossBSPNode (int bspnum)
     }
 		
     bsp = &nodes[bspnum];
+
+#if COMPACTLEVEL
+    // the partition is in map units
+    dl.x = bsp->x<<FRACBITS;
+    dl.y = bsp->y<<FRACBITS;
+    dl.dx = bsp->dx<<FRACBITS;
+    dl.dy = bsp->dy<<FRACBITS;
+    partition = &dl;
+#else
+    partition = (divline_t *)bsp;
+#endif
     
     // decide which side the start point is on
-    side = P_DivlineSide (strace.x, strace.y, (divline_t *)bsp);
+    side = P_DivlineSide (strace.x, strace.y, partition);
     if (side == 2)
 	side = 0;	// an "on" should cross both sides
 
@@ -278,7 +293,7 @@ boolean P_CrossBSPNode (int bspnum)
 	return false;
 	
     // the partition plane is crossed here
-    if (side == P_DivlineSide (t2x, t2y,(divline_t *)bsp))
+    if (side == P_DivlineSide (t2x, t2y, partition))
     {
 	// the line doesn't touch the other side
 	return true;
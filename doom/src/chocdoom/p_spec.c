@@ -32,6 +32,7 @@
 #include "m_argv.h"
 #include "m_misc.h"
 #include "m_random.h"
+#include "m_snapshot.h"
 #include "w_wad.h"
 
 #include "r_local.h"
@@ -143,7 +144,16 @@ extern  line_t*	linespeciallist[MAXLINEANIMS];
 void P_InitPicAnims (void)
 {
     int		i;
+    anim_t*	snap;
+    int		size;
 
+    snap = M_SnapshotGet (snap_picanims, &size);
+    if (snap && size <= sizeof(anims) && !(size % sizeof(anim_t)))
+    {
+	memcpy (anims, snap, size);
+	lastanim = anims + size / sizeof(anim_t);
+	return;
+    }
     
     //	Init animation
     lastanim = anims;
@@ -182,7 +192,9 @@ void P_InitPicAnims (void)
 	lastanim->speed = animdefs[i].speed;
 	lastanim++;
     }
-	
+
+    M_SnapshotAdd (snap_picanims, anims, (lastanim - anims) * sizeof(anim_t));
+    M_SnapshotEnd (snap_picanims);
 }
 
 
@@ -269,17 +281,12 @@ getNextSector
 fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		floor = sec->floorheight;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->neighbourcount ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbours[i];
 	
 	if (other->floorheight < floor)
 	    floor = other->floorheight;
@@ -296,17 +303,12 @@ fixed_t	P_FindLowestFloorSurrounding(sector_t* sec)
 fixed_t	P_FindHighestFloorSurrounding(sector_t *sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		floor = -500*FRACUNIT;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->neighbourcount ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-	
-	if (!other)
-	    continue;
+	other = sec->neighbours[i];
 	
 	if (other->floorheight > floor)
 	    floor = other->floorheight;
@@ -334,18 +336,13 @@ P_FindNextHighestFloor
     int         i;
     int         h;
     int         min;
-    line_t*     check;
     sector_t*   other;
     fixed_t     height = currentheight;
     fixed_t     heightlist[MAX_ADJOINING_SECTORS + 2];
 
-    for (i=0, h=0; i < sec->linecount; i++)
+    for (i=0, h=0; i < sec->neighbourcount; i++)
     {
-        check = sec->lines[i];
-        other = getNextSector(check,sec);
-
-        if (!other)
-            continue;
+        other = sec->neighbours[i];
         
         if (other->floorheight > height)
         {
@@ -392,17 +389,12 @@ fixed_t
 P_FindLowestCeilingSurrounding(sector_t* sec)
 {
     int			i;
-    line_t*		check;
     sector_t*		other;
     fixed_t		height = INT_MAX;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->neighbourcount ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbours[i];
 
 	if (other->ceilingheight < height)
 	    height = other->ceilingheight;
@@ -417,17 +409,12 @@ P_FindLowestCeilingSurrounding(sector_t* sec)
 fixed_t	P_FindHighestCeilingSurrounding(sector_t* sec)
 {
     int		i;
-    line_t*	check;
     sector_t*	other;
     fixed_t	height = 0;
 	
-    for (i=0 ;i < sec->linecount ; i++)
+    for (i=0 ;i < sec->neighbourcount ; i++)
     {
-	check = sec->lines[i];
-	other = getNextSector(check,sec);
-
-	if (!other)
-	    continue;
+	other = sec->neighbours[i];
 
 	if (other->ceilingheight > height)
 	    height = other->ceilingheight;
@@ -439,6 +426,11 @@ fixed_t	P_FindHighestCeilingSurrounding(sector_t* sec)
 
 //
 // RETURN NEXT SECTOR # THAT LINE TAG REFERS TO
+// Walks the tag chains from P_InitTagLists, which
+//  are in ascending order, so the result is the first
+//  tagged sector after start, as with a linear scan.
+// start need not be tagged: EV_BuildStairs passes
+//  back the last step it raised.
 //
 int
 P_FindSectorFromLineTag
@@ -446,12 +438,16 @@ P_FindSectorFromLineTag
   int		start )
 {
     int	i;
-	
-    for (i=start+1;i<numsectors;i++)
-	if (sectors[i].tag == line->tag)
-	    return i;
-    
-    return -1;
+
+    if (start >= 0 && sectors[start].tag == line->tag)
+	i = sectors[start].nexttag;
+    else
+	i = sectors[(unsigned) line->tag % (unsigned) numsectors].firsttag;
+
+    while (i >= 0 && (i <= start || sectors[i].tag != line->tag))
+	i = sectors[i].nexttag;
+
+    return i;
 }
 
 
@@ -467,17 +463,12 @@ P_FindMinSurroundingLight
 {
     int		i;
     int		min;
-    line_t*	line;
     sector_t*	check;
 	
     min = max;
-    for (i=0 ; i < sector->linecount ; i++)
+    for (i=0 ; i < sector->neighbourcount ; i++)
     {
-	line = sector->lines[i];
-	check = getNextSector(line,sector);
-
-	if (!check)
-	    continue;
+	check = sector->neighbours[i];
 
 	if (check->lightlevel < min)
 	    min = check->lightlevel;
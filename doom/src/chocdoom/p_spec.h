@@ -195,6 +195,7 @@ EV_LightTurnOn
   int		bright );
 
 void    T_Glow(glow_t* g);
+void    T_FireFlicker(fireflicker_t* flick);
 void    P_SpawnGlowingLight(sector_t* sector);
 
 
@@ -604,6 +605,9 @@ typedef enum
     
 } result_e;
 
+// bumped along with the heightcount of any sector
+extern int	planemovecount;
+
 result_e
 T_MovePlane
 ( sector_t*	sector,
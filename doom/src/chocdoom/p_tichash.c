@@ -0,0 +1,393 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Per tic hashes of the play simulation, to catch demo desyncs.
+//
+//	With -tichash, every tic run while a demo is recorded hashes
+//	the simulation state into a few words, one per group of fields,
+//	and writes them to a side file next to the demo (foo.lmp gets
+//	foo.hsh).  Playing the demo back with -tichash compares each
+//	tic against the file and stops at the first tic that differs,
+//	naming the group of fields that went out of step.
+//
+//	Layout:
+//	    header   "THSH", version, NUMTICHASHES
+//	    records  { demotic, hash[NUMTICHASHES] } for each tic run
+//
+//	Tics without a record (intermissions, pauses) are skipped, so
+//	a save state load during playback finds its place by demotic.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include <misc_utils.h>
+#include <dev_io.h>
+
+#include "doomstat.h"
+#include "i_swap.h"
+#include "i_system.h"
+#include "m_argv.h"
+#include "m_misc.h"
+#include "p_local.h"
+
+#include "p_tichash.h"
+
+#define TICHASH_ID		"THSH"
+#define TICHASH_VERSION		2
+
+// Records buffered between reads or writes of the side file
+#define TICHASH_BUFTICS		64
+
+typedef enum
+{
+    th_rng,
+    th_players,
+    th_mobjpos,
+    th_mobjmom,
+    th_mobjhealth,
+    th_mobjstate,
+    th_sectors,
+
+    NUMTICHASHES
+} tichashfield_t;
+
+static char *tichashnames[NUMTICHASHES] =
+{
+    "P_Random index",
+    "player state",
+    "mobj positions",
+    "mobj momenta",
+    "mobj health",
+    "mobj states",
+    "sector heights"
+};
+
+typedef struct
+{
+    char		id[4];
+    int			version;
+    int			numhashes;
+} tichashheader_t;
+
+typedef struct
+{
+    int			tic;		// demotic
+    unsigned int	hash[NUMTICHASHES];
+} tichashrec_t;
+
+extern int		prndindex;
+
+boolean			tichashing;
+
+static int		tichashfile = -1;
+static boolean		tichashwrite;
+static char		tichashpath[D_MAX_PATH];
+
+static tichashrec_t	tichashbuf[TICHASH_BUFTICS];
+static int		tichashpos;		// next record in the buffer
+static int		tichashlen;		// records in the buffer
+static int		tichashtics;		// tics checked or written
+
+
+// FNV-1a over whole words: a multiply and an xor each
+#define HASHWORD(h, v)	((h) = ((h) ^ (unsigned int)(v)) * 16777619u)
+#define HASHSEED	2166136261u
+
+
+static boolean P_TicHashOpen (char *demoname, char *mode)
+{
+    char*	ext;
+
+    //!
+    // @category demo
+    //
+    // Record per tic hashes of the game state next to a demo being
+    // recorded (demo.hsh), or check a demo being played back against
+    // them and stop at the first tic that differs.
+    //
+
+    tichashing = M_CheckParm ("-tichash") > 0;
+
+    if (!tichashing)
+	return false;
+
+    M_StringCopy (tichashpath, demoname, sizeof(tichashpath) - 4);
+    ext = strrchr (tichashpath, '.');
+    if (ext && !strchr (ext, '/'))
+	*ext = 0;
+    M_StringConcat (tichashpath, ".hsh", sizeof(tichashpath));
+
+    d_open (tichashpath, &tichashfile, mode);
+    if (tichashfile < 0)
+    {
+	printf ("P_TicHash: can't open %s\n", tichashpath);
+	tichashing = false;
+	return false;
+    }
+
+    tichashpos = tichashlen = tichashtics = 0;
+    return true;
+}
+
+
+void P_TicHashRecord (char *demoname)
+{
+    tichashheader_t	header;
+
+    P_TicHashEnd ();
+
+    if (!P_TicHashOpen (demoname, "+w"))
+	return;
+
+    memcpy (header.id, TICHASH_ID, 4);
+    header.version = LONG(TICHASH_VERSION);
+    header.numhashes = LONG(NUMTICHASHES);
+    d_write (tichashfile, &header, sizeof(header));
+
+    tichashwrite = true;
+}
+
+
+void P_TicHashVerify (char *demoname)
+{
+    tichashheader_t	header;
+
+    P_TicHashEnd ();
+
+    if (!P_TicHashOpen (demoname, "r"))
+	return;
+
+    if (d_read (tichashfile, &header, sizeof(header)) != sizeof(header)
+     || memcmp (header.id, TICHASH_ID, 4)
+     || LONG(header.version) != TICHASH_VERSION
+     || LONG(header.numhashes) != NUMTICHASHES)
+    {
+	printf ("P_TicHash: %s is not a hash file for this version\n",
+		tichashpath);
+	d_close (tichashfile);
+	tichashfile = -1;
+	tichashing = false;
+	return;
+    }
+
+    tichashwrite = false;
+}
+
+
+//
+// P_TicHashState
+// Hashes the state after the tic just run.
+//
+static void P_TicHashState (tichashrec_t *rec)
+{
+    unsigned int	h[NUMTICHASHES];
+    thinker_t*		th;
+    mobj_t*		mo;
+    player_t*		p;
+    sector_t*		sec;
+    int			i, j;
+
+    for (i = 0; i < NUMTICHASHES; i++)
+	h[i] = HASHSEED;
+
+    HASHWORD (h[th_rng], prndindex);
+
+    for (i = 0; i < MAXPLAYERS; i++)
+    {
+	if (!playeringame[i])
+	    continue;
+
+	p = &players[i];
+	HASHWORD (h[th_players], i);
+	HASHWORD (h[th_players], p->playerstate);
+	HASHWORD (h[th_players], p->health);
+	HASHWORD (h[th_players], p->armorpoints);
+	HASHWORD (h[th_players], p->armortype);
+	HASHWORD (h[th_players], p->readyweapon);
+	HASHWORD (h[th_players], p->pendingweapon);
+	HASHWORD (h[th_players], p->viewz);
+	for (j = 0; j < NUMAMMO; j++)
+	    HASHWORD (h[th_players], p->ammo[j]);
+	for (j = 0; j < NUMPOWERS; j++)
+	    HASHWORD (h[th_players], p->powers[j]);
+	HASHWORD (h[th_players], p->killcount);
+	HASHWORD (h[th_players], p->itemcount);
+	HASHWORD (h[th_players], p->secretcount);
+    }
+
+    for (th = thinkercap.next ; th != &thinkercap ; th = th->next)
+    {
+	if (th->function.acp1 != (actionf_p1)P_MobjThinker)
+	    continue;
+
+	mo = (mobj_t *)th;
+
+	HASHWORD (h[th_mobjpos], mo->type);
+	HASHWORD (h[th_mobjpos], mo->x);
+	HASHWORD (h[th_mobjpos], mo->y);
+	HASHWORD (h[th_mobjpos], mo->z);
+	HASHWORD (h[th_mobjpos], mo->angle);
+
+	HASHWORD (h[th_mobjmom], mo->momx);
+	HASHWORD (h[th_mobjmom], mo->momy);
+	HASHWORD (h[th_mobjmom], mo->momz);
+
+	HASHWORD (h[th_mobjhealth], mo->health);
+
+	HASHWORD (h[th_mobjstate], mo->state ? mo->state - states : -1);
+	HASHWORD (h[th_mobjstate], mo->tics);
+	HASHWORD (h[th_mobjstate], mo->flags);
+	HASHWORD (h[th_mobjstate], mo->movedir);
+	HASHWORD (h[th_mobjstate], mo->reactiontime);
+    }
+
+    for (i = 0, sec = sectors ; i < numsectors ; i++, sec++)
+    {
+	HASHWORD (h[th_sectors], sec->floorheight);
+	HASHWORD (h[th_sectors], sec->ceilingheight);
+	HASHWORD (h[th_sectors], sec->lightlevel);
+    }
+
+    rec->tic = LONG(demotic);
+    for (i = 0; i < NUMTICHASHES; i++)
+	rec->hash[i] = LONG(h[i]);
+}
+
+
+static void P_TicHashFlush (void)
+{
+    int		len;
+
+    len = tichashpos * sizeof(tichashrec_t);
+
+    if (len && d_write (tichashfile, tichashbuf, len) < 0)
+	I_Error ("P_TicHash: write error on %s", tichashpath);
+
+    tichashpos = 0;
+}
+
+
+//
+// P_TicHashRead
+// Refills the buffer once it is used up.  False at the end of the file.
+//
+static boolean P_TicHashRead (void)
+{
+    int		len;
+
+    if (tichashpos < tichashlen)
+	return true;
+
+    len = d_read (tichashfile, tichashbuf, sizeof(tichashbuf));
+    tichashpos = 0;
+    tichashlen = len > 0 ? len / sizeof(tichashrec_t) : 0;
+
+    return tichashlen > 0;
+}
+
+
+static void P_TicHashCheck (tichashrec_t *rec)
+{
+    tichashrec_t*	want;
+    int			i;
+
+    if (!P_TicHashRead ())
+    {
+	printf ("P_TicHash: %s ends after %i tics\n",
+		tichashpath, tichashtics);
+	P_TicHashEnd ();
+	return;
+    }
+
+    want = &tichashbuf[tichashpos++];
+
+    if (want->tic != rec->tic)
+	I_Error ("P_TicHash: %s is out of order at tic %i",
+		 tichashpath, LONG(rec->tic));
+
+    for (i = 0; i < NUMTICHASHES; i++)
+    {
+	if (want->hash[i] != rec->hash[i])
+	{
+	    I_Error ("P_TicHash: desync at tic %i (E%iM%i, leveltime %i): "
+		     "%s differ",
+		     LONG(rec->tic), gameepisode, gamemap, leveltime,
+		     tichashnames[i]);
+	}
+    }
+}
+
+
+void P_TicHash (void)
+{
+    tichashrec_t	rec;
+
+    if (tichashfile < 0)
+	return;
+
+    P_TicHashState (&rec);
+
+    if (tichashwrite)
+    {
+	tichashbuf[tichashpos++] = rec;
+	if (tichashpos == TICHASH_BUFTICS)
+	    P_TicHashFlush ();
+    }
+    else
+    {
+	P_TicHashCheck (&rec);
+    }
+
+    tichashtics++;
+}
+
+
+//
+// P_TicHashSeek
+// Playback went to tic, from a save state or a seek: the next record
+// to check is the first one after it.
+//
+void P_TicHashSeek (int tic)
+{
+    if (tichashfile < 0 || tichashwrite)
+	return;
+
+    d_seek (tichashfile, sizeof(tichashheader_t), DSEEK_SET);
+    tichashpos = tichashlen = 0;
+
+    while (P_TicHashRead () && LONG(tichashbuf[tichashpos].tic) <= tic)
+	tichashpos++;
+}
+
+
+void P_TicHashEnd (void)
+{
+    if (tichashfile < 0)
+	return;
+
+    if (tichashwrite)
+    {
+	P_TicHashFlush ();
+	printf ("P_TicHash: wrote %i tics to %s\n", tichashtics, tichashpath);
+    }
+    else
+    {
+	printf ("P_TicHash: %i tics match %s\n", tichashtics, tichashpath);
+    }
+
+    d_close (tichashfile);
+    tichashfile = -1;
+}
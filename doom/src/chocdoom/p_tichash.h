@@ -0,0 +1,43 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//      Per tic hashes of the play simulation, to catch demo desyncs.
+//
+
+
+#ifndef __P_TICHASH__
+#define __P_TICHASH__
+
+#include "doomtype.h"
+
+// Set by -tichash.
+extern boolean	tichashing;
+
+// Start writing the hashes of a demo being recorded.
+void P_TicHashRecord (char *demoname);
+
+// Start checking a demo played back against its hashes.
+void P_TicHashVerify (char *demoname);
+
+// Called by P_Ticker after each tic.
+void P_TicHash (void);
+
+// Demo playback jumped to tic.
+void P_TicHashSeek (int tic);
+
+// Flush and close the hash file at the end of the demo.
+void P_TicHashEnd (void);
+
+#endif
@@ -22,6 +22,7 @@
 #include "p_local.h"
 
 #include "doomstat.h"
+#include "p_tichash.h"
 
 
 int	leveltime;
@@ -148,4 +149,7 @@ void P_Ticker (void)
 
     // for par times
     leveltime++;	
+
+    if (tichashing)
+	P_TicHash ();
 }
@@ -34,6 +34,7 @@
 #include "r_state.h"
 
 #include "st_stuff.h"
+#include "m_profile.h"
 #include <bsp_sys.h>
 
 //#include "r_local.h"
@@ -247,8 +248,17 @@ static void R_AddLine (seg_t *line)
   curline = line;
   render_on_distance = detailshift ? false : true;
 
+#if COMPACTLEVEL
+  {
+    segvertex_t *sv = &segverts[line - segs];
+
+    angle1 = R_PointToAngle (sv->x1<<FRACBITS, sv->y1<<FRACBITS);
+    angle2 = R_PointToAngle (sv->x2<<FRACBITS, sv->y2<<FRACBITS);
+  }
+#else
   angle1 = R_PointToAngle (line->v1->x, line->v1->y);
   angle2 = R_PointToAngle (line->v2->x, line->v2->y);
+#endif
 
   // Clip to view edges.
   span = angle1 - angle2;
@@ -359,7 +369,14 @@ static const int checkcoord[12][4] = // killough -- static const
   {2,1,3,0}
 };
 
+#if COMPACTLEVEL
+// Node boxes are kept in map units
+#define BSPCOORD(i)	(bspcoord[i]<<FRACBITS)
+static boolean R_CheckBBox(short *bspcoord)
+#else
+#define BSPCOORD(i)	bspcoord[i]
 static boolean R_CheckBBox(fixed_t *bspcoord) // killough 1/28/98: static
+#endif
 {
   int     boxpos, boxx, boxy;
   fixed_t x1, x2, y1, y2;
@@ -369,17 +386,17 @@ static boolean R_CheckBBox(fixed_t *bspcoord) // killough 1/28/98: static
 
   // Find the corners of the box
   // that define the edges from current viewpoint.
-  boxx = viewx <= bspcoord[BOXLEFT] ? 0 : viewx < bspcoord[BOXRIGHT ] ? 1 : 2;
-  boxy = viewy >= bspcoord[BOXTOP ] ? 0 : viewy > bspcoord[BOXBOTTOM] ? 1 : 2;
+  boxx = viewx <= BSPCOORD(BOXLEFT) ? 0 : viewx < BSPCOORD(BOXRIGHT ) ? 1 : 2;
+  boxy = viewy >= BSPCOORD(BOXTOP ) ? 0 : viewy > BSPCOORD(BOXBOTTOM) ? 1 : 2;
 
   boxpos = (boxy<<2)+boxx;
   if (boxpos == 5)
     return true;
 
-  x1 = bspcoord[checkcoord[boxpos][0]];
-  y1 = bspcoord[checkcoord[boxpos][1]];
-  x2 = bspcoord[checkcoord[boxpos][2]];
-  y2 = bspcoord[checkcoord[boxpos][3]];
+  x1 = BSPCOORD(checkcoord[boxpos][0]);
+  y1 = BSPCOORD(checkcoord[boxpos][1]);
+  x2 = BSPCOORD(checkcoord[boxpos][2]);
+  y2 = BSPCOORD(checkcoord[boxpos][3]);
 
     // check clip list for an open space
   angle1 = R_PointToAngle (x1, y1) - viewangle;
@@ -507,7 +524,6 @@ void R_Subsector (int num)
 
 void R_RenderBSPNode(int bspnum)
 {
-  profiler_enter();
   while (!(bspnum & NF_SUBSECTOR))  // Found a subsector?
     {
       node_t *bsp = &nodes[bspnum];
@@ -520,14 +536,16 @@ void R_RenderBSPNode(int bspnum)
 
       // Possibly divide back space.
 
+#if COMPACTLEVEL
+      if (!R_CheckBBox(nodebboxes[bspnum][side^1])) {
+#else
       if (!R_CheckBBox(bsp->bbox[side^1])) {
-        profiler_exit();
+#endif
         return;
       }
 
       bspnum = bsp->children[side^1];
     }
   R_Subsector(bspnum == -1 ? 0 : bspnum & ~NF_SUBSECTOR);
-  profiler_exit();
 }
 
@@ -18,10 +18,16 @@
 //
 
 #include <stdio.h>
+#include <limits.h>
+
+#include <misc_utils.h>
+#include <debug.h>
+#include <bsp_cmd.h>
 
 #include "deh_main.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "z_zone.h"
 
 
@@ -33,6 +39,8 @@
 #include "p_local.h"
 
 #include "doomstat.h"
+#include "m_argv.h"
+#include "m_snapshot.h"
 #include "r_sky.h"
 
 
@@ -124,6 +132,10 @@ struct texture_s
     texpatch_t	patches[1];		
 };
 
+// Size of a texture_t with the given number of patches.
+#define TEXTURESIZE(count) \
+    (sizeof(texture_t) + sizeof(texpatch_t)*((count)-1))
+
 
 
 int		firstflat;
@@ -441,6 +453,112 @@ static void GenerateTextureHashTable(void)
 }
 
 
+//
+// R_TexturesFromSnapshot
+// Points the texture tables into the boot snapshot.
+// Returns false if there is none or it does not add up.
+//
+static boolean R_TexturesFromSnapshot (void)
+{
+    texture_t*		texture;
+    byte*		data;
+    byte*		end;
+    byte*		columns;
+    int*		sizes;
+    int			size;
+    int			totalwidth;
+    int			i;
+
+    sizes = M_SnapshotGet (snap_texturesizes, &size);
+    if (!sizes || !size || size % (3*sizeof(int)))
+	return false;
+
+    numtextures = size / (3*sizeof(int));
+    textures = Z_Malloc (numtextures * sizeof(*textures), PU_STATIC, 0);
+
+    data = M_SnapshotGet (snap_textures, &size);
+    end = data + size;
+    totalwidth = 0;
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texture = (texture_t *) data;
+
+	if (end - data < (int)sizeof(texture_t)
+	 || end - data < (int)TEXTURESIZE(texture->patchcount))
+	    break;
+
+	textures[i] = texture;
+	data += TEXTURESIZE(texture->patchcount);
+	totalwidth += texture->width;
+    }
+
+    columns = M_SnapshotGet (snap_texturecolumns, &size);
+
+    if (i < numtextures || data != end
+     || size != totalwidth * (sizeof(short) + sizeof(unsigned short)))
+    {
+	Z_Free (textures);
+	return false;
+    }
+
+    texturecolumnlump = Z_Malloc (numtextures * sizeof(*texturecolumnlump), PU_STATIC, 0);
+    texturecolumnofs = Z_Malloc (numtextures * sizeof(*texturecolumnofs), PU_STATIC, 0);
+    texturecomposite = Z_Malloc (numtextures * sizeof(*texturecomposite), PU_STATIC, 0);
+
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texturecolumnlump[i] = (short *) columns;
+	columns += textures[i]->width * sizeof(short);
+    }
+    for (i=0 ; i<numtextures ; i++)
+    {
+	texturecolumnofs[i] = (unsigned short *) columns;
+	columns += textures[i]->width * sizeof(unsigned short);
+    }
+
+    // Composited textures not created yet.
+    memset (texturecomposite, 0, numtextures * sizeof(*texturecomposite));
+
+    texturecompositesize = sizes;
+    texturewidthmask = sizes + numtextures;
+    textureheight = sizes + 2*numtextures;
+
+    return true;
+}
+
+
+//
+// R_SnapshotTextures
+// Hands the tables built by R_InitTextures to the boot snapshot.
+//
+static void R_SnapshotTextures (void)
+{
+    int		i;
+
+    for (i=0 ; i<numtextures ; i++)
+	M_SnapshotAdd (snap_textures, textures[i],
+		       TEXTURESIZE(textures[i]->patchcount));
+    M_SnapshotEnd (snap_textures);
+
+    for (i=0 ; i<numtextures ; i++)
+	M_SnapshotAdd (snap_texturecolumns, texturecolumnlump[i],
+		       textures[i]->width * sizeof(**texturecolumnlump));
+    for (i=0 ; i<numtextures ; i++)
+	M_SnapshotAdd (snap_texturecolumns, texturecolumnofs[i],
+		       textures[i]->width * sizeof(**texturecolumnofs));
+    M_SnapshotEnd (snap_texturecolumns);
+
+    M_SnapshotAdd (snap_texturesizes, texturecompositesize,
+		   numtextures * sizeof(*texturecompositesize));
+    M_SnapshotAdd (snap_texturesizes, texturewidthmask,
+		   numtextures * sizeof(*texturewidthmask));
+    M_SnapshotAdd (snap_texturesizes, textureheight,
+		   numtextures * sizeof(*textureheight));
+    M_SnapshotEnd (snap_texturesizes);
+}
+
+
 //
 // R_InitTextures
 // Initializes the texture list
@@ -475,6 +593,8 @@ void R_InitTextures (void)
 
     int*		directory = 0;
 
+    if (R_TexturesFromSnapshot ())
+	goto done;
     
     // Load the patch names from pnames.lmp.
     name[8] = 0;
@@ -550,8 +670,7 @@ void R_InitTextures (void)
 	mtexture = (maptexture_t *) ( (byte *)maptex + offset);
 
 	texture = textures[i] =
-	    Z_Malloc (sizeof(texture_t)
-		      + sizeof(texpatch_t)*(READ_LE_I16(mtexture->patchcount)-1),
+	    Z_Malloc (TEXTURESIZE(READ_LE_I16(mtexture->patchcount)),
 		      PU_STATIC, 0);
 	
 	texture->width = READ_LE_I16(mtexture->width);
@@ -596,7 +715,10 @@ void R_InitTextures (void)
 
     for (i=0 ; i<numtextures ; i++)
 	R_GenerateLookup (i);
-    
+
+    R_SnapshotTextures ();
+
+  done:
     // Create translation table for global animation.
     texturetranslation = Z_Malloc ((numtextures+1)*sizeof(*texturetranslation), PU_STATIC, 0);
     
@@ -624,6 +746,178 @@ void R_InitFlats (void)
     
     for (i=0 ; i<numflats ; i++)
 	flattranslation[i] = i;
+
+    flatmips = Z_Malloc (numflats*sizeof(*flatmips), PU_STATIC, 0);
+    memset (flatmips, 0, numflats*sizeof(*flatmips));
+}
+
+
+//
+// FLAT MIPMAPS
+// The 32*32, 16*16 and 8*8 levels of a flat, one after another,
+// for the distant rows of a floor or ceiling. They are made where the
+// flat lump is cached ahead of drawing, by R_PrecacheLevel and
+// R_Prefetch, and kept PU_CACHE alongside it. Each texel is a search
+// of the palette, far too slow to do in the middle of a frame, so a
+// plane whose mips are not there is drawn without them. R_Prefetch
+// makes them a few rows at a time, within its time per frame.
+//
+byte**		flatmips;
+static byte*	flatpalette;
+
+// The flat R_PrefetchFlatMips is part way through.
+static int	mipflat = -1;
+static int	mipdone;		// texels of it made so far
+static byte	mipbuild[FLATMIPSIZE];
+
+static byte R_FlatMipColor (byte *src, int size)
+{
+    byte*	rgb;
+    int		r, g, b;
+    int		diff, bestdiff;
+    int		best;
+    int		i;
+
+    r = g = b = 0;
+    for (i=0 ; i<4 ; i++)
+    {
+	rgb = flatpalette + 3*src[(i>>1)*size + (i&1)];
+	r += rgb[0];
+	g += rgb[1];
+	b += rgb[2];
+    }
+    r >>= 2;
+    g >>= 2;
+    b >>= 2;
+
+    best = 0;
+    bestdiff = INT_MAX;
+    for (i=0, rgb=flatpalette ; i<256 ; i++, rgb+=3)
+    {
+	diff = (r-rgb[0])*(r-rgb[0])
+	     + (g-rgb[1])*(g-rgb[1])
+	     + (b-rgb[2])*(b-rgb[2]);
+	if (diff < bestdiff)
+	{
+	    best = i;
+	    bestdiff = diff;
+	    if (!diff)
+		break;
+	}
+    }
+    return best;
+}
+
+//
+// R_MakeFlatMips
+// Makes the mip texels of flat lump src into dest a row at a time,
+// from texel done on, until all are made or msec (0 for no limit) has
+// passed since start.  Returns the texels made so far.
+//
+static int R_MakeFlatMips (byte *src, byte *dest, int done,
+			   int start, int msec)
+{
+    byte*	from;
+    int		level;
+    int		size;
+    int		x, y;
+
+    if (!flatpalette)
+	flatpalette = W_CacheLumpName (DEH_String("PLAYPAL"), PU_STATIC);
+
+    from = src;
+    level = 0;
+    for (size = 64 ; size > 8 ; size >>= 1)
+    {
+	while (done < level + (size>>1)*(size>>1))
+	{
+	    if (msec && I_GetTimeMS () - start >= msec)
+		return done;
+
+	    y = 2*((done - level) / (size>>1));
+	    for (x=0 ; x<size ; x+=2)
+		dest[done++] = R_FlatMipColor (from + y*size + x, size);
+	}
+	from = dest + level;
+	level += (size>>1)*(size>>1);
+    }
+
+    return done;
+}
+
+//
+// R_CacheFlatMips
+// Makes the mip levels of a flat unless they are still cached.
+//
+void R_CacheFlatMips (int flat)
+{
+    byte*	src;
+    int		lump;
+
+    if (!spanlod || flatmips[flat])
+	return;
+
+    lump = firstflat + flat;
+    src = W_CacheLumpNum (lump, PU_STATIC);
+
+    Z_Malloc (FLATMIPSIZE, PU_STATIC, &flatmips[flat]);
+    R_MakeFlatMips (src, flatmips[flat], 0, 0, 0);
+    Z_ChangeTag (flatmips[flat], PU_CACHE);
+
+    W_ReleaseLumpNum (lump);
+}
+
+//
+// R_PrefetchFlatMips
+// R_CacheFlatMips for R_Prefetch, within msec of start.  Returns
+// false if the time ran out first: call it again for the same flat
+// to go on where it stopped.
+//
+static boolean R_PrefetchFlatMips (int flat, int start, int msec)
+{
+    byte*	src;
+    int		lump;
+
+    if (!spanlod || flatmips[flat])
+	return true;
+
+    if (flat != mipflat)
+    {
+	mipflat = flat;
+	mipdone = 0;
+    }
+
+    lump = firstflat + flat;
+    src = W_CacheLumpNum (lump, PU_STATIC);
+    mipdone = R_MakeFlatMips (src, mipbuild, mipdone, start, msec);
+    W_ReleaseLumpNum (lump);
+
+    if (mipdone < FLATMIPSIZE)
+	return false;
+
+    Z_Malloc (FLATMIPSIZE, PU_STATIC, &flatmips[flat]);
+    memcpy (flatmips[flat], mipbuild, FLATMIPSIZE);
+    Z_ChangeTag (flatmips[flat], PU_CACHE);
+    mipflat = -1;
+    return true;
+}
+
+//
+// R_GetFlatMips
+// Returns the mip levels of the flat, or NULL if they are not cached.
+// Release them with R_ReleaseFlatMips.
+//
+byte *R_GetFlatMips (int flat)
+{
+    if (flatmips[flat])
+	Z_ChangeTag (flatmips[flat], PU_STATIC);
+
+    return flatmips[flat];
+}
+
+void R_ReleaseFlatMips (int flat)
+{
+    Z_ChangeTag (flatmips[flat], PU_CACHE);
 }
 
 
@@ -636,12 +930,22 @@ void R_InitFlats (void)
 void R_InitSpriteLumps (void)
 {
     int		i;
+    int		size;
     patch_t	*patch;
 	
     firstspritelump = W_GetNumForName (DEH_String("S_START")) + 1;
     lastspritelump = W_GetNumForName (DEH_String("S_END")) - 1;
     
     numspritelumps = lastspritelump - firstspritelump + 1;
+
+    spritewidth = M_SnapshotGet (snap_spritelumps, &size);
+    if (spritewidth && size == 3*numspritelumps*sizeof(*spritewidth))
+    {
+	spriteoffset = spritewidth + numspritelumps;
+	spritetopoffset = spritewidth + 2*numspritelumps;
+	return;
+    }
+
     spritewidth = Z_Malloc (numspritelumps*sizeof(*spritewidth), PU_STATIC, 0);
     spriteoffset = Z_Malloc (numspritelumps*sizeof(*spriteoffset), PU_STATIC, 0);
     spritetopoffset = Z_Malloc (numspritelumps*sizeof(*spritetopoffset), PU_STATIC, 0);
@@ -654,6 +958,12 @@ void R_InitSpriteLumps (void)
 	spriteoffset[i] = READ_LE_I16(patch->leftoffset)<<FRACBITS;
 	spritetopoffset[i] = READ_LE_I16(patch->topoffset)<<FRACBITS;
     }
+
+    size = numspritelumps*sizeof(*spritewidth);
+    M_SnapshotAdd (snap_spritelumps, spritewidth, size);
+    M_SnapshotAdd (snap_spritelumps, spriteoffset, size);
+    M_SnapshotAdd (snap_spritelumps, spritetopoffset, size);
+    M_SnapshotEnd (snap_spritelumps);
 }
 
 
@@ -667,8 +977,10 @@ void R_InitColormaps (void)
 
     // Load in the light tables, 
     //  256 byte align tables.
+    // Every pixel drawn goes through them: fast RAM first.
     lump = W_GetNumForName(DEH_String("COLORMAP"));
-    colormaps = W_CacheLumpNum(lump, PU_STATIC);
+    colormaps = Z_MallocTier(W_LumpLength(lump), PU_STATIC, 0, Z_TIER_FAST);
+    W_ReadLump(lump, colormaps);
 }
 
 
@@ -685,6 +997,20 @@ void R_InitData (void)
     R_InitFlats ();
     R_InitSpriteLumps ();
     R_InitColormaps ();
+
+    //!
+    // @category obscure
+    //
+    // Don't load the graphics around the player between frames.
+    //
+
+    if (M_CheckParm ("-noprefetch"))
+	prefetch = 0;
+
+    cmd_register_i32 (&prefetch, "prefetch");
+    cmd_register_i32 (&prefetchstalls, "prefetchstalls");
+    cmd_register_i32 (&prefetchstalltotal, "prefetchstalltotal");
+    cmd_register_i32 (&prefetchloads, "prefetchloads");
 }
 
 
@@ -807,6 +1133,7 @@ void R_PrecacheLevel (void)
 	    lump = firstflat + i;
 	    flatmemory += lumpinfo[lump].size;
 	    W_CacheLumpNum(lump, PU_CACHE);
+	    R_CacheFlatMips (i);
 	}
     }
 
@@ -883,3 +1210,248 @@ void R_PrecacheLevel (void)
 
 
 
+
+
+
+//
+// R_Prefetch
+// Loads the graphics around the player a few lumps at a time
+// between frames, so that PU_CACHE lumps purged since they were
+// last seen are not read from the card in the middle of a frame.
+// The sectors within PREFETCHHOPS neighbour hops of the player are
+// queued nearest first whenever the player enters a new sector.
+//
+#define PREFETCHHOPS		3
+#define PREFETCHQUEUE		512
+#define PREFETCHMSEC		2	// load time allowed per frame
+
+int32_t		prefetch = 1;		// 0 disables prefetching
+int32_t		prefetchstalls;		// lumps read mid frame, last frame
+int32_t		prefetchstalltotal;	// lumps read mid frame, this level
+int32_t		prefetchloads;		// lumps loaded ahead, this level
+int32_t		prefetchframes;		// frames rendered, this level
+
+// Queued lumps, or -1-texnum for a texture composite.
+static int		prefetchqueue[PREFETCHQUEUE];
+static int		prefetchhead;
+static int		prefetchtail;
+
+static sector_t*	prefetchsector;
+static sector_t**	prefetchsectors;
+static unsigned short*	prefetchlumpmark;
+static unsigned short*	prefetchtexmark;
+static unsigned short*	prefetchsecmark;
+static unsigned short	prefetchmark;
+
+
+static void R_PrefetchItem (int item)
+{
+    if (prefetchtail - prefetchhead < PREFETCHQUEUE)
+	prefetchqueue[prefetchtail++ % PREFETCHQUEUE] = item;
+}
+
+static void R_PrefetchLump (int lump)
+{
+    if (prefetchlumpmark[lump] == prefetchmark)
+	return;
+    prefetchlumpmark[lump] = prefetchmark;
+    R_PrefetchItem (lump);
+}
+
+static void R_PrefetchTexture (int texnum)
+{
+    texture_t*	texture;
+    int		i;
+
+    if (!texnum || prefetchtexmark[texnum] == prefetchmark)
+	return;
+    prefetchtexmark[texnum] = prefetchmark;
+
+    texture = textures[texnum];
+
+    for (i=0 ; i<texture->patchcount ; i++)
+	R_PrefetchLump (texture->patches[i].patch);
+
+    if (texturecompositesize[texnum])
+	R_PrefetchItem (-1-texnum);
+}
+
+static void R_PrefetchSector (sector_t* sec)
+{
+    line_t*		line;
+    side_t*		side;
+    mobj_t*		mo;
+    spriteframe_t*	sf;
+    int			i;
+    int			j;
+
+    if (sec->floorpic != skyflatnum)
+	R_PrefetchLump (firstflat + flattranslation[sec->floorpic]);
+    if (sec->ceilingpic != skyflatnum)
+	R_PrefetchLump (firstflat + flattranslation[sec->ceilingpic]);
+    else
+	R_PrefetchTexture (texturetranslation[skytexture]);
+
+    for (i=0 ; i<sec->linecount ; i++)
+    {
+	line = sec->lines[i];
+
+	for (j=0 ; j<2 ; j++)
+	{
+	    if (line->sidenum[j] == -1)
+		continue;
+	    side = &sides[line->sidenum[j]];
+	    R_PrefetchTexture (texturetranslation[side->toptexture]);
+	    R_PrefetchTexture (texturetranslation[side->midtexture]);
+	    R_PrefetchTexture (texturetranslation[side->bottomtexture]);
+	}
+    }
+
+    for (mo = sec->thinglist ; mo ; mo = mo->snext)
+    {
+	if ((unsigned)mo->sprite >= numsprites
+	    || (mo->frame & FF_FRAMEMASK) >= sprites[mo->sprite].numframes)
+	    continue;
+
+	sf = &sprites[mo->sprite].spriteframes[mo->frame & FF_FRAMEMASK];
+
+	for (i=0 ; i<8 ; i++)
+	    R_PrefetchLump (firstspritelump + sf->lump[i]);
+    }
+}
+
+//
+// R_PrefetchQueue
+// Queue the graphics of the sectors around sec, nearest first.
+//
+static void R_PrefetchQueue (sector_t* sec)
+{
+    sector_t*	other;
+    int		head;
+    int		tail;
+    int		end;
+    int		hop;
+    int		i;
+
+    prefetchhead = prefetchtail = 0;
+
+    if (++prefetchmark == 0)
+    {
+	memset (prefetchlumpmark, 0, numlumps*sizeof(*prefetchlumpmark));
+	memset (prefetchtexmark, 0, numtextures*sizeof(*prefetchtexmark));
+	memset (prefetchsecmark, 0, numsectors*sizeof(*prefetchsecmark));
+	prefetchmark = 1;
+    }
+
+    head = 0;
+    tail = 0;
+    prefetchsectors[tail++] = sec;
+    prefetchsecmark[sec - sectors] = prefetchmark;
+
+    for (hop=0 ; hop<=PREFETCHHOPS && head<tail ; hop++)
+    {
+	for (end = tail ; head<end ; head++)
+	{
+	    sec = prefetchsectors[head];
+	    R_PrefetchSector (sec);
+
+	    if (hop == PREFETCHHOPS)
+		continue;
+
+	    for (i=0 ; i<sec->neighbourcount ; i++)
+	    {
+		other = sec->neighbours[i];
+		if (prefetchsecmark[other - sectors] == prefetchmark)
+		    continue;
+		prefetchsecmark[other - sectors] = prefetchmark;
+		prefetchsectors[tail++] = other;
+	    }
+	}
+    }
+}
+
+//
+// R_PrefetchLevel
+// Called by P_SetupLevel.
+//
+void R_PrefetchLevel (void)
+{
+    if (prefetchframes)
+	dprintf ("R_Prefetch: %i stalls in %i frames, %i lumps loaded ahead\n",
+		 prefetchstalltotal, prefetchframes, prefetchloads);
+
+    prefetchsector = NULL;
+    prefetchhead = prefetchtail = 0;
+    prefetchmark = 0;
+    prefetchstalls = 0;
+    prefetchstalltotal = 0;
+    prefetchloads = 0;
+    prefetchframes = 0;
+
+    prefetchsectors = Z_Malloc (numsectors*sizeof(*prefetchsectors),
+				PU_LEVEL, NULL);
+    prefetchlumpmark = Z_Malloc (numlumps*sizeof(*prefetchlumpmark),
+				 PU_LEVEL, NULL);
+    prefetchtexmark = Z_Malloc (numtextures*sizeof(*prefetchtexmark),
+				PU_LEVEL, NULL);
+    prefetchsecmark = Z_Malloc (numsectors*sizeof(*prefetchsecmark),
+				PU_LEVEL, NULL);
+    memset (prefetchlumpmark, 0, numlumps*sizeof(*prefetchlumpmark));
+    memset (prefetchtexmark, 0, numtextures*sizeof(*prefetchtexmark));
+    memset (prefetchsecmark, 0, numsectors*sizeof(*prefetchsecmark));
+}
+
+//
+// R_Prefetch
+// Called once per frame from the main loop, after the frame is shown.
+//
+void R_Prefetch (player_t* player)
+{
+    sector_t*	sec;
+    lumpinfo_t*	lump;
+    int		item;
+    int		start;
+
+    if (!prefetch || gamestate != GS_LEVEL || !player->mo
+	|| !prefetchsectors)
+	return;
+
+    sec = player->mo->subsector->sector;
+
+    if (sec != prefetchsector)
+    {
+	prefetchsector = sec;
+	R_PrefetchQueue (sec);
+    }
+
+    start = I_GetTimeMS ();
+
+    while (prefetchhead < prefetchtail
+	   && I_GetTimeMS () - start < PREFETCHMSEC)
+    {
+	item = prefetchqueue[prefetchhead++ % PREFETCHQUEUE];
+
+	if (item < 0)
+	{
+	    if (!texturecomposite[-1-item])
+		R_GenerateComposite (-1-item);
+	    continue;
+	}
+
+	lump = &lumpinfo[item];
+
+	if (!lump->cache && !lump->wad_file->mapped)
+	{
+	    W_CacheLumpNum (item, PU_CACHE);
+	    prefetchloads++;
+	}
+
+	// out of time part way through: the same flat goes on next frame
+	if (item >= firstflat && item <= lastflat
+	    && !R_PrefetchFlatMips (item - firstflat, start, PREFETCHMSEC))
+	{
+	    prefetchhead--;
+	    break;
+	}
+    }
+}
@@ -36,6 +36,26 @@ R_GetColumn
 void R_InitData (void);
 void R_PrecacheLevel (void);
 
+// Background loading of the graphics around the player.
+void R_PrefetchLevel (void);
+void R_Prefetch (player_t* player);
+
+extern int32_t	prefetch;
+extern int32_t	prefetchstalls;
+extern int32_t	prefetchstalltotal;
+extern int32_t	prefetchloads;
+extern int32_t	prefetchframes;
+
+
+// Mip levels of a flat, 32*32, 16*16 and 8*8 one after another.
+#define FLATMIPSIZE	(32*32 + 16*16 + 8*8)
+
+extern byte**	flatmips;
+
+void R_CacheFlatMips (int flat);
+byte *R_GetFlatMips (int flat);
+void R_ReleaseFlatMips (int flat);
+
 
 // Retrieval.
 // Floor/ceiling opaque texture tiles,
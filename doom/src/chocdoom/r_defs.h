@@ -91,11 +91,26 @@ typedef struct
 
 } degenmobj_t;
 
+//
+// A two sided line as seen from one of its sectors
+//  by sound propagation, see P_NoiseAlert.
+// open caches P_LineOpening, valid while heightstamp
+//  matches the heightcount sum of both sectors.
+//
+typedef struct
+{
+    struct line_s*	line;
+    struct sector_s*	other;
+    int			heightstamp;
+    boolean		open;
+
+} soundportal_t;
+
 //
 // The SECTORS record, at runtime.
 // Stores things/mobjs.
 //
-typedef	struct
+typedef	struct sector_s
 {
     fixed_t	floorheight;
     fixed_t	ceilingheight;
@@ -129,6 +144,23 @@ typedef	struct
     int			linecount;
     struct line_s**	lines;	// [linecount] size
 
+    // getNextSector of each two sided line,
+    //  in lines[] order, built by P_GroupLines
+    int			neighbourcount;
+    struct sector_s**	neighbours;	// [neighbourcount] size
+
+    // sector numbers with the same tag hash,
+    //  in ascending order, -1 terminated
+    int			firsttag;
+    int			nexttag;
+
+    // bumped whenever floor or ceiling may move
+    int			heightcount;
+
+    // two sided lines in lines[] order, for P_NoiseAlert
+    int			portalcount;
+    soundportal_t*	portals;	// [portalcount] size
+
     int extrlight;
     boolean extralightown;
 } sector_t;
@@ -233,6 +265,20 @@ typedef struct subsector_s
 
 
 
+//
+// Seg end points in map units, parallel to segs[].
+// R_AddLine reads them instead of chasing v1/v2 into vertexes[].
+//
+typedef struct
+{
+    short	x1;
+    short	y1;
+    short	x2;
+    short	y2;
+
+} segvertex_t;
+
+
 //
 // The LineSeg.
 //
@@ -261,6 +307,30 @@ typedef struct
 //
 // BSP node.
 //
+#if COMPACTLEVEL
+
+// The partition line in map units, as the WAD stores it:
+//  12 bytes a node instead of 52.  The child bounding boxes are
+//  only needed for the far side, so they live in nodebboxes[]
+//  and stay out of the cache on the way down.
+typedef struct
+{
+    // Partition line.
+    short	x;
+    short	y;
+    short	dx;
+    short	dy;
+
+    // If NF_SUBSECTOR its a subsector.
+    unsigned short children[2];
+    
+} node_t;
+
+// Bounding box for each child of a node, in map units.
+typedef short	nodebbox_t[2][4];
+
+#else
+
 typedef struct
 {
     // Partition line.
@@ -277,6 +347,8 @@ typedef struct
     
 } node_t;
 
+#endif
+
 
 
 
@@ -734,7 +734,7 @@ void R_InitTranslationTables (void)
 {
     int		i;
 	
-    translationtables = Z_Malloc (256*3, PU_STATIC, 0);
+    translationtables = Z_MallocTier (256*3, PU_STATIC, 0, Z_TIER_FAST);
     
     // translate just the 16 green colors
     for (i=0 ; i<256 ; i++)
@@ -784,6 +784,11 @@ fixed_t			ds_ystep;
 // start of a 64*64 tile image 
 byte*			ds_source;	
 
+// for R_DrawSpanLOD: mip level of ds_source (64>>ds_mip square),
+// and log2 of the run of pixels each sample is written to
+int			ds_mip;
+int			ds_runshift;
+
 // just for profiling
 int			dscount;
 
@@ -797,6 +802,8 @@ void R_DrawSpan (void)
     int count;
     int spot;
     unsigned int xtemp, ytemp;
+    lighttable_t *colormap;
+    byte *source;
 
 #ifdef RANGECHECK
     if (ds_x2 < ds_x1
@@ -821,11 +828,36 @@ void R_DrawSpan (void)
          | ((ds_ystep >> 6)  & 0x0000ffff);
 
     dest = ylookup[ds_y] + columnofs[ds_x1];
+    source = ds_source;
+    colormap = ds_colormap;
 
     // We do not check for zero spans here?
-    count = ds_x2 - ds_x1;
+    count = ds_x2 - ds_x1 + 1;
 
-    do
+    // Four pixels at a time, stepping position once per pixel.
+    while (count >= 4)
+    {
+	spot = ((position >> 4) & 0x0fc0) | (position >> 26);
+	position += step;
+	dest[0] = pixel(colormap[source[spot]]);
+
+	spot = ((position >> 4) & 0x0fc0) | (position >> 26);
+	position += step;
+	dest[1] = pixel(colormap[source[spot]]);
+
+	spot = ((position >> 4) & 0x0fc0) | (position >> 26);
+	position += step;
+	dest[2] = pixel(colormap[source[spot]]);
+
+	spot = ((position >> 4) & 0x0fc0) | (position >> 26);
+	position += step;
+	dest[3] = pixel(colormap[source[spot]]);
+
+	dest += 4;
+	count -= 4;
+    }
+
+    while (count--)
     {
 	// Calculate current texture index in u,v.
         ytemp = (position >> 4) & 0x0fc0;
@@ -834,11 +866,10 @@ void R_DrawSpan (void)
 
 	// Lookup pixel from flat texture tile,
 	//  re-index using light/colormap.
-	*dest++ = pixel(ds_colormap[ds_source[spot]]);
+	*dest++ = pixel(colormap[source[spot]]);
 
         position += step;
-
-    } while (count--);
+    }
 }
 
 
@@ -916,6 +947,82 @@ void R_DrawSpan (void)
 #endif
 
 
+//
+// R_DrawSpanLOD
+// For distant rows: samples the ds_mip level of the flat once every
+// 1<<ds_runshift pixels and writes the sample over the whole run.
+//
+static const unsigned int ds_mipymask[4] =
+{
+    0x0fc0, 0x03e0, 0x00f0, 0x0038
+};
+
+void R_DrawSpanLOD (void)
+{
+    unsigned int position, step, runstep;
+    unsigned int xtemp, ytemp;
+    unsigned int ymask;
+    int yshift, xshift;
+    set_line_t setrun;
+    pix_t *dest;
+    pix_t c;
+    int count;
+    int run;
+
+#ifdef RANGECHECK
+    if (ds_x2 < ds_x1
+	|| ds_x1<0
+	|| ds_x2>=SCREENWIDTH
+	|| (unsigned)ds_y>SCREENHEIGHT
+	|| (unsigned)ds_mip>3
+	|| ds_runshift<1
+	|| ds_runshift>3)
+    {
+	I_Error( "R_DrawSpanLOD: %i to %i at %i",
+		 ds_x1,ds_x2,ds_y);
+    }
+#endif
+
+    position = ((ds_xfrac << 10) & 0xffff0000)
+             | ((ds_yfrac >> 6)  & 0x0000ffff);
+    step = ((ds_xstep << 10) & 0xffff0000)
+         | ((ds_ystep >> 6)  & 0x0000ffff);
+
+    // Sample in the middle of each run.
+    run = 1 << ds_runshift;
+    runstep = step << ds_runshift;
+    position += step * (run >> 1);
+
+    yshift = 4 + 2*ds_mip;
+    xshift = 26 + ds_mip;
+    ymask = ds_mipymask[ds_mip];
+    setrun = set_line_tbl[R_RANGE_NEAREST + ds_runshift];
+
+    dest = ylookup[ds_y] + columnofs[ds_x1];
+    count = ds_x2 - ds_x1 + 1;
+
+    while (count >= run)
+    {
+        ytemp = (position >> yshift) & ymask;
+        xtemp = position >> xshift;
+        c = pixel(ds_colormap[ds_source[xtemp | ytemp]]);
+        setrun(dest, c);
+
+        dest += run;
+        position += runstep;
+        count -= run;
+    }
+
+    if (count > 0)
+    {
+        ytemp = (position >> yshift) & ymask;
+        xtemp = position >> xshift;
+        c = pixel(ds_colormap[ds_source[xtemp | ytemp]]);
+        v_set_line(dest, c, count);
+    }
+}
+
+
 //
 // Again..
 //
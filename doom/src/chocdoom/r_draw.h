@@ -76,6 +76,9 @@ extern fixed_t		ds_ystep;
 // start of a 64*64 tile image
 extern byte*		ds_source;		
 
+extern int		ds_mip;
+extern int		ds_runshift;
+
 extern byte*		translationtables;
 extern byte*		dc_translation;
 
@@ -87,6 +90,9 @@ void 	R_DrawSpan (void);
 // Low resolution mode, 160x200?
 void 	R_DrawSpanLow (void);
 
+// Distant rows, from a mip level in runs of pixels.
+void 	R_DrawSpanLOD (void);
+
 int
 R_ProcDownscale (int start, int stop);
 
@@ -22,21 +22,29 @@
 
 
 
+#include <stdio.h>
 #include <stdlib.h>
 #include <math.h>
 
 
 #include "doomdef.h"
 #include "d_loop.h"
+#include "i_system.h"
+#include "i_timer.h"
 
+#include "m_argv.h"
 #include "m_bbox.h"
 #include "m_menu.h"
 
 #include "r_local.h"
 #include "r_sky.h"
+#include "r_overdraw.h"
+#include "m_profile.h"
+#include "w_wad.h"
 
 #include "z_zone.h"
 #include <bsp_sys.h>
+#include <bsp_cmd.h>
 
 
 // Fineangles in the SCREENWIDTH wide window.
@@ -152,25 +160,38 @@ int	R_PointOnSide (int x, int y, node_t *node)
 {
 	fixed_t	dx,dy;
 	fixed_t	left, right;
+#if COMPACTLEVEL
+	// The partition is in map units
+	fixed_t	nx = node->x<<FRACBITS;
+	fixed_t	ny = node->y<<FRACBITS;
+#else
+	fixed_t	nx = node->x;
+	fixed_t	ny = node->y;
+#endif
 
 	if (!node->dx)
 	{
-		if (x <= node->x)
+		if (x <= nx)
 			return node->dy > 0;
 		return node->dy < 0;
 	}
 	if (!node->dy)
 	{
-		if (y <= node->y)
+		if (y <= ny)
 			return node->dx < 0;
 		return node->dx > 0;
 	}
 	
-	dx = (x - node->x);
-	dy = (y - node->y);
+	dx = (x - nx);
+	dy = (y - ny);
 	
+#if COMPACTLEVEL
+	left = node->dy * (dx>>16);
+	right = (dy>>16) * node->dx;
+#else
 	left = (node->dy>>16) * (dx>>16);
 	right = (dy>>16) * (node->dx>>16);
+#endif
 	
 	if (right < left)
 		return 0;		/* front side */
@@ -436,7 +457,8 @@ fixed_t R_ScaleFromGlobalAngle (angle_t visangle)
 //
 void R_InitTables (void)
 {
-    finesine_n = (int *)Z_Malloc(10240 * sizeof(int), PU_STATIC, 0);
+    // Read for every seg; fast RAM after the colormaps
+    finesine_n = (int *)Z_MallocTier(10240 * sizeof(int), PU_STATIC, 0, Z_TIER_FAST);
     for (int i = 0; i < 10240; i++) {
         finesine_n[i] = FixedDiv(FRACUNIT, finesine[i]);
     }
@@ -550,6 +572,137 @@ void R_InitLightTables (void)
 
 
 
+//
+// R_YSlopeAt
+// Plane distance scale for a screen row
+//  dy rows away from centery.
+//
+static fixed_t R_YSlopeAt (int dy)
+{
+    return FixedDiv ((viewwidth<<detailshift)/2*FRACUNIT,
+		     abs((dy<<FRACBITS)+FRACUNIT/2));
+}
+
+
+//
+// R_InitYSlope
+// Fills yslopetab for every centery offset
+//  within MAXLOOKROWS, once per view size.
+// Looking up and down then only moves
+//  the yslope pointer, see R_SetCenterY.
+//
+static fixed_t	yslopeslow[SCREENHEIGHT];
+
+static void R_InitYSlope (void)
+{
+    int		i;
+    int		base;
+
+    base = viewheight/2 + MAXLOOKROWS;
+
+    for (i=0 ; i<viewheight+2*MAXLOOKROWS ; i++)
+	yslopetab[i] = R_YSlopeAt (i-base);
+}
+
+
+//
+// R_LookCenterY
+// Horizon row for the current look pitch.
+//
+static int R_LookCenterY (void)
+{
+    return viewheight/2 + (players[0].lookdir>>FRACBITS)*screenblocks/10;
+}
+
+
+//
+// R_SetCenterY
+// yslope[i] only depends on i-centery, so a pitch
+//  change is a pointer move into yslopetab.
+// Offsets outside of the table (should not happen
+//  with the p_user.c look clamp) are computed per row.
+//
+static void R_SetCenterY (int newcentery)
+{
+    int		i;
+    int		ofs;
+
+    centery = newcentery;
+    centeryfrac = centery<<FRACBITS;
+
+    ofs = centery - viewheight/2;
+
+    if (ofs >= -MAXLOOKROWS && ofs <= MAXLOOKROWS)
+    {
+	yslope = yslopetab + MAXLOOKROWS - ofs;
+	return;
+    }
+
+    for (i=0 ; i<viewheight ; i++)
+	yslopeslow[i] = R_YSlopeAt (i-centery);
+    yslope = yslopeslow;
+}
+
+
+//
+// R_BenchYSlope
+// Sweeps the pitch over the whole look range
+//  and compares the table against the per row
+//  FixedDiv path it replaces.
+// Any mismatch would change the plane spans,
+//  so it is fatal.
+//
+static void R_BenchYSlope (int frames)
+{
+    int		f;
+    int		i;
+    int		cy;
+    int		lookrows;
+    int		start;
+    int		tabletime;
+    int		divtime;
+    fixed_t	check;
+
+    lookrows = 60*screenblocks/10;
+    check = 0;
+
+    start = I_GetTimeMS ();
+    for (f=0 ; f<frames ; f++)
+    {
+	cy = viewheight/2 + (f % (2*lookrows+1)) - lookrows;
+	R_SetCenterY (cy);
+	check += yslope[0];
+    }
+    tabletime = I_GetTimeMS () - start;
+
+    start = I_GetTimeMS ();
+    for (f=0 ; f<frames ; f++)
+    {
+	cy = viewheight/2 + (f % (2*lookrows+1)) - lookrows;
+	for (i=0 ; i<viewheight ; i++)
+	    yslopeslow[i] = R_YSlopeAt (i-cy);
+	check -= yslopeslow[0];
+    }
+    divtime = I_GetTimeMS () - start;
+
+    for (cy=viewheight/2-lookrows ; cy<=viewheight/2+lookrows ; cy++)
+    {
+	R_SetCenterY (cy);
+	for (i=0 ; i<viewheight ; i++)
+	{
+	    if (yslope[i] != R_YSlopeAt (i-cy))
+		I_Error ("R_BenchYSlope: row %i differs at centery %i", i, cy);
+	}
+    }
+
+    printf ("R_BenchYSlope: %i pitch changes, table %i ms, divide %i ms (%i)\n",
+	    frames, tabletime, divtime, check);
+
+    R_SetCenterY (R_LookCenterY ());
+}
+
+
+
 //
 // R_SetViewSize
 // Do not really change anything here,
@@ -582,9 +735,8 @@ void R_ExecuteSetViewSize (void)
     int		j;
     int		level;
     int		startmap; 	
-    int tempCentery;
 
-    profiler_enter();
+    PROF_ENTER();
 
     detailshift = setdetail;
 
@@ -634,28 +786,9 @@ void R_ExecuteSetViewSize (void)
     for (i=0 ; i<viewwidth ; i++)
 	screenheightarray[i] = viewheight;
 
-#if 0
     // planes
-    for (i=0 ; i<viewheight ; i++)
-    {
-	dy = ((i-viewheight/2)<<FRACBITS)+FRACUNIT/2;
-	dy = abs(dy);
-	yslope[i] = FixedDiv ( (viewwidth<<detailshift)/2*FRACUNIT, dy);
-    }
-#else
-    tempCentery = viewheight / 2 + (players[0].lookdir >> FRACBITS) * screenblocks / 10;
-    if (centery != tempCentery)
-    {
-        centery = tempCentery;
-        centeryfrac = centery << FRACBITS;
-        for (i = 0; i < viewheight; i++)
-        {
-            yslope[i] = FixedDiv((viewwidth << detailshift) / 2 * FRACUNIT,
-                                 abs(((i - centery) << FRACBITS) +
-                                     FRACUNIT / 2));
-        }
-    }
-#endif
+    R_InitYSlope ();
+    R_SetCenterY (R_LookCenterY ());
     for (i=0 ; i<viewwidth ; i++)
     {
 	cosadj = abs(finecosine[xtoviewangle[i]>>ANGLETOFINESHIFT]);
@@ -681,7 +814,7 @@ void R_ExecuteSetViewSize (void)
 	    scalelight[i][j] = colormaps + level*256;
 	}
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 
@@ -690,10 +823,16 @@ void R_ExecuteSetViewSize (void)
 // R_Init
 //
 
+int32_t		bspmsec;		// time in R_RenderBSPNode
+int32_t		bspframes;		// frames counted in bspmsec
+int32_t		planemsec;		// time in R_DrawPlanes, same frames
+
 
 
 void R_Init (void)
 {
+    int		p;
+
     R_InitData ();
     R_InitPointToAngle ();
     R_InitTables ();
@@ -706,6 +845,29 @@ void R_Init (void)
     R_InitTranslationTables ();
 	
     framecount = 0;
+
+    //!
+    // @arg <n>
+    // @category obscure
+    //
+    // Time <n> free-look pitch changes through the yslope
+    // table against per row divides, and verify both match.
+    //
+
+    p = M_CheckParmWithArgs ("-benchyslope", 1);
+
+    if (p)
+    {
+	R_ExecuteSetViewSize ();
+	R_BenchYSlope (atoi (myargv[p+1]));
+    }
+
+    cmd_register_i32 (&bspmsec, "bspmsec");
+    cmd_register_i32 (&bspframes, "bspframes");
+    cmd_register_i32 (&planemsec, "planemsec");
+    cmd_register_i32 (&skypass, "skypass");
+
+    R_InitOverdraw ();
 }
 
 
@@ -772,18 +934,8 @@ void R_SetupFrame (player_t* player)
     else
 	fixedcolormap = 0;
 
-    int tempCentery = viewheight / 2 + (players[0].lookdir >> FRACBITS) * screenblocks / 10;
-    if (centery != tempCentery)
-    {
-        centery = tempCentery;
-        centeryfrac = centery << FRACBITS;
-        for (i = 0; i < viewheight; i++)
-        {
-            yslope[i] = FixedDiv((viewwidth << detailshift) / 2 * FRACUNIT,
-                                 abs(((i - centery) << FRACBITS) +
-                                     FRACUNIT / 2));
-        }
-    }
+    if (centery != R_LookCenterY ())
+	R_SetCenterY (R_LookCenterY ());
 		
     framecount++;
     validcount++;
@@ -795,8 +947,13 @@ void R_SetupFrame (player_t* player)
 //
 void R_RenderPlayerView (player_t* player)
 {	
-    profiler_enter();
+    unsigned int	lumpreads;
+    int			bspstart;
+
+    PROF_ENTER();
+    lumpreads = w_lumpreads;
     R_SetupFrame (player);
+    R_StartOverdraw ();
     // Clear buffers.
 
     R_ClearClipSegs ();
@@ -808,19 +965,34 @@ void R_RenderPlayerView (player_t* player)
     NetUpdate ();
 
     // The head node is the last node output.
+    bspstart = I_GetTimeMS ();
+    PROF_ENTER_AS (R_RenderBSPNode);
     R_RenderBSPNode (numnodes-1);
+    PROF_EXIT_AS (R_RenderBSPNode);
+    bspmsec += I_GetTimeMS () - bspstart;
+    bspframes++;
 
     // Check for new console commands.
     NetUpdate ();
     
+    bspstart = I_GetTimeMS ();
     R_DrawPlanes ();
+    planemsec += I_GetTimeMS () - bspstart;
     
     // Check for new console commands.
     NetUpdate ();
     
     R_DrawMasked ();
 
+    if (overdrawframe)
+	R_FinishOverdraw ();
+
     // Check for new console commands.
     NetUpdate ();			
-    profiler_exit();
+
+    // Lumps that had to be read from the card for this frame.
+    prefetchstalls = w_lumpreads - lumpreads;
+    prefetchstalltotal += prefetchstalls;
+    prefetchframes++;
+    PROF_EXIT();
 }
@@ -0,0 +1,352 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Overdraw render mode: counts the writes to every view pixel
+//	and shows them as a heat map instead of the scene.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "doomdef.h"
+#include "i_video.h"
+#include "m_argv.h"
+#include "z_zone.h"
+
+#include "r_local.h"
+#include "r_overdraw.h"
+#include "v_video.h"
+#include <bsp_cmd.h>
+
+#define ODSIZE		(SCREENWIDTH * SCREENHEIGHT)
+
+// Totals are also kept per 16x16 cell of the view, to find hot spots.
+#define ODCELLSHIFT	4
+#define ODCELLSX	(SCREENWIDTH >> ODCELLSHIFT)
+#define ODCELLSY	((SCREENHEIGHT + (1 << ODCELLSHIFT) - 1) >> ODCELLSHIFT)
+
+int32_t		overdraw;
+boolean		overdrawframe;
+
+//
+// OVERDRAW TOTALS
+// Of the last counted frame: every write, the view pixels written at
+// least once and those never written, the average writes per written
+// pixel in hundredths, the most writes to one pixel, and the pixels
+// each kernel wrote.  Set odreport to print them with the hottest cell.
+//
+int32_t		odwrites;
+int32_t		odcovered;
+int32_t		odholes;
+int32_t		odaverage;
+int32_t		odmax;
+int32_t		odpixels[NUMODKERNELS];
+int32_t		odreport;
+
+static char*	odkernelnames[NUMODKERNELS] =
+{
+    "odcolumn", "odcolumnlod", "odfuzz", "odtrans",
+    "odspan", "odspanlod", "odsky"
+};
+
+// Writes per pixel, 0 to 6 and more.
+static const byte	odheat[] = { 0, 200, 112, 231, 216, 176, 209 };
+
+static const byte	odkernelcolors[NUMODKERNELS] =
+{
+    112, 120, 96, 231, 200, 204, 209
+};
+
+// LOD run length of 1, 2, 4 and 8 pixels.
+static const byte	odlodcolors[] = { 112, 231, 216, 176 };
+
+// Writes to each screen pixel, and the kernel and LOD of the last one.
+static byte*	odcounts;
+static byte*	odwriters;
+
+static int	odcells[ODCELLSY][ODCELLSX];
+
+// The kernels the counting ones stand in for during a frame.
+static void (*odcolfunc) (void);
+static void (*odfuzzcolfunc) (void);
+static void (*odtranscolfunc) (void);
+static void (*odspanfunc) (void);
+
+
+//
+// R_CountPixels
+// A block of view pixels, sx and width already at screen scale.
+//
+static void
+R_CountPixels
+( int		kernel,
+  int		shift,
+  int		sx,
+  int		width,
+  int		yl,
+  int		yh )
+{
+    byte*	count;
+    byte*	writer;
+    byte	id;
+    int		i;
+
+    if (sx + width > scaledviewwidth)
+	width = scaledviewwidth - sx;
+    if (width <= 0 || yl > yh)
+	return;
+
+    odpixels[kernel] += width * (yh - yl + 1);
+    id = kernel | (shift << 4);
+
+    for ( ; yl <= yh ; yl++)
+    {
+	i = (yl + viewwindowy) * SCREENWIDTH + viewwindowx + sx;
+	count = odcounts + i;
+	writer = odwriters + i;
+
+	for (i = 0 ; i < width ; i++)
+	{
+	    if (count[i] < 255)
+		count[i]++;
+	    writer[i] = id;
+	}
+    }
+}
+
+void R_CountColumnPixels (int kernel, int shift, int x, int yl, int yh)
+{
+    R_CountPixels (kernel, shift, x << detailshift,
+		   1 << (detailshift + shift), yl, yh);
+}
+
+void R_CountSpanPixels (int kernel, int shift, int y, int x1, int x2)
+{
+    R_CountPixels (kernel, shift, x1 << detailshift,
+		   (x2 - x1 + 1) << detailshift, y, y);
+}
+
+
+//
+// Counting kernels.  Columns are counted after drawing, as the fuzz
+// kernels clip dc_yl and dc_yh; spans before, as the low detail one
+// scales ds_x1 and ds_x2.  R_AddLine sets render_on_distance for
+// every seg in high detail, so a column only counts as LOD when its
+// range is drawn in runs.
+//
+static void R_OverdrawColumn (void)
+{
+    int		shift;
+
+    odcolfunc ();
+
+    shift = render_on_distance && !detailshift
+	  ? rw_render_downscale[rw_render_range].shift : 0;
+
+    if (shift > 0)
+	R_CountColumnPixels (od_columnlod, shift, dc_x, dc_yl, dc_yh);
+    else
+	R_CountColumnPixels (od_column, 0, dc_x, dc_yl, dc_yh);
+}
+
+static void R_OverdrawFuzzColumn (void)
+{
+    odfuzzcolfunc ();
+    R_CountColumnPixels (od_fuzz, 0, dc_x, dc_yl, dc_yh);
+}
+
+static void R_OverdrawTranslatedColumn (void)
+{
+    odtranscolfunc ();
+    R_CountColumnPixels (od_trans, 0, dc_x, dc_yl, dc_yh);
+}
+
+static void R_OverdrawSpan (void)
+{
+    R_CountSpanPixels (od_span, 0, ds_y, ds_x1, ds_x2);
+    odspanfunc ();
+}
+
+
+//
+// R_StartOverdraw
+// Puts the counting kernels in place for one frame, or lets the
+// buffers go once overdraw is turned off.
+//
+void R_StartOverdraw (void)
+{
+    if (!overdraw)
+    {
+	if (odcounts)
+	{
+	    Z_Free (odcounts);
+	    odcounts = odwriters = NULL;
+	}
+	return;
+    }
+
+    if (!odcounts)
+    {
+	odcounts = Z_Malloc (2 * ODSIZE, PU_STATIC, NULL);
+	odwriters = odcounts + ODSIZE;
+    }
+
+    memset (odcounts, 0, 2 * ODSIZE);
+    memset (odpixels, 0, sizeof(odpixels));
+
+    odcolfunc = basecolfunc;
+    odfuzzcolfunc = fuzzcolfunc;
+    odtranscolfunc = transcolfunc;
+    odspanfunc = spanfunc;
+
+    colfunc = basecolfunc = R_OverdrawColumn;
+    fuzzcolfunc = R_OverdrawFuzzColumn;
+    transcolfunc = R_OverdrawTranslatedColumn;
+    spanfunc = R_OverdrawSpan;
+
+    overdrawframe = true;
+}
+
+
+//
+// R_ReportOverdraw
+//
+static void R_ReportOverdraw (void)
+{
+    int		x, y;
+    int		hotx, hoty;
+    int		i;
+
+    hotx = hoty = 0;
+    for (y = 0 ; y < ODCELLSY ; y++)
+	for (x = 0 ; x < ODCELLSX ; x++)
+	    if (odcells[y][x] > odcells[hoty][hotx])
+	    {
+		hotx = x;
+		hoty = y;
+	    }
+
+    printf ("overdraw: %d writes to %d pixels, %d.%02d each, "
+	    "max %d, %d unwritten\n",
+	    odwrites, odcovered, odaverage / 100, odaverage % 100,
+	    odmax, odholes);
+
+    for (i = 0 ; i < NUMODKERNELS ; i++)
+	printf ("  %-12s %d\n", odkernelnames[i], odpixels[i]);
+
+    printf ("  hottest cell at %d,%d: %d writes\n",
+	    hotx << ODCELLSHIFT, hoty << ODCELLSHIFT, odcells[hoty][hotx]);
+}
+
+
+//
+// R_FinishOverdraw
+// Puts the kernels back, adds up the frame and replaces the view
+// with the chosen map.
+//
+void R_FinishOverdraw (void)
+{
+    pix_t*	dest;
+    byte	count;
+    byte	writer;
+    byte	c;
+    int		x, y, i;
+
+    colfunc = basecolfunc = odcolfunc;
+    fuzzcolfunc = odfuzzcolfunc;
+    transcolfunc = odtranscolfunc;
+    spanfunc = odspanfunc;
+
+    overdrawframe = false;
+
+    odwrites = odcovered = odholes = odmax = 0;
+    memset (odcells, 0, sizeof(odcells));
+
+    for (y = 0 ; y < viewheight ; y++)
+    {
+	i = (y + viewwindowy) * SCREENWIDTH + viewwindowx;
+	dest = I_VideoBuffer + i;
+
+	for (x = 0 ; x < scaledviewwidth ; x++, i++)
+	{
+	    count = odcounts[i];
+	    writer = odwriters[i];
+
+	    odwrites += count;
+	    if (count)
+		odcovered++;
+	    else
+		odholes++;
+	    if (count > odmax)
+		odmax = count;
+	    odcells[y >> ODCELLSHIFT][x >> ODCELLSHIFT] += count;
+
+	    if (!count)
+		c = 0;
+	    else if (overdraw == 2)
+		c = odkernelcolors[writer & 15];
+	    else if (overdraw == 3)
+		c = odlodcolors[(writer >> 4) & 3];
+	    else
+		c = odheat[count < arrlen(odheat) ? count : arrlen(odheat) - 1];
+
+	    dest[x] = pixel(c);
+	}
+    }
+
+    odaverage = odcovered ? (int) ((int64_t) odwrites * 100 / odcovered) : 0;
+
+    if (odreport)
+    {
+	R_ReportOverdraw ();
+	odreport = 0;
+    }
+}
+
+
+//
+// R_InitOverdraw
+//
+void R_InitOverdraw (void)
+{
+    int		p;
+    int		i;
+
+    //!
+    // @arg <mode>
+    // @category obscure
+    //
+    // Show overdraw instead of the scene: 1 for writes per pixel,
+    // 2 for the kernel that drew each pixel, 3 for its LOD.
+    //
+
+    p = M_CheckParmWithArgs ("-overdraw", 1);
+
+    if (p)
+	overdraw = atoi (myargv[p+1]);
+
+    cmd_register_i32 (&overdraw, "overdraw");
+    cmd_register_i32 (&odreport, "odreport");
+    cmd_register_i32 (&odwrites, "odwrites");
+    cmd_register_i32 (&odcovered, "odcovered");
+    cmd_register_i32 (&odholes, "odholes");
+    cmd_register_i32 (&odaverage, "odaverage");
+    cmd_register_i32 (&odmax, "odmax");
+
+    for (i = 0 ; i < NUMODKERNELS ; i++)
+	cmd_register_i32 (&odpixels[i], odkernelnames[i]);
+}
+
@@ -0,0 +1,59 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Overdraw render mode: counts the writes to every view pixel
+//	and shows them as a heat map instead of the scene.
+//
+
+
+#ifndef __R_OVERDRAW__
+#define __R_OVERDRAW__
+
+#include "doomtype.h"
+
+// The kernels that write view pixels.
+typedef enum
+{
+    od_column,		// colfunc, full resolution
+    od_columnlod,	// colfunc through R_RenderColVar
+    od_fuzz,		// fuzzcolfunc
+    od_trans,		// transcolfunc
+    od_span,		// spanfunc
+    od_spanlod,		// R_DrawSpanLOD
+    od_sky,		// R_DrawSky
+
+    NUMODKERNELS
+} odkernel_t;
+
+// 0 renders normally; 1 shows writes per pixel, 2 the last kernel
+// to write each pixel, 3 its LOD run length.
+extern int32_t	overdraw;
+
+// True while a frame is being counted.
+extern boolean	overdrawframe;
+
+void R_InitOverdraw (void);
+
+// Around R_RenderPlayerView.
+void R_StartOverdraw (void);
+void R_FinishOverdraw (void);
+
+// Writes made outside colfunc and spanfunc, in view coordinates.
+// shift is the log2 of the LOD run length.
+void R_CountColumnPixels (int kernel, int shift, int x, int yl, int yh);
+void R_CountSpanPixels (int kernel, int shift, int y, int x1, int x2);
+
+#endif
+
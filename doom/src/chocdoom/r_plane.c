@@ -21,6 +21,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "i_system.h"
 #include "z_zone.h"
@@ -28,13 +29,18 @@
 
 #include "doomdef.h"
 #include "doomstat.h"
+#include "m_argv.h"
 
 #include "r_local.h"
 #include "r_sky.h"
 #include "st_stuff.h"
 #include "p_local.h"
 #include "v_video.h"
+#include "r_data.h"
+#include "r_overdraw.h"
+#include "m_profile.h"
 #include <bsp_sys.h>
+#include <bsp_cmd.h>
 
 
 extern planefunction_t		floorfunc;
@@ -78,7 +84,7 @@ extern int			spanstop[SCREENHEIGHT];
 extern lighttable_t**		planezlight;
 extern fixed_t			planeheight;
 
-extern fixed_t			yslope[SCREENHEIGHT];
+extern fixed_t*			yslope;
 extern fixed_t			distscale[SCREENWIDTH];
 extern fixed_t			basexscale;
 extern fixed_t			baseyscale;
@@ -90,49 +96,73 @@ extern fixed_t			cachedystep[SCREENHEIGHT];
 
 extern int plyr_wpflash_light;
 
+// 0 = high, 1 = low
+extern int			detailshift;
+
 //
-// R_InitPlanes
-// Only at game startup.
+// Span LOD: rows further than R_DISTANCE_NEAR are drawn in runs of
+// 2, 4 or 8 pixels, like the distant wall columns, from the flat mip
+// level that matches the run's footprint. High detail only.
 //
-void R_InitPlanes (void)
+int32_t				spanlod = 1;
+
+int32_t				planebatch = 1;	// see R_DrawPlaneSpans
+int32_t				planespans;	// spans drawn, for spans/sec
+
+static byte*			planesource;	// the 64*64 flat
+static byte*			planemips;	// its mip levels, or NULL
+
+static const int		planemipofs[4] =
 {
-  // Doh!
+    0, 0, 32*32, 32*32 + 16*16
+};
+
+//
+// R_SpanLOD
+// Picks the run length and mip level for a row at distance,
+// returns false to draw it at full resolution.
+//
+static boolean R_SpanLOD (fixed_t distance)
+{
+    fixed_t	footprint;
+    fixed_t	xstep;
+    fixed_t	ystep;
+    int		mip;
+
+    if (!planemips || distance <= R_DISTANCE_NEAR)
+	return false;
+
+    if (distance > R_DISTANCE_FAR)
+	ds_runshift = rw_render_downscale[R_RANGE_FAR].shift;
+    else if (distance > R_DISTANCE_MID)
+	ds_runshift = rw_render_downscale[R_RANGE_MID].shift;
+    else
+	ds_runshift = rw_render_downscale[R_RANGE_NEAR].shift;
+
+    // texels covered by one run
+    xstep = abs(ds_xstep);
+    ystep = abs(ds_ystep);
+    footprint = (xstep > ystep ? xstep : ystep) << ds_runshift;
+
+    for (mip = 0; mip < 3 && footprint >= 2*FRACUNIT; mip++)
+	footprint >>= 1;
+
+    ds_mip = mip;
+    ds_source = mip ? planemips + planemipofs[mip] : planesource;
+
+    return true;
 }
 
 
 //
-// R_MapPlane
-//
-// Uses global vars:
-//  planeheight
-//  ds_source
-//  basexscale
-//  baseyscale
-//  viewx
-//  viewy
+// R_SetupPlaneRow
+// The per row part of R_MapPlane: steps, lights and colormap.
+// Returns the distance of the row.
 //
-// BASIC PRIMITIVE
-//
-void
-R_MapPlane
-( int		y,
-  int		x1,
-  int		x2 )
+static fixed_t R_SetupPlaneRow (int y)
 {
-    angle_t	angle;
     fixed_t	distance;
-    fixed_t	length;
     unsigned	index;
-	
-#ifdef RANGECHECK
-    if (x2 < x1
-     || x1 < 0
-     || x2 >= viewwidth
-     || y > viewheight)
-    {
-	I_Error ("R_MapPlane: %i, %i at %i",x1,x2,y);
-    }
-#endif
 
     if (planeheight != cachedheight[y])
     {
@@ -153,11 +183,6 @@ R_MapPlane
     }
     ST_StartLight(distance, 0, -1, LT_FOG);
 
-    length = FixedMul (distance,distscale[x1]);
-    angle = (viewangle + xtoviewangle[x1])>>ANGLETOFINESHIFT;
-    ds_xfrac = viewx + FixedMul(finecosine[angle], length);
-    ds_yfrac = -viewy - FixedMul(finesine[angle], length);
-
     if (fixedcolormap)
 	ds_colormap = fixedcolormap;
     else
@@ -169,18 +194,262 @@ R_MapPlane
 
 	ds_colormap = planezlight[index];
     }
-	
+
     ds_y = y;
+
+    return distance;
+}
+
+
+//
+// R_DrawPlaneSpan
+// Draws x1 to x2 of the row set up by R_SetupPlaneRow.
+//
+static void R_DrawPlaneSpan (fixed_t distance, int x1, int x2)
+{
+    angle_t	angle;
+    fixed_t	length;
+
+    length = FixedMul (distance,distscale[x1]);
+    angle = (viewangle + xtoviewangle[x1])>>ANGLETOFINESHIFT;
+    ds_xfrac = viewx + FixedMul(finecosine[angle], length);
+    ds_yfrac = -viewy - FixedMul(finesine[angle], length);
+
     ds_x1 = x1;
     ds_x2 = x2;
 
-    // high or low detail
-    spanfunc ();	
+    // high or low detail, or a distant row
+    if (R_SpanLOD (distance))
+    {
+	if (overdrawframe)
+	    R_CountSpanPixels (od_spanlod, ds_runshift, ds_y, x1, x2);
+	R_DrawSpanLOD ();
+    }
+    else
+    {
+	ds_source = planesource;
+	spanfunc ();
+    }
+
+    planespans++;
+}
+
+
+//
+// R_MapPlane
+//
+// Uses global vars:
+//  planeheight
+//  planesource
+//  basexscale
+//  baseyscale
+//  viewx
+//  viewy
+//
+// BASIC PRIMITIVE
+//
+void
+R_MapPlane
+( int		y,
+  int		x1,
+  int		x2 )
+{
+    fixed_t	distance;
+	
+#ifdef RANGECHECK
+    if (x2 < x1
+     || x1 < 0
+     || x2 >= viewwidth
+     || y > viewheight)
+    {
+	I_Error ("R_MapPlane: %i, %i at %i",x1,x2,y);
+    }
+#endif
+
+    distance = R_SetupPlaneRow (y);
+    R_DrawPlaneSpan (distance, x1, x2);
 
     ST_StopLight();
 }
 
 
+//
+// PLANE BATCHES
+// With planebatch set, R_MakeSpans only collects the spans of a
+// visplane, chained by row. They are drawn a row at a time, so the
+// row setup is done once however many spans share the row, and from
+// a copy of the flat in fast RAM once the plane is big enough to pay
+// for the copy.
+//
+#define MAXPLANESPANS		1024
+#define PLANETILEPIXELS		2048	// pixels worth copying the flat for
+#define PLANETILESIZE		(64*64 + FLATMIPSIZE)
+
+typedef struct
+{
+    short	x1;
+    short	x2;
+    short	next;		// next span on the row, or -1
+} planespan_t;
+
+static planespan_t	planespanlist[MAXPLANESPANS];
+static int		numplanespans;
+static short		planerows[SCREENHEIGHT];	// first span, or -1
+static int		planetop;
+static int		planebottom;
+static int		planepixels;	// pixels in this visplane so far
+
+static byte*		planetile;	// in fast RAM
+static int		planetilelump = -1;
+static boolean		planetilemips;
+static int		planelump;	// flat of the visplane being drawn
+
+
+//
+// R_UsePlaneTile
+// Points planesource and planemips at the fast RAM copy of the flat,
+// copying it unless the tile already holds it.
+//
+static void R_UsePlaneTile (int lumpnum)
+{
+    if (planesource == planetile)
+	return;
+
+    if (planetilelump != lumpnum || (planemips && !planetilemips))
+    {
+	memcpy (planetile, planesource, 64*64);
+	planetilemips = planemips != NULL;
+	if (planemips)
+	    memcpy (planetile + 64*64, planemips, FLATMIPSIZE);
+	planetilelump = lumpnum;
+    }
+
+    planesource = planetile;
+    if (planemips)
+	planemips = planetile + 64*64;
+}
+
+
+//
+// R_DrawPlaneSpans
+// Draws the collected spans, a row at a time.
+//
+static void R_DrawPlaneSpans (int lumpnum)
+{
+    planespan_t*	span;
+    fixed_t		distance;
+    int			y;
+    int			i;
+
+    if (!numplanespans)
+	return;
+
+    if (planetile && planepixels >= PLANETILEPIXELS)
+	R_UsePlaneTile (lumpnum);
+
+    for (y=planetop ; y<=planebottom ; y++)
+    {
+	i = planerows[y];
+	if (i < 0)
+	    continue;
+
+	distance = R_SetupPlaneRow (y);
+
+	for ( ; i >= 0 ; i = span->next)
+	{
+	    span = &planespanlist[i];
+	    R_DrawPlaneSpan (distance, span->x1, span->x2);
+	}
+
+	ST_StopLight();
+	planerows[y] = -1;
+    }
+
+    numplanespans = 0;
+    planetop = SCREENHEIGHT;
+    planebottom = -1;
+}
+
+
+static void R_AddPlaneSpan (int y, int x1, int x2)
+{
+    planespan_t*	span;
+
+#ifdef RANGECHECK
+    if (x2 < x1
+     || x1 < 0
+     || x2 >= viewwidth
+     || y > viewheight)
+    {
+	I_Error ("R_AddPlaneSpan: %i, %i at %i",x1,x2,y);
+    }
+#endif
+
+    if (numplanespans == MAXPLANESPANS)
+	R_DrawPlaneSpans (planelump);
+
+    span = &planespanlist[numplanespans];
+    span->x1 = x1;
+    span->x2 = x2;
+    span->next = planerows[y];
+    planerows[y] = numplanespans++;
+
+    if (y < planetop)
+	planetop = y;
+    if (y > planebottom)
+	planebottom = y;
+
+    planepixels += x2 - x1 + 1;
+}
+
+
+static void R_InitPlaneBatch (void)
+{
+    int		i;
+
+    //!
+    // @category obscure
+    //
+    // Draw floors and ceilings a span at a time as they are found,
+    // without batching them by row.
+    //
+
+    if (M_CheckParm ("-noplanebatch"))
+	planebatch = 0;
+
+    for (i=0 ; i<SCREENHEIGHT ; i++)
+	planerows[i] = -1;
+    planetop = SCREENHEIGHT;
+    planebottom = -1;
+
+    planetile = Z_MallocTier (PLANETILESIZE, PU_STATIC, 0, Z_TIER_FAST);
+
+    cmd_register_i32 (&planebatch, "planebatch");
+    cmd_register_i32 (&planespans, "planespans");
+}
+
+
+//
+// R_InitPlanes
+// Only at game startup.
+//
+void R_InitPlanes (void)
+{
+    //!
+    // @category obscure
+    //
+    // Draw distant floors and ceilings at full resolution.
+    //
+
+    if (M_CheckParm ("-nospanlod"))
+	spanlod = 0;
+
+    cmd_register_i32 (&spanlod, "spanlod");
+
+    R_InitPlaneBatch ();
+}
+
+
 //
 // R_ClearPlanes
 // At begining of frame.
@@ -278,15 +547,27 @@ R_MakeSpans
   int		t2,
   int		b2 )
 {
-    fixed_t distance = FixedMul (planeheight, yslope[b1]);
-
-    while (t1 < t2 && t1<=b1) {
-        R_MapPlane (t1,spanstart[t1],x-1);
-        t1++;
+    if (planebatch)
+    {
+	while (t1 < t2 && t1<=b1) {
+	    R_AddPlaneSpan (t1,spanstart[t1],x-1);
+	    t1++;
+	}
+	while (b1 > b2 && b1>=t1) {
+	    R_AddPlaneSpan (b1,spanstart[b1],x-1);
+	    b1--;
+	}
     }
-    while (b1 > b2 && b1>=t1) {
-        R_MapPlane (b1,spanstart[b1],x-1);
-        b1--;
+    else
+    {
+	while (t1 < t2 && t1<=b1) {
+	    R_MapPlane (t1,spanstart[t1],x-1);
+	    t1++;
+	}
+	while (b1 > b2 && b1>=t1) {
+	    R_MapPlane (b1,spanstart[b1],x-1);
+	    b1--;
+	}
     }
     while (t2 < t1 && t2<=b2)
     {
@@ -306,6 +587,8 @@ R_MakeSpans
 // R_DrawPlanes
 // At the end of each frame.
 //
+static visplane_t*	skyplanes[MAXVISPLANES];
+
 void R_DrawPlanes (void)
 {
     visplane_t*		pl;
@@ -314,8 +597,9 @@ void R_DrawPlanes (void)
     int			stop;
     int			angle;
     int                 lumpnum;
+    int			numskyplanes;
 
-    profiler_enter();
+    PROF_ENTER();
     render_on_distance = false;
 #ifdef RANGECHECK
     if (ds_p - drawsegs > MAXDRAWSEGS)
@@ -331,6 +615,8 @@ void R_DrawPlanes (void)
 		 lastopening - openings);
 #endif
 
+    numskyplanes = 0;
+
     for (pl = visplanes ; pl < lastvisplane ; pl++)
     {
 	if (pl->minx > pl->maxx)
@@ -338,6 +624,12 @@ void R_DrawPlanes (void)
 
 	
 	// sky flat
+	if (pl->picnum == skyflatnum && skypass)
+	{
+	    skyplanes[numskyplanes++] = pl;
+	    continue;
+	}
+
 	if (pl->picnum == skyflatnum)
 	{
 	    dc_iscale = pspriteiscale>>detailshift;
@@ -366,7 +658,13 @@ void R_DrawPlanes (void)
 	
 	// regular flat
         lumpnum = firstflat + flattranslation[pl->picnum];
-	ds_source = W_CacheLumpNum(lumpnum, PU_STATIC);
+	planesource = W_CacheLumpNum(lumpnum, PU_STATIC);
+	planemips = NULL;
+	planelump = lumpnum;
+	planepixels = 0;
+
+	if (spanlod && !detailshift)
+	    planemips = R_GetFlatMips(flattranslation[pl->picnum]);
 	
 	planeheight = abs(pl->height-viewz);
 	light = (pl->lightlevel >> LIGHTSEGSHIFT)+extralight + 1;
@@ -391,8 +689,14 @@ void R_DrawPlanes (void)
 			pl->top[x],
 			pl->bottom[x]);
 	}
+
+	R_DrawPlaneSpans (lumpnum);
 	
+    if (planemips)
+	R_ReleaseFlatMips(flattranslation[pl->picnum]);
     W_ReleaseLumpNum(lumpnum);
     }
-    profiler_exit();
+
+    R_DrawSky (skyplanes, numskyplanes);
+    PROF_EXIT();
 }
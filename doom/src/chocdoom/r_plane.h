@@ -28,6 +28,13 @@
 // Visplane related.
 extern  short*		lastopening;
 
+// The visplanes of the current frame run up to lastvisplane.
+extern visplane_t	visplanes[];
+extern visplane_t*	lastvisplane;
+
+// Distant rows from the flat mip levels, see R_CacheFlatMips.
+extern int32_t		spanlod;
+
 
 typedef void (*planefunction_t) (int top, int bottom);
 
@@ -37,7 +44,13 @@ extern planefunction_t	ceilingfunc_t;
 extern short		floorclip[SCREENWIDTH];
 extern short		ceilingclip[SCREENWIDTH];
 
-extern fixed_t		yslope[SCREENHEIGHT];
+// Free-look range, in rows, covered by the yslopetab.
+// yslope points into it at the current centery offset.
+#define MAXLOOKROWS		(SCREENHEIGHT/2)
+#define YSLOPETABSIZE		(SCREENHEIGHT+2*MAXLOOKROWS)
+
+extern fixed_t*		yslope;
+extern fixed_t		yslopetab[YSLOPETABSIZE];
 extern fixed_t		distscale[SCREENWIDTH];
 
 void R_InitPlanes (void);
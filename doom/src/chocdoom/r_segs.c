@@ -32,6 +32,7 @@
 #include "r_local.h"
 #include "r_sky.h"
 #include "st_stuff.h"
+#include "am_map.h"
 #include <gfx2d_mem.h>
 
 
@@ -562,7 +563,11 @@ R_StoreWallRange
     linedef = curline->linedef;
 
     // mark the segment as visible for auto map
-    linedef->flags |= ML_MAPPED;
+    if (!(linedef->flags & ML_MAPPED))
+    {
+	linedef->flags |= ML_MAPPED;
+	AM_LineMapped (linedef);
+    }
     
     // calculate rw_distance for scale calculation
     rw_normalangle = curline->angle + ANG90;
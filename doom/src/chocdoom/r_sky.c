@@ -28,8 +28,13 @@
 // Needed for Flat retrieval.
 #include "r_data.h"
 
+#include "z_zone.h"
+#include "doomstat.h"
+#include "r_local.h"
+#include "v_video.h"
 
 #include "r_sky.h"
+#include "r_overdraw.h"
 
 //
 // sky mapping
@@ -38,6 +43,15 @@ extern int			skyflatnum;
 extern int			skytexture;
 extern int			skytexturemid;
 
+extern int*			texturewidthmask;
+extern fixed_t			pspriteiscale;
+
+// 0 = high, 1 = low
+extern int			detailshift;
+
+extern pix_t*			ylookup[MAXHEIGHT];
+extern int			columnofs[MAXWIDTH];
+
 
 
 //
@@ -50,3 +64,167 @@ void R_InitSkyMap (void)
     skytexturemid = SCREENHEIGHT/2*FRACUNIT;
 }
 
+
+//
+// SKY PASS
+// The sky texture is kept expanded in skybuffer, SKYHEIGHT texels a
+// column and already mapped through colormaps[0], since the sky is
+// always full bright. The texel row of each screen row only depends
+// on centery and the scale, so it is looked up in skyrows, and a sky
+// column is a plain copy with no colormap or R_GetColumn per column.
+//
+#define SKYHEIGHT	128
+
+int32_t			skypass = 1;	// 0 draws the sky through colfunc
+
+static pix_t*		skybuffer;
+static int		skybuffertex = -1;
+static int		skywidthmask;
+
+static byte		skyrows[SCREENHEIGHT];
+static int		skyrowscentery = -1;
+static fixed_t		skyrowsiscale;
+static int		skyrowsheight;
+
+
+//
+// R_InitSkyBuffer
+// Expands the sky texture into skybuffer. It is PU_CACHE, so this is
+// done again if the zone takes it back.
+//
+static void R_InitSkyBuffer (void)
+{
+    byte*	source;
+    pix_t*	dest;
+    int		width;
+    int		x, y;
+
+    if (skybuffer && skybuffertex == skytexture)
+	return;
+
+    if (skybuffer)
+	Z_Free (skybuffer);
+
+    skywidthmask = texturewidthmask[skytexture];
+    width = skywidthmask + 1;
+
+    Z_Malloc (width*SKYHEIGHT*sizeof(*skybuffer), PU_STATIC, &skybuffer);
+
+    for (x=0, dest=skybuffer ; x<width ; x++)
+    {
+	source = R_GetColumn (skytexture, x);
+
+	for (y=0 ; y<SKYHEIGHT ; y++)
+	    *dest++ = pixel(colormaps[source[y]]);
+    }
+
+    Z_ChangeTag (skybuffer, PU_CACHE);
+    skybuffertex = skytexture;
+}
+
+
+//
+// R_InitSkyRows
+// Same texel rows R_DrawColumn would step through.
+//
+static void R_InitSkyRows (fixed_t iscale)
+{
+    float	frac;
+    int		y;
+
+    if (skyrowscentery == centery
+     && skyrowsiscale == iscale
+     && skyrowsheight == viewheight)
+	return;
+
+    for (y=0 ; y<viewheight ; y++)
+    {
+	frac = (float)(skytexturemid + (y-centery)*iscale);
+	frac /= DOUBLEUNIT;
+	skyrows[y] = (int)frac & (SKYHEIGHT-1);
+    }
+
+    skyrowscentery = centery;
+    skyrowsiscale = iscale;
+    skyrowsheight = viewheight;
+}
+
+
+//
+// R_DrawSky
+// Draws the sky columns of all the sky visplanes in one pass,
+// left to right.
+//
+void R_DrawSky (visplane_t **planes, int count)
+{
+    visplane_t*		pl;
+    pix_t*		source;
+    pix_t*		dest;
+    int			minx, maxx;
+    int			x, dx;
+    int			yl, yh;
+    int			angle;
+    int			i;
+
+    if (!count)
+	return;
+
+    R_InitSkyBuffer ();
+    R_InitSkyRows (pspriteiscale>>detailshift);
+
+    // Keep it while drawing, nothing here allocates.
+    Z_ChangeTag (skybuffer, PU_STATIC);
+
+    minx = SCREENWIDTH;
+    maxx = -1;
+    for (i=0 ; i<count ; i++)
+    {
+	if (planes[i]->minx < minx)
+	    minx = planes[i]->minx;
+	if (planes[i]->maxx > maxx)
+	    maxx = planes[i]->maxx;
+    }
+
+    for (x=minx ; x<=maxx ; x++)
+    {
+	source = NULL;
+	dx = x << detailshift;
+
+	for (i=0 ; i<count ; i++)
+	{
+	    pl = planes[i];
+	    if (x < pl->minx || x > pl->maxx)
+		continue;
+
+	    yl = pl->top[x];
+	    yh = pl->bottom[x];
+	    if (yl > yh)
+		continue;
+
+	    if (!source)
+	    {
+		angle = (viewangle + xtoviewangle[x])>>ANGLETOSKYSHIFT;
+		source = skybuffer + (angle & skywidthmask)*SKYHEIGHT;
+	    }
+
+	    if (overdrawframe)
+		R_CountColumnPixels (od_sky, 0, x, yl, yh);
+
+	    dest = ylookup[yl] + columnofs[dx];
+
+	    if (detailshift)
+	    {
+		for ( ; yl<=yh ; yl++, dest+=SCREENWIDTH)
+		    dest[0] = dest[1] = source[skyrows[yl]];
+	    }
+	    else
+	    {
+		for ( ; yl<=yh ; yl++, dest+=SCREENWIDTH)
+		    *dest = source[skyrows[yl]];
+	    }
+	}
+    }
+
+    Z_ChangeTag (skybuffer, PU_CACHE);
+}
+
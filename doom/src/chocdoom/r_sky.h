@@ -20,6 +20,8 @@
 #ifndef __R_SKY__
 #define __R_SKY__
 
+#include "r_defs.h"
+
 
 
 // SKY, store the number for name.
@@ -34,4 +36,9 @@ extern int		skytexturemid;
 // Called whenever the view size changes.
 void R_InitSkyMap (void);
 
+// Draws the sky visplanes, all in one pass.
+void R_DrawSky (visplane_t **planes, int count);
+
+extern int32_t		skypass;
+
 #endif
@@ -83,6 +83,10 @@ extern subsector_t*	subsectors;
 
 extern int		numnodes;
 extern node_t*		nodes;
+#if COMPACTLEVEL
+extern nodebbox_t*	nodebboxes;
+extern segvertex_t*	segverts;
+#endif
 
 extern int		numlines;
 extern line_t*		lines;
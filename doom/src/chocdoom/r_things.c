@@ -30,10 +30,12 @@
 #include "z_zone.h"
 #include "w_wad.h"
 
+#include "m_snapshot.h"
 #include "r_local.h"
 
 #include "doomstat.h"
 #include "st_stuff.h"
+#include "m_profile.h"
 #include <bsp_sys.h>
 #include "misc_utils.h"
 
@@ -200,6 +202,42 @@ static void R_InstallSpriteLump(int lump, unsigned frame,
 // The rotation character can be 0 to signify no rotations.
 //
 
+//
+// R_SpriteDefsFromSnapshot
+// Fills in sprites[] from the boot snapshot: the spritedef_t of each
+// sprite, followed by the frames of all of them.
+//
+static boolean R_SpriteDefsFromSnapshot (void)
+{
+    spritedef_t*	defs;
+    spriteframe_t*	frames;
+    int			size;
+    int			numframes;
+    int			i;
+
+    defs = M_SnapshotGet (snap_spritedefs, &size);
+    if (!defs || size < numsprites*(int)sizeof(*defs))
+	return false;
+
+    numframes = 0;
+    for (i=0 ; i<numsprites ; i++)
+	numframes += defs[i].numframes;
+
+    if (size != numsprites*sizeof(*defs) + numframes*sizeof(*frames))
+	return false;
+
+    frames = (spriteframe_t *) (defs + numsprites);
+
+    for (i=0 ; i<numsprites ; i++)
+    {
+	sprites[i].numframes = defs[i].numframes;
+	sprites[i].spriteframes = defs[i].numframes ? frames : NULL;
+	frames += defs[i].numframes;
+    }
+
+    return true;
+}
+
 #define R_SpriteNameHash(s) ((unsigned)((s)[0]-((s)[1]*3-(s)[3]*2-(s)[2])*2))
 
 void R_InitSpriteDefs (char** namelist) 
@@ -224,6 +262,9 @@ void R_InitSpriteDefs (char** namelist)
 	return;
 		
     sprites = Z_Malloc(numsprites *sizeof(*sprites), PU_STATIC, NULL);
+
+    if (R_SpriteDefsFromSnapshot ())
+	return;
 	
     start = firstspritelump-1;
     end = lastspritelump+1;
@@ -303,6 +344,14 @@ void R_InitSpriteDefs (char** namelist)
 	    Z_Malloc (maxframe * sizeof(spriteframe_t), PU_STATIC, NULL);
 	d_memcpy (sprites[i].spriteframes, sprtemp, maxframe*sizeof(spriteframe_t));
     }
+
+    M_SnapshotAdd (snap_spritedefs, sprites, numsprites*sizeof(*sprites));
+    for (i=0 ; i<numsprites ; i++)
+    {
+	M_SnapshotAdd (snap_spritedefs, sprites[i].spriteframes,
+		       sprites[i].numframes*sizeof(spriteframe_t));
+    }
+    M_SnapshotEnd (snap_spritedefs);
 }
 
 //
@@ -1105,7 +1154,7 @@ void R_DrawMasked (void)
     vissprite_t*	spr;
     drawseg_t*		ds;
 	
-    profiler_enter();
+    PROF_ENTER();
 #if vis_hack
     if (vissprite_p > vissprites)
     {
@@ -1143,7 +1192,7 @@ void R_DrawMasked (void)
     if (!viewangleoffset)		{
 	    R_DrawPlayerSprites ();
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 
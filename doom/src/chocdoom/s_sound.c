@@ -44,6 +44,7 @@
 #include "w_wad.h"
 #include "z_zone.h"
 #include "d_main.h"
+#include "m_profile.h"
 // when to clip out sounds
 // Does not fit the large outdoor areas.
 
@@ -420,6 +421,12 @@ void S_StartSound(void *origin_p, int sfx_id)
     int cnum;
     int volume;
 
+    // nothing is heard while a demo runs ahead
+    if (demoseeking)
+    {
+        return;
+    }
+
     origin = (mobj_t *) origin_p;
     volume = snd_SfxVolume;
 
@@ -532,7 +539,7 @@ void S_UpdateSounds(mobj_t *listener)
     int                sep;
     sfxinfo_t*        sfx;
     channel_t*        c;
-    profiler_enter();
+    PROF_ENTER();
     I_UpdateSound();
 
     for (cnum=0; cnum<snd_channels; cnum++)
@@ -589,7 +596,7 @@ void S_UpdateSounds(mobj_t *listener)
             }
         }
     }
-    profiler_exit();
+    PROF_EXIT();
 }
 
 void S_SetMusicVolume(int volume)
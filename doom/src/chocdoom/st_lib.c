@@ -147,7 +147,9 @@ STlib_updateNum
 ( st_number_t*		n,
   boolean		refresh )
 {
-    if (*n->on) STlib_drawNum(n, refresh);
+    // only when it changed, the status bar compositor keeps the rest
+    if (*n->on && (refresh || n->oldnum != *n->num))
+	STlib_drawNum(n, refresh);
 }
 
 
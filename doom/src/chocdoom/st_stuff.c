@@ -35,6 +35,7 @@
 #include "doomkeys.h"
 
 #include "g_game.h"
+#include "m_bbox.h"
 
 #include "st_stuff.h"
 #include "st_lib.h"
@@ -418,21 +419,105 @@ cheatseq_t cheat_mypos = CHEAT("idmypos", 0);
 //
 void ST_Stop(void);
 
+//
+// STATUS BAR COMPOSITOR
+// The widgets are drawn into st_compose_screen, which always holds
+// the whole bar, and only the rectangles they changed are copied to
+// the frame buffer, with V_CopyRect. When the frame buffer has been
+// drawn over, the bar is copied back whole without drawing anything.
+// Pixels are palette indices, so the background is drawn once per
+// level, not once per palette.
+//
+#define ST_MAXDAMAGE	24
+
+static pix_t*		st_compose_screen;
+static boolean		st_backgroundvalid;
+
+// Rectangles changed this frame, and the box being marked.
+static int		st_damage[ST_MAXDAMAGE][4];
+static int		st_numdamage;
+static int		st_damagebox[4];
+
+static boolean		st_oldstatusbaron;
+static boolean		st_oldmenuactive;
+
+// The bar as if it started at the top of a SCREENWIDTH wide screen,
+// so the widgets draw into it at their frame buffer coordinates.
+#define ST_COMPOSE	(st_compose_screen - ST_Y*SCREENWIDTH)
+
+//
+// Adds the box marked since the last call as a changed rectangle.
+//
+static void ST_addDamage(void)
+{
+    int		*box;
+
+    if (st_damagebox[BOXRIGHT] < st_damagebox[BOXLEFT])
+	return;
+
+    if (st_numdamage == ST_MAXDAMAGE)
+    {
+	// out of rectangles, grow the last one
+	box = st_damage[ST_MAXDAMAGE-1];
+	M_AddToBox(box, st_damagebox[BOXLEFT], st_damagebox[BOXBOTTOM]);
+	M_AddToBox(box, st_damagebox[BOXRIGHT], st_damagebox[BOXTOP]);
+    }
+    else
+    {
+	memcpy(st_damage[st_numdamage++], st_damagebox, sizeof(st_damagebox));
+    }
+
+    M_ClearBox(st_damagebox);
+}
+
+//
+// Copies the changed rectangles, or the whole bar, to the screen.
+//
+static void ST_blitDamage(boolean whole)
+{
+    int		*box;
+    int		i;
+
+    if (whole)
+    {
+	V_CopyRect(ST_X, 0, st_compose_screen, ST_WIDTH, ST_HEIGHT, ST_X, ST_Y);
+    }
+    else
+    {
+	for (i=0 ; i<st_numdamage ; i++)
+	{
+	    box = st_damage[i];
+	    V_CopyRect(box[BOXLEFT], box[BOXBOTTOM] - ST_Y, st_compose_screen,
+		       box[BOXRIGHT] - box[BOXLEFT] + 1,
+		       box[BOXTOP] - box[BOXBOTTOM] + 1,
+		       box[BOXLEFT], box[BOXBOTTOM]);
+	}
+    }
+
+    st_numdamage = 0;
+}
+
 void ST_refreshBackground(void)
 {
 
     if (st_statusbaron)
     {
-        V_UseBuffer(st_backing_screen);
+	if (!st_backgroundvalid)
+	{
+	    V_UseBuffer(st_backing_screen);
 
-	V_DrawPatch(ST_X, 0, sbar);
+	    V_DrawPatch(ST_X, 0, sbar);
 
-	if (netgame)
-	    V_DrawPatch(ST_FX, 0, faceback);
+	    if (netgame)
+		V_DrawPatch(ST_FX, 0, faceback);
 
-        V_RestoreBuffer();
+	    V_RestoreBuffer();
+
+	    st_backgroundvalid = true;
+	}
 
-	V_CopyRect(ST_X, 0, st_backing_screen, ST_WIDTH, ST_HEIGHT, ST_X, ST_Y);
+	memcpy(st_compose_screen, st_backing_screen,
+	       ST_WIDTH * ST_HEIGHT * sizeof(pix_t));
     }
 
 }
@@ -1023,35 +1108,55 @@ void ST_drawWidgets(boolean refresh)
     // used by w_frags widget
     st_fragson = deathmatch && st_statusbaron; 
 
+    // each widget adds what it drew to the damage list
+    M_ClearBox(st_damagebox);
+    V_UseBufferMarked(ST_COMPOSE, st_damagebox);
+
     STlib_updateNum(&w_ready, refresh);
+    ST_addDamage();
 
     if (0 == D_PKG_3DO()) {
         for (i=0;i<4;i++)
         {
     	STlib_updateNum(&w_ammo[i], refresh);
+    	ST_addDamage();
     	STlib_updateNum(&w_maxammo[i], refresh);
+    	ST_addDamage();
         }
     }
 
     STlib_updatePercent(&w_health, refresh);
+    ST_addDamage();
     STlib_updatePercent(&w_armor, refresh);
+    ST_addDamage();
 
     if (0 == D_PKG_3DO()) {
         STlib_updateBinIcon(&w_armsbg, refresh);
     } else {
         STlib_updateNum(&w_level, refresh);
     }
+    ST_addDamage();
     for (i=0;i<6;i++)
+    {
 	STlib_updateMultIcon(&w_arms[i], refresh);
+	ST_addDamage();
+    }
 
     STlib_updateMultIcon(&w_faces, refresh);
+    ST_addDamage();
 
     for (i=0;i<3;i++)
+    {
 	STlib_updateMultIcon(&w_keyboxes[i], refresh);
+	ST_addDamage();
+    }
 
     if (!D_PKG_3DO()) {
         STlib_updateNum(&w_frags, refresh);
+        ST_addDamage();
     }
+
+    V_RestoreBuffer();
 }
 
 #if 1/*(GFX_COLOR_MODE == GFX_COLOR_MODE_CLUT)*/
@@ -1262,12 +1367,26 @@ void ST_diffDraw(void)
 
 void ST_Drawer (boolean fullscreen, boolean refresh)
 {
+    boolean	whole;
+
     st_statusbaron = (!fullscreen) || automapactive;
-    st_firsttime = st_firsttime || refresh;
+
+    // The widgets do not draw while the bar is off.
+    if (st_statusbaron != st_oldstatusbaron)
+	st_firsttime = true;
+    st_oldstatusbaron = st_statusbaron;
 
     // Do red-/gold-shifts from damage/items
     ST_doPaletteStuff();
 
+    if (!st_statusbaron)
+	return;
+
+    // Copy the whole bar back if the screen was drawn over:
+    // a wipe, a help screen, or a menu that is up or just went.
+    whole = st_firsttime || refresh || menuactive || st_oldmenuactive;
+    st_oldmenuactive = menuactive;
+
     I_SetPlayPal();
 
     // If just after ST_Start(), refresh all
@@ -1275,6 +1394,8 @@ void ST_Drawer (boolean fullscreen, boolean refresh)
     // Otherwise, update as little as possible
     else ST_diffDraw();
 
+    ST_blitDamage(whole);
+
     I_RestorePal();
 }
 
@@ -1659,6 +1780,7 @@ void ST_Start (void)
     ST_initData();
     ST_createWidgets();
     st_stopped = false;
+    st_backgroundvalid = false;
 
 }
 
@@ -1675,6 +1797,12 @@ void ST_Stop (void)
 void ST_Init (void)
 {
     ST_loadData();
+
+    // The blend table is built from the play palette
+    I_SetPalette (W_CacheLumpNum (lu_palette, PU_CACHE), 0);
+    I_InitBlendTable();
+
     st_backing_screen = (pix_t *) Z_Malloc(ST_WIDTH * ST_HEIGHT * sizeof(pix_t), PU_STATIC, 0);
+    st_compose_screen = (pix_t *) Z_Malloc(ST_WIDTH * ST_HEIGHT * sizeof(pix_t), PU_STATIC, 0);
 }
 
@@ -32,6 +32,7 @@
 #include "i_video.h"
 #include "m_bbox.h"
 #include "m_misc.h"
+#include "m_profile.h"
 #include "v_video.h"
 #include "w_wad.h"
 #include "z_zone.h"
@@ -59,6 +60,9 @@ static pix_t *dest_screen = NULL;
 
 int dirtybox[4]; 
 
+// Box the drawing to an alternate buffer is marked in, if any.
+static int *buffer_box = NULL;
+
 // haleyjd 08/28/10: clipping callback function for patches.
 // This is needed for Chocolate Strife, which clips patches to the screen.
 static vpatchclipfunc_t patchclip_callback = NULL;
@@ -76,6 +80,11 @@ void V_MarkRect(int x, int y, int width, int height)
         M_AddToBox (dirtybox, x, y); 
         M_AddToBox (dirtybox, x + width-1, y + height-1); 
     }
+    else if (buffer_box)
+    {
+        M_AddToBox (buffer_box, x, y); 
+        M_AddToBox (buffer_box, x + width-1, y + height-1); 
+    }
 } 
  
 
@@ -277,9 +286,9 @@ void V_DrawPatchFlipped(int x, int y, patch_t *patch)
 
 void V_DrawPatchDirect(int x, int y, patch_t *patch)
 {
-    profiler_enter();
+    PROF_ENTER();
     V_DrawPatch(x, y, patch); 
-    profiler_exit();
+    PROF_EXIT();
 } 
 
 //
@@ -624,11 +633,20 @@ void V_UseBuffer(pix_t *buffer)
     dest_screen = buffer;
 }
 
+// As V_UseBuffer, and marks what is drawn in box.
+
+void V_UseBufferMarked(pix_t *buffer, int *box)
+{
+    dest_screen = buffer;
+    buffer_box = box;
+}
+
 // Restore screen buffer to the i_video screen buffer.
 
 void V_RestoreBuffer(void)
 {
     dest_screen = I_VideoBuffer;
+    buffer_box = NULL;
 }
 
 //
@@ -111,6 +111,10 @@ void V_DrawRawScreen(byte *raw);
 
 void V_UseBuffer(pix_t *buffer);
 
+// Same, also adding the area drawn to box (see m_bbox.h).
+
+void V_UseBufferMarked(pix_t *buffer, int *box);
+
 // Return to using the normal screen buffer to draw graphics.
 
 void V_RestoreBuffer(void);
@@ -26,6 +26,7 @@
 #include <debug.h>
 
 extern wad_file_class_t stdc_wad_file;
+extern wad_file_class_t lz4_wad_file;
 
 #ifdef _WIN32
 extern wad_file_class_t win32_wad_file;
@@ -46,6 +47,8 @@ static wad_file_class_t *wad_file_classes[] =
     &stdc_wad_file,
 };
 
+unsigned int w_bytesread;
+
 /*
 
 typedef struct
@@ -74,6 +77,15 @@ wad_file_t *W_OpenFile(char *path)
     wad_file_t *result;
     int i;
 
+    // Packed WADs are recognised by their header, whatever the name.
+
+    result = lz4_wad_file.OpenFile(path);
+
+    if (result != NULL)
+    {
+        return result;
+    }
+
     //!
     // Use the OS's virtual memory subsystem to map WAD files
     // directly into memory.
@@ -113,6 +125,15 @@ void W_ForEach (const char *path,
 
 wad_file_t *W_MapFile(char *path)
 {
+    wad_file_t *result;
+
+    result = lz4_wad_file.MMapFile(path);
+
+    if (result != NULL)
+    {
+        return result;
+    }
+
     return stdc_wad_file.MMapFile(path);
 }
 
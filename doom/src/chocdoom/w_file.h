@@ -81,6 +81,10 @@ void W_CloseFile(wad_file_t *wad);
 size_t W_Read(wad_file_t *wad, unsigned int offset,
               void *buffer, size_t buffer_len);
 
+// Bytes read from the storage device so far, by all WAD files.
+
+extern unsigned int w_bytesread;
+
 #define F_DOT_WAD "WAD"
 
 
@@ -0,0 +1,411 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	WAD I/O functions for LZ4 packed WADs (see doom/tools/lz4wad.c).
+//
+//	The container holds the unpacked WAD as a list of blocks: the
+//	header, the directory, every lump and the gaps between them.
+//	Reads are in unpacked WAD offsets, so W_AddFile and W_ReadLump
+//	do not know the difference.  A read that covers exactly one block
+//	(every W_ReadLump call) loads the packed data into the tail of the
+//	caller's buffer and decodes it in place.  The packer ends the LZ4
+//	stream where the output can no longer overtake the input and
+//	stores the rest of the block raw, already in its final place.
+//
+
+#include <stdio.h>
+#include "string.h"
+
+#include <misc_utils.h>
+#include <debug.h>
+#include <dev_io.h>
+#include <bsp_sys.h>
+
+#include <d_main.h>
+#include "i_swap.h"
+#include "i_system.h"
+#include "w_file.h"
+#include "z_zone.h"
+
+#define LZ4WAD_ID "LZWD"
+
+typedef struct
+{
+    char	identification[4];	// LZ4WAD_ID
+    int		numblocks;
+    int		indexofs;
+    int		length;			// unpacked WAD length
+} PACKEDATTR lz4wad_header_t;
+
+typedef struct
+{
+    int		position;		// offset in the unpacked WAD
+    int		size;			// unpacked size
+    int		zposition;		// offset in the container
+    int		zsize;			// packed size
+    int		lzsize;			// LZ4 stream bytes; 0 if stored
+} PACKEDATTR lz4wad_block_t;
+
+typedef struct
+{
+    wad_file_t wad;
+    char path[D_MAX_PATH];
+    int numblocks;
+    lz4wad_block_t *blocks;
+} lz4_wad_file_t;
+
+extern wad_file_class_t lz4_wad_file;
+
+//
+// LZ4_Decode
+// Decodes an LZ4 block.  src may lie inside dst, as long as it ends
+// at dst + dstlen and no write overtakes the input.  Returns the
+// number of bytes written, or -1 if the block is malformed.
+//
+static int LZ4_Decode(const byte *src, int srclen, byte *dst, int dstlen)
+{
+    const byte *ip = src;
+    const byte *iend = src + srclen;
+    byte *op = dst;
+    byte *oend = dst + dstlen;
+    const byte *match;
+    unsigned int token;
+    unsigned int len;
+    unsigned int b;
+
+    while (ip < iend)
+    {
+        token = *ip++;
+
+        // literals
+
+        len = token >> 4;
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (unsigned int)(iend - ip) || len > (unsigned int)(oend - op))
+            return -1;
+        memmove(op, ip, len);
+        op += len;
+        ip += len;
+
+        // the last sequence has no match
+
+        if (ip >= iend)
+            break;
+
+        // match
+
+        if (iend - ip < 2)
+            return -1;
+        match = op - (ip[0] | (ip[1] << 8));
+        ip += 2;
+        if (match < dst || match == op)
+            return -1;
+
+        len = token & 15;
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += 4;
+        if (len > (unsigned int)(oend - op))
+            return -1;
+
+        // byte copy, the match may overlap its own output
+
+        while (len--)
+            *op++ = *match++;
+    }
+
+    return op - dst;
+}
+
+static int W_LZ4_ReadRaw(int f, unsigned int offset,
+                         void *buffer, size_t buffer_len)
+{
+    int err;
+
+    err = d_seek(f, offset, DSEEK_SET);
+    err = err < 0 ? err : d_read(f, buffer, buffer_len);
+    if (err > 0)
+    {
+        w_bytesread += err;
+    }
+    return err;
+}
+
+//
+// W_LZ4_ReadBlock
+// Unpacks one block into dest, which must hold block->size bytes.
+//
+static void W_LZ4_ReadBlock(lz4_wad_file_t *lz4_wad, int f,
+                            lz4wad_block_t *block, byte *dest)
+{
+    byte *packed;
+    int unpacked;
+
+    if (block->lzsize == 0)
+    {
+        if (W_LZ4_ReadRaw(f, block->zposition, dest,
+                          block->size) != block->size)
+        {
+            I_Error("W_LZ4_ReadBlock: read error in %s", lz4_wad->path);
+        }
+        return;
+    }
+
+    packed = dest + block->size - block->zsize;
+    unpacked = block->size - (block->zsize - block->lzsize);
+
+    if (W_LZ4_ReadRaw(f, block->zposition, packed,
+                      block->zsize) != block->zsize
+     || LZ4_Decode(packed, block->lzsize, dest, unpacked) != unpacked)
+    {
+        I_Error("W_LZ4_ReadBlock: bad block at %i in %s",
+                block->position, lz4_wad->path);
+    }
+}
+
+// Index of the block holding the given unpacked offset.
+
+static int W_LZ4_FindBlock(lz4_wad_file_t *lz4_wad, unsigned int offset)
+{
+    int lo, hi, mid;
+
+    lo = 0;
+    hi = lz4_wad->numblocks - 1;
+
+    while (lo < hi)
+    {
+        mid = (lo + hi + 1) / 2;
+
+        if ((unsigned int)lz4_wad->blocks[mid].position <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    return lo;
+}
+
+static lz4_wad_file_t *W_LZ4_Open(char *path, int *file)
+{
+    lz4_wad_file_t *result;
+    lz4wad_header_t header;
+    int f, i, length;
+
+    length = d_open(path, &f, "r");
+    if (f < 0)
+    {
+        return NULL;
+    }
+
+    if (length < (int)sizeof(header)
+     || d_read(f, &header, sizeof(header)) != sizeof(header)
+     || strncmp(header.identification, LZ4WAD_ID, 4))
+    {
+        d_close(f);
+        return NULL;
+    }
+
+    result = Z_Malloc(sizeof(lz4_wad_file_t), PU_STATIC, 0);
+    result->wad.file_class = &lz4_wad_file;
+    result->wad.mapped = NULL;
+    result->wad.length = LONG(header.length);
+    snprintf(result->path, sizeof(result->path), "%s", path);
+
+    result->numblocks = LONG(header.numblocks);
+    length = result->numblocks * sizeof(lz4wad_block_t);
+    result->blocks = Z_Malloc(length, PU_STATIC, 0);
+
+    if (d_seek(f, LONG(header.indexofs), DSEEK_SET) < 0
+     || d_read(f, result->blocks, length) != length)
+    {
+        I_Error("W_LZ4_Open: can't read index of %s", path);
+    }
+
+    for (i = 0; i < result->numblocks; ++i)
+    {
+        result->blocks[i].position = LONG(result->blocks[i].position);
+        result->blocks[i].size = LONG(result->blocks[i].size);
+        result->blocks[i].zposition = LONG(result->blocks[i].zposition);
+        result->blocks[i].zsize = LONG(result->blocks[i].zsize);
+        result->blocks[i].lzsize = LONG(result->blocks[i].lzsize);
+    }
+
+    *file = f;
+    return result;
+}
+
+static wad_file_t *W_LZ4_OpenFile(char *path)
+{
+    lz4_wad_file_t *result;
+    int f;
+
+    result = W_LZ4_Open(path, &f);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+    d_close(f);
+
+    return &result->wad;
+}
+
+static void W_LZ4_CloseFile(wad_file_t *wad)
+{
+    lz4_wad_file_t *lz4_wad;
+
+    lz4_wad = (lz4_wad_file_t *) wad;
+
+    if (lz4_wad->wad.mapped) {
+        Z_Free(lz4_wad->wad.mapped);
+        lz4_wad->wad.mapped = NULL;
+    }
+    Z_Free(lz4_wad->blocks);
+    Z_Free(lz4_wad);
+}
+
+// Read data from the specified position in the unpacked WAD into the
+// provided buffer.  Returns the number of bytes read.
+
+static size_t W_LZ4_Read(wad_file_t *wad, unsigned int offset,
+                         void *buffer, size_t buffer_len)
+{
+    lz4_wad_file_t *lz4_wad;
+    lz4wad_block_t *block;
+    byte *dest, *scratch;
+    unsigned int end, start, stop;
+    int f, i;
+
+    lz4_wad = (lz4_wad_file_t *) wad;
+
+    if (lz4_wad->wad.mapped) {
+        if (offset >= wad->length)
+            return 0;
+        if (buffer_len > wad->length - offset)
+            buffer_len = wad->length - offset;
+        memcpy(buffer, wad->mapped + offset, buffer_len);
+        return buffer_len;
+    }
+
+    if (offset >= wad->length || buffer_len == 0)
+    {
+        return 0;
+    }
+    end = offset + buffer_len;
+    if (end > wad->length)
+    {
+        end = wad->length;
+    }
+
+    d_open(lz4_wad->path, &f, "r");
+    if (f < 0)
+    {
+        return -1;
+    }
+
+    dest = buffer;
+
+    for (i = W_LZ4_FindBlock(lz4_wad, offset); i < lz4_wad->numblocks; ++i)
+    {
+        block = &lz4_wad->blocks[i];
+
+        if ((unsigned int)block->position >= end)
+        {
+            break;
+        }
+
+        start = block->position;
+        stop = block->position + block->size;
+        if (start < offset)
+            start = offset;
+        if (stop > end)
+            stop = end;
+
+        if (start == block->position && stop == block->position + block->size)
+        {
+            // Whole block: unpack straight into the caller's buffer
+
+            W_LZ4_ReadBlock(lz4_wad, f, block, dest + (start - offset));
+        }
+        else
+        {
+            scratch = Z_Malloc(block->size, PU_STATIC, 0);
+            W_LZ4_ReadBlock(lz4_wad, f, block, scratch);
+            memcpy(dest + (start - offset),
+                   scratch + (start - block->position), stop - start);
+            Z_Free(scratch);
+        }
+    }
+
+    d_close(f);
+
+    return end - offset;
+}
+
+static wad_file_t *W_LZ4_MapFile(char *path)
+{
+    lz4_wad_file_t *result;
+    int f, i;
+
+    result = W_LZ4_Open(path, &f);
+    if (result == NULL)
+    {
+        return NULL;
+    }
+
+    result->wad.mapped = Z_Malloc(result->wad.length, PU_STATIC, 0);
+
+    for (i = 0; i < result->numblocks; ++i)
+    {
+        W_LZ4_ReadBlock(result, f, &result->blocks[i],
+                        result->wad.mapped + result->blocks[i].position);
+    }
+    d_close(f);
+
+    return &result->wad;
+}
+
+static void W_LZ4_Foreach(char *dirpath, void (*handle)(void *))
+{
+    // Directories are scanned by stdc_wad_file; W_OpenFile picks the
+    // class from the file header.
+}
+
+
+wad_file_class_t lz4_wad_file =
+{
+    W_LZ4_OpenFile,
+    W_LZ4_CloseFile,
+    W_LZ4_Read,
+    W_LZ4_MapFile,
+    W_LZ4_Foreach,
+};
+
@@ -170,13 +170,23 @@ size_t W_StdC_Read(wad_file_t *wad, unsigned int offset,
         err = d_seek (f, offset, DSEEK_SET);
         err = err < 0 ? err : d_read(f, buffer, buffer_len);
         d_close(f);
+        if (err > 0) {
+            w_bytesread += err;
+        }
         return err;
     }
 #else
     d_seek (stdc_wad->fstream, offset, DSEEK_SET);
     // Read into the buffer.
 
-    return d_read(stdc_wad->fstream, buffer, buffer_len);
+    {
+        int err = d_read(stdc_wad->fstream, buffer, buffer_len);
+
+        if (err > 0) {
+            w_bytesread += err;
+        }
+        return err;
+    }
 #endif /*W_IO_SHARED*/
 #endif
 }
@@ -207,6 +217,7 @@ static wad_file_t *W_StdC_MapFile(char *path)
     {
         I_Error("Ooops!");
     }
+    w_bytesread += length;
     d_close(f);
     return &result->wad;
 
@@ -504,6 +504,9 @@ static void DoMerge(void)
     Z_Free(lumpinfo);
     lumpinfo = newlumps;
     numlumps = num_newlumps;
+
+    // Lump numbers changed, so the directory must be rebuilt
+    W_FreeHashTable();
 }
 
 // Merge in a file by name
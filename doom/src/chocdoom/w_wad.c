@@ -32,6 +32,7 @@
 #include "d_iwad.h"
 #include "i_swap.h"
 #include "i_system.h"
+#include "i_timer.h"
 #include "i_video.h"
 #include "m_misc.h"
 #include "z_zone.h"
@@ -68,10 +69,18 @@ typedef struct
 
 lumpinfo_t *lumpinfo;		
 unsigned int numlumps = 0;
+unsigned int w_lumpreads = 0;
 
-// Hash table for fast lookups
+// Lump directory: open addressed table of lump numbers keyed on the
+// packed name.  Only the last lump of each name is entered, so the
+// first matching key found by a probe is always the right one.
 
-static lumpinfo_t **lumphash;
+static int *lumphash;
+static unsigned int lumphashmask;
+
+// Bumped every time the directory is freed, to invalidate lumpref_t.
+
+static unsigned int lumphashgen = 1;
 
 // Hash function used for lump names.
 
@@ -91,6 +100,28 @@ unsigned int W_LumpNameHash(const char *s)
     return result;
 }
 
+// Pack a lump name into its directory key.
+
+lumpkey_t W_LumpNameKey(const char *s)
+{
+    lumpkey_t result = 0;
+    unsigned int i;
+
+    for (i=0; i < 8 && s[i] != '\0'; ++i)
+    {
+        result |= (lumpkey_t) toupper((int)(byte)s[i]) << (i * 8);
+    }
+
+    return result;
+}
+
+// First directory slot probed for a key.
+
+static inline unsigned int W_KeySlot(lumpkey_t key)
+{
+    return (unsigned int)((key * 0x9e3779b97f4a7c15ULL) >> 32) & lumphashmask;
+}
+
 // Increase the size of the lumpinfo[] array to the specified size.
 static void ExtendLumpInfo(int newnumlumps)
 {
@@ -116,14 +147,6 @@ static void ExtendLumpInfo(int newnumlumps)
         {
             Z_ChangeUser(newlumpinfo[i].cache, &newlumpinfo[i].cache);
         }
-
-        // We shouldn't be generating a hash table until after all WADs have
-        // been loaded, but just in case...
-        if (lumpinfo[i].next != NULL)
-        {
-            int nextlumpnum = lumpinfo[i].next - lumpinfo;
-            newlumpinfo[i].next = &newlumpinfo[nextlumpnum];
-        }
     }
 
     // All done.
@@ -269,6 +292,7 @@ wad_file_t *W_AddFile (char *filename, wad_file_t *wad_file)
         lump_p->size = LONG(filerover->size);
         lump_p->cache = NULL;
         d_memcpy(lump_p->name, filerover->name, 8);
+        lump_p->key = W_LumpNameKey(lump_p->name);
         W_CountMaps(lump_p, is_pwad);
         ++lump_p;
         ++filerover;
@@ -276,11 +300,7 @@ wad_file_t *W_AddFile (char *filename, wad_file_t *wad_file)
 
     Z_Free(fileinfo);
 
-    if (lumphash != NULL)
-    {
-        Z_Free(lumphash);
-        lumphash = NULL;
-    }
+    W_FreeHashTable();
 
     return wad_file;
 }
@@ -302,40 +322,25 @@ int W_NumLumps (void)
 
 int W_CheckNumForName (char* name)
 {
-    lumpinfo_t *lump_p = NULL;
-    int i = 0;
+    lumpkey_t key;
+    unsigned int slot;
+    int lump;
 
-    // Do we have a hash table yet?
+    // (Re)build the directory if the WAD list changed since last time.
 
-    if (lumphash != NULL)
+    if (lumphash == NULL)
     {
-        int hash;
-        
-        // We do! Excellent.
+        W_GenerateHashTable();
+    }
 
-        hash = W_LumpNameHash(name) % numlumps;
-        
-        for (lump_p = lumphash[hash]; lump_p != NULL; lump_p = lump_p->next)
-        {
-            if (!strncasecmp(lump_p->name, name, 8))
-            {
-                return lump_p - lumpinfo;
-            }
-        }
-    } 
-    else
-    {
-        // We don't have a hash table generate yet. Linear search :-(
-        // 
-        // scan backwards so patch lump files take precedence
+    key = W_LumpNameKey(name);
 
-        for (i=numlumps-1; i >= 0; --i)
+    for (slot = W_KeySlot(key); (lump = lumphash[slot]) >= 0;
+         slot = (slot + 1) & lumphashmask)
+    {
+        if (lumpinfo[lump].key == key)
         {
-            lump_p = &lumpinfo[i];
-            if (!strncasecmp(lump_p->name, name, 8))
-            {
-                return i;
-            }
+            return lump;
         }
     }
 
@@ -344,6 +349,43 @@ int W_CheckNumForName (char* name)
     return -1;
 }
 
+//
+// W_ScanNumForName
+// Linear search of the lump list, as done before the directory
+// existed.  Scans backwards so patch lump files take precedence.
+//
+
+static int W_ScanNumForName (char* name)
+{
+    int i;
+
+    for (i=numlumps-1; i >= 0; --i)
+    {
+        if (!strncasecmp(lumpinfo[i].name, name, 8))
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+//
+// W_CheckNumForRef
+// Like W_CheckNumForName, but only looks the name up again when
+// the directory has been rebuilt since the last call with this ref.
+//
+
+int W_CheckNumForRef (lumpref_t *ref, char *name)
+{
+    if (ref->generation != lumphashgen)
+    {
+        ref->lumpnum = W_CheckNumForName(name);
+        ref->generation = lumphashgen;
+    }
+
+    return ref->lumpnum;
+}
 
 
 
@@ -413,6 +455,41 @@ void W_ReadLump(unsigned int lump, void *dest)
 }
 
 
+//
+// W_ReadLumpPart
+// Reads up to length bytes from offset into the lump, for streaming
+//  a lump without caching all of it.  Returns the bytes read.
+//
+int W_ReadLumpPart(unsigned int lump, int offset, void *dest, int length)
+{
+    lumpinfo_t *l;
+    int c;
+
+    if (lump >= numlumps)
+    {
+	I_Error ("W_ReadLumpPart: %i >= numlumps", lump);
+    }
+
+    l = lumpinfo+lump;
+
+    if (offset >= l->size)
+    {
+	return 0;
+    }
+
+    if (length > l->size - offset)
+    {
+	length = l->size - offset;
+    }
+
+    I_BeginRead ();
+    c = W_Read(l->wad_file, l->position + offset, dest, length);
+    I_EndRead ();
+
+    return c;
+}
+
+
 
 
 //
@@ -461,6 +538,7 @@ void *W_CacheLumpNum(int lumpnum, int tag)
     {
         // Not yet loaded, so load it now
 
+        ++w_lumpreads;
         lump->cache = Z_Malloc(W_LumpLength(lumpnum), tag, &lump->cache);
 	W_ReadLump (lumpnum, lump->cache);
         result = lump->cache;
@@ -479,6 +557,24 @@ void *W_CacheLumpName(char *name, int tag)
     return W_CacheLumpNum(W_GetNumForName(name), tag);
 }
 
+//
+// W_CacheLumpRef
+// W_CacheLumpName for names drawn every frame.
+//
+void *W_CacheLumpRef(lumpref_t *ref, char *name, int tag)
+{
+    int lump;
+
+    lump = W_CheckNumForRef(ref, name);
+
+    if (lump < 0)
+    {
+        I_Error ("W_CacheLumpRef: %s not found!", name);
+    }
+
+    return W_CacheLumpNum(lump, tag);
+}
+
 // 
 // Release a lump back to the cache, so that it can be reused later 
 // without having to read from disk again, or alternatively, discarded
@@ -582,39 +678,196 @@ void W_Profile (void)
 
 #endif
 
-// Generate a hash table for fast lookups
+// Generate the lump directory for fast lookups
 
 void W_GenerateHashTable(void)
 {
     unsigned int i;
+    unsigned int size;
+
+    // Free the old directory, if there is one
+
+    W_FreeHashTable();
+
+    // Keep the table at most half full so probes stay short.
+
+    for (size = 16; size < numlumps * 2; size <<= 1);
+
+    lumphash = Z_Malloc(sizeof(int) * size, PU_STATIC, NULL);
+    memset(lumphash, 0xff, sizeof(int) * size);
+    lumphashmask = size - 1;
+
+    for (i=0; i<numlumps; ++i)
+    {
+        lumpkey_t key = lumpinfo[i].key;
+        unsigned int slot;
+
+        // A later lump replaces an earlier one of the same name, so
+        // patch lump files take precedence.
+
+        for (slot = W_KeySlot(key); lumphash[slot] >= 0;
+             slot = (slot + 1) & lumphashmask)
+        {
+            if (lumpinfo[lumphash[slot]].key == key)
+            {
+                break;
+            }
+        }
+
+        lumphash[slot] = i;
+    }
+
+    // All done!
+}
 
-    // Free the old hash table, if there is one
+// Drop the directory after the lump list changed; the next lookup
+// generates a new one.
 
+void W_FreeHashTable(void)
+{
     if (lumphash != NULL)
     {
         Z_Free(lumphash);
+        lumphash = NULL;
+    }
+
+    ++lumphashgen;
+}
+
+//
+// W_BenchLookups
+// Time every lump name through the old linear scan, the directory
+// and a cached lumpref_t, and check the scan and directory agree.
+//
+
+void W_BenchLookups(int passes)
+{
+    lumpref_t *refs;
+    unsigned int i;
+    int pass;
+    int start;
+    int scantime;
+    int dirtime;
+    int reftime;
+    int check;
+
+    W_GenerateHashTable();
+
+    for (i=0; i<numlumps; ++i)
+    {
+        if (W_ScanNumForName(lumpinfo[i].name)
+         != W_CheckNumForName(lumpinfo[i].name))
+        {
+            I_Error("W_BenchLookups: lump %i resolves differently", i);
+        }
+    }
+
+    refs = Z_Malloc(sizeof(lumpref_t) * numlumps, PU_STATIC, NULL);
+    memset(refs, 0, sizeof(lumpref_t) * numlumps);
+    check = 0;
+
+    start = I_GetTimeMS();
+    for (pass=0; pass<passes; ++pass)
+    {
+        for (i=0; i<numlumps; ++i)
+        {
+            check += W_ScanNumForName(lumpinfo[i].name);
+        }
     }
+    scantime = I_GetTimeMS() - start;
 
-    // Generate hash table
-    if (numlumps > 0)
+    start = I_GetTimeMS();
+    for (pass=0; pass<passes; ++pass)
     {
-        lumphash = Z_Malloc(sizeof(lumpinfo_t *) * numlumps, PU_STATIC, NULL);
-        memset(lumphash, 0, sizeof(lumpinfo_t *) * numlumps);
+        for (i=0; i<numlumps; ++i)
+        {
+            check -= W_CheckNumForName(lumpinfo[i].name);
+        }
+    }
+    dirtime = I_GetTimeMS() - start;
 
+    start = I_GetTimeMS();
+    for (pass=0; pass<passes; ++pass)
+    {
         for (i=0; i<numlumps; ++i)
         {
-            unsigned int hash;
+            check += W_CheckNumForRef(&refs[i], lumpinfo[i].name);
+        }
+    }
+    reftime = I_GetTimeMS() - start;
+
+    Z_Free(refs);
+
+    printf("W_BenchLookups: %u lumps x %i, scan %i ms, "
+           "directory %i ms, cached %i ms (%i)\n",
+           numlumps, passes, scantime, dirtime, reftime, check);
+}
+
+//
+// W_BenchFile
+// Read every lump of a WAD, plain or packed, and print the time taken
+// and the bytes read from the card against the bytes delivered.
+//
+
+void W_BenchFile(char *filename)
+{
+    wad_file_t *wad_file;
+    wadinfo_t header;
+    filelump_t *fileinfo;
+    unsigned int bytesread;
+    unsigned int lumpbytes;
+    int numfilelumps;
+    int length;
+    int start;
+    int size;
+    int i;
+    void *dest;
 
-            hash = W_LumpNameHash(lumpinfo[i].name) % numlumps;
+    bytesread = w_bytesread;
+    start = I_GetTimeMS();
 
-            // Hook into the hash table
+    wad_file = W_OpenFile(filename);
 
-            lumpinfo[i].next = lumphash[hash];
-            lumphash[hash] = &lumpinfo[i];
+    if (wad_file == NULL)
+    {
+        printf("W_BenchFile: can't open %s\n", filename);
+        return;
+    }
+
+    W_Read(wad_file, 0, &header, sizeof(header));
+    numfilelumps = LONG(header.numlumps);
+    length = numfilelumps * sizeof(filelump_t);
+    fileinfo = Z_Malloc(length, PU_STATIC, 0);
+    W_Read(wad_file, LONG(header.infotableofs), fileinfo, length);
+
+    lumpbytes = 0;
+
+    for (i=0; i<numfilelumps; ++i)
+    {
+        size = LONG(fileinfo[i].size);
+
+        if (size <= 0)
+        {
+            continue;
+        }
+
+        dest = Z_Malloc(size, PU_STATIC, 0);
+
+        if (W_Read(wad_file, LONG(fileinfo[i].filepos), dest, size) != size)
+        {
+            I_Error("W_BenchFile: short read of lump %i in %s", i, filename);
         }
+
+        Z_Free(dest);
+        lumpbytes += size;
     }
 
-    // All done!
+    Z_Free(fileinfo);
+    W_CloseFile(wad_file);
+
+    printf("W_BenchFile: %s, %i lumps, %u bytes in %i ms, %u bytes read\n",
+           filename, numfilelumps, lumpbytes, I_GetTimeMS() - start,
+           w_bytesread - bytesread);
 }
 
 // Lump names that are unique to particular game types. This lets us check
@@ -38,6 +38,11 @@
 
 typedef struct lumpinfo_s lumpinfo_t;
 
+// Lump name packed into one integer, upper-cased and zero padded,
+// so that name lookups are a single compare.
+
+typedef uint64_t lumpkey_t;
+
 struct lumpinfo_s
 {
     char	name[8];
@@ -46,11 +51,22 @@ struct lumpinfo_s
     int		size;
     void       *cache;
 
-    // Used for hash table lookups
+    // Used for directory lookups
 
-    lumpinfo_t *next;
+    lumpkey_t	key;
 };
 
+//
+// Lump number cached by callers that look a name up every frame.
+// Zero initialised; resolved again whenever the directory changes.
+//
+
+typedef struct
+{
+    int		lumpnum;
+    unsigned int generation;
+} lumpref_t;
+
 
 extern lumpinfo_t *lumpinfo;
 extern unsigned int numlumps;
@@ -58,16 +74,28 @@ extern unsigned int numlumps;
 wad_file_t *W_AddFile (char *filename, wad_file_t *wad_file);
 int	W_CheckNumForName (char* name);
 int	W_GetNumForName (char* name);
+int	W_CheckNumForRef (lumpref_t *ref, char *name);
 
 int	W_LumpLength (unsigned int lump);
 void    W_ReadLump (unsigned int lump, void *dest);
+int     W_ReadLumpPart (unsigned int lump, int offset, void *dest, int length);
 
 void*	W_CacheLumpNum (int lump, int tag);
 void*	W_CacheLumpName (char* name, int tag);
+void*	W_CacheLumpRef (lumpref_t *ref, char *name, int tag);
 
 void    W_GenerateHashTable(void);
+void    W_FreeHashTable(void);
 
 extern unsigned int W_LumpNameHash(const char *s);
+extern lumpkey_t W_LumpNameKey(const char *s);
+
+void    W_BenchLookups(int passes);
+void    W_BenchFile(char *filename);
+
+// Lumps read from the WAD by W_CacheLumpNum so far.
+
+extern unsigned int w_lumpreads;
 
 void    W_ReleaseLumpNum(int lump);
 void    W_ReleaseLumpName(char *name);
@@ -17,10 +17,18 @@
 //
 
 
+#include <stdarg.h>
+#include <string.h>
+
 #include "z_zone.h"
 #include "i_system.h"
 #include "doomtype.h"
+#include "d_main.h"
+#include "m_argv.h"
+#include "m_misc.h"
 #include "misc_utils.h"
+#include <dev_io.h>
+#include <bsp_cmd.h>
 
 //
 // ZONE MEMORY ALLOCATION
@@ -44,6 +52,10 @@ typedef struct memblock_s
     int			id;	// should be ZONEID
     struct memblock_s*	next;
     struct memblock_s*	prev;
+#ifdef ZONE_CALLSITES
+    char*		file;	// where it was allocated
+    int			line;
+#endif
 } memblock_t;
 
 
@@ -63,6 +75,73 @@ typedef struct
 
 memzone_t*	mainzone;
 
+//
+// FAST ZONE
+// A second, small zone in on-chip RAM for the tables the renderer
+// reads for every pixel.  The linker puts the FASTZONE section in
+// DTCM, except for the F7 SRAM build (application_sram.sct), which
+// has it in SRAM2; the main zone lives in SDRAM.
+//
+#if defined(STM32H747xx)
+#define FASTZONESIZE	(128 * 1024)
+#else
+#define FASTZONESIZE	(16 * 1024)
+#endif
+
+#ifdef __ARMCC_VERSION
+#define FASTZONEATTR	__attribute__((section("FASTZONE"), zero_init))
+#else
+#define FASTZONEATTR
+#endif
+
+static int	fastzonemem[FASTZONESIZE / sizeof(int)] FASTZONEATTR;
+
+memzone_t*	fastzone;
+
+// Placement statistics, see Z_MallocTier
+
+int32_t		zfastallocs;
+int32_t		zfastbytes;
+int32_t		zfastfallbacks;
+
+//
+// HEAP STATISTICS
+// Bytes in use per tag over both zones, headers included, and the
+// most there has been.  Readable from the console; set zdump to 1 to
+// print a summary, or to 2 to write zonedump.txt with every block.
+//
+int32_t		ztagbytes[PU_NUM_TAGS];
+int32_t		ztaghigh[PU_NUM_TAGS];
+int32_t		zpurges;
+int32_t		zpurgebytes;
+int32_t		zdump;
+
+static char*	ztagnames[PU_NUM_TAGS] =
+{
+    NULL, "zstatic", "zsound", "zmusic", NULL,
+    "zlevel", "zlevspec", "zpurgelevel", "zcache"
+};
+
+static char*	ztaghighnames[PU_NUM_TAGS] =
+{
+    NULL, "zstatichigh", "zsoundhigh", "zmusichigh", NULL,
+    "zlevelhigh", "zlevspechigh", "zpurgelevelhigh", "zcachehigh"
+};
+
+// Free block histogram: bucket 0 is under 64 bytes, each next one
+// twice the size, the last one everything from 512 KB up.
+
+#define ZHISTBUCKETS	15
+#define ZDUMPFILE	"zonedump.txt"
+
+static void Z_Account (int tag, int size)
+{
+    ztagbytes[tag] += size;
+
+    if (ztagbytes[tag] > ztaghigh[tag])
+	ztaghigh[tag] = ztagbytes[tag];
+}
+
 
 
 //
@@ -98,6 +177,7 @@ void Z_Init (void)
 {
     memblock_t*	block;
     int		size;
+    int		i;
 
     mainzone = (memzone_t *)I_ZoneBase (&size);
     mainzone->size = size;
@@ -117,6 +197,49 @@ void Z_Init (void)
     block->tag = PU_FREE;
     
     block->size = mainzone->size - sizeof(memzone_t);
+
+    //!
+    // @category obscure
+    //
+    // Keep everything in the main zone, for comparing timings.
+    //
+
+    if (!M_CheckParm ("-nofastzone"))
+    {
+	fastzone = (memzone_t *)fastzonemem;
+	fastzone->size = sizeof(fastzonemem);
+	Z_ClearZone (fastzone);
+    }
+
+    for (i = 0; i < PU_NUM_TAGS; i++)
+    {
+	if (ztagnames[i])
+	{
+	    cmd_register_i32 (&ztagbytes[i], ztagnames[i]);
+	    cmd_register_i32 (&ztaghigh[i], ztaghighnames[i]);
+	}
+    }
+    cmd_register_i32 (&zpurges, "zpurges");
+    cmd_register_i32 (&zpurgebytes, "zpurgebytes");
+    cmd_register_i32 (&zdump, "zdump");
+    cmd_register_i32 (&zfastallocs, "zfastallocs");
+    cmd_register_i32 (&zfastbytes, "zfastbytes");
+    cmd_register_i32 (&zfastfallbacks, "zfastfallbacks");
+}
+
+
+//
+// Z_BlockZone
+// The zone a block was allocated from.
+//
+static memzone_t* Z_BlockZone (memblock_t* block)
+{
+    if (fastzone
+     && (byte *)block > (byte *)fastzone
+     && (byte *)block < (byte *)fastzone + fastzone->size)
+	return fastzone;
+
+    return mainzone;
 }
 
 
@@ -125,6 +248,7 @@ void Z_Init (void)
 //
 void Z_Free (void* ptr)
 {
+    memzone_t*		zone;
     memblock_t*		block;
     memblock_t*		other;
 	
@@ -132,6 +256,14 @@ void Z_Free (void* ptr)
 
     if (block->id != ZONEID)
 	I_Error ("Z_Free: freed a pointer without ZONEID");
+
+    zone = Z_BlockZone (block);
+
+    if (zone == fastzone)
+	zfastbytes -= block->size;
+
+    if (block->tag != PU_FREE)
+	Z_Account (block->tag, -block->size);
 		
     if (block->tag != PU_FREE && block->user != NULL)
     {
@@ -153,8 +285,8 @@ void Z_Free (void* ptr)
         other->next = block->next;
         other->next->prev = other;
 
-        if (block == mainzone->rover)
-            mainzone->rover = other;
+        if (block == zone->rover)
+            zone->rover = other;
 
         block = other;
     }
@@ -167,25 +299,61 @@ void Z_Free (void* ptr)
         block->next = other->next;
         block->next->prev = block;
 
-        if (other == mainzone->rover)
-            mainzone->rover = block;
+        if (other == zone->rover)
+            zone->rover = block;
     }
 }
 
 
 
 //
-// Z_Malloc
-// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+// Z_ZoneFits
+// True if size bytes can be had from the zone, counting purgable
+// blocks.  Lets Z_MallocTier give up on the fast zone without
+// throwing out its cached blocks first.
+//
+static boolean Z_ZoneFits (memzone_t* zone, int size)
+{
+    memblock_t*	block;
+    int		run;
+
+    run = 0;
+
+    for (block = zone->blocklist.next ;
+	 block != &zone->blocklist ;
+	 block = block->next)
+    {
+	if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+	{
+	    run += block->size;
+	    if (run >= size)
+		return true;
+	}
+	else
+	{
+	    run = 0;
+	}
+    }
+
+    return false;
+}
+
+
+//
+// Z_MallocZone
+// Returns NULL if the zone has no room.
 //
 #define MINFRAGMENT		64
 
 
-void*
-Z_Malloc
-( int		size,
+static void*
+Z_MallocZone
+( memzone_t*	zone,
+  int		size,
   int		tag,
-  void*		user )
+  void*		user,
+  char*		file,
+  int		line )
 {
     int		extra;
     memblock_t*	start;
@@ -201,9 +369,13 @@ Z_Malloc
     // account for size of block header
     size += sizeof(memblock_t);
     size = ROUND_UP(size, sizeof(void*));
+
+    if (zone != mainzone && !Z_ZoneFits (zone, size))
+        return NULL;
+
     // if there is a free block behind the rover,
     //  back up over them
-    base = mainzone->rover;
+    base = zone->rover;
     
     if (base->prev->tag == PU_FREE)
         base = base->prev;
@@ -216,7 +388,7 @@ Z_Malloc
         if (rover == start)
         {
             // scanned all the way around the list
-            I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+            return NULL;
         }
 	
         if (rover->tag != PU_FREE)
@@ -231,6 +403,9 @@ Z_Malloc
             {
                 // free the rover block (adding the size to base)
 
+                zpurges++;
+                zpurgebytes += rover->size;
+
                 // the rover can be the base block
                 base = base->prev;
                 Z_Free ((byte *)rover+sizeof(memblock_t));
@@ -270,6 +445,11 @@ Z_Malloc
 
     base->user = user;
     base->tag = tag;
+    Z_Account (tag, base->size);
+#ifdef ZONE_CALLSITES
+    base->file = file;
+    base->line = line;
+#endif
 
     result  = (void *) ((byte *)base + sizeof(memblock_t));
 
@@ -279,7 +459,7 @@ Z_Malloc
     }
 
     // next allocation will start looking here
-    mainzone->rover = base->next;	
+    zone->rover = base->next;	
 	
     base->id = ZONEID;
     
@@ -287,20 +467,90 @@ Z_Malloc
 }
 
 
+//
+// Z_Malloc
+// You can pass a NULL user if the tag is < PU_PURGELEVEL.
+//
+void*
+Z_Malloc2
+( int		size,
+  int		tag,
+  void*		user,
+  char*		file,
+  int		line )
+{
+    void*	result;
+
+    result = Z_MallocZone (mainzone, size, tag, user, file, line);
+
+    if (result == NULL)
+    {
+	// Leave the data needed to size the zone behind
+	Z_WriteDumpFile ();
+
+#ifdef ZONE_CALLSITES
+	I_Error ("%s:%i: Z_Malloc: failed on allocation of %i bytes",
+		 file, line, size);
+#else
+	I_Error ("Z_Malloc: failed on allocation of %i bytes", size);
+#endif
+    }
+
+    return result;
+}
+
+
+//
+// Z_MallocTier
+// Like Z_Malloc, but Z_TIER_FAST asks for the fast zone.  Falls back
+// to the main zone when the fast one is full.
+//
+void*
+Z_MallocTier2
+( int		size,
+  int		tag,
+  void*		user,
+  int		tier,
+  char*		file,
+  int		line )
+{
+    memblock_t*	block;
+    void*	result;
+
+    if (tier == Z_TIER_FAST && fastzone)
+    {
+	result = Z_MallocZone (fastzone, size, tag, user, file, line);
+
+	if (result)
+	{
+	    block = (memblock_t *) ((byte *)result - sizeof(memblock_t));
+	    zfastallocs++;
+	    zfastbytes += block->size;
+	    return result;
+	}
+
+	zfastfallbacks++;
+    }
+
+    return Z_Malloc2 (size, tag, user, file, line);
+}
+
+
 
 //
 // Z_FreeTags
 //
-void
-Z_FreeTags
-( int		lowtag,
+static void
+Z_FreeZoneTags
+( memzone_t*	zone,
+  int		lowtag,
   int		hightag )
 {
     memblock_t*	block;
     memblock_t*	next;
 	
-    for (block = mainzone->blocklist.next ;
-	 block != &mainzone->blocklist ;
+    for (block = zone->blocklist.next ;
+	 block != &zone->blocklist ;
 	 block = next)
     {
 	// get link before freeing
@@ -315,37 +565,281 @@ Z_FreeTags
     }
 }
 
+void
+Z_FreeTags
+( int		lowtag,
+  int		hightag )
+{
+    Z_FreeZoneTags (mainzone, lowtag, hightag);
+
+    if (fastzone)
+	Z_FreeZoneTags (fastzone, lowtag, hightag);
+}
+
 
 
 //
-// Z_DumpHeap
-// Note: TFileDumpHeap( stdout ) ?
+// Z_Printf
+// Prints to the console if f < 0, else writes to file f.
 //
-void
-Z_DumpHeap
-( int		lowtag,
+static void Z_Printf (int f, char *s, ...)
+{
+    char	buf[160];
+    va_list	args;
+    int		len;
+
+    va_start (args, s);
+    len = M_vsnprintf (buf, sizeof(buf), s, args);
+    va_end (args);
+
+    if (f < 0)
+	printf ("%s", buf);
+    else
+	d_write (f, buf, len);
+}
+
+
+//
+// Z_DumpZone
+// Free space, fragmentation and the blocks tagged lowtag to hightag.
+//
+static void
+Z_DumpZone
+( int		f,
+  memzone_t*	zone,
+  char*		name,
+  int		lowtag,
   int		hightag )
 {
     memblock_t*	block;
-	
-    for (block = mainzone->blocklist.next ; ; block = block->next)
+    int		hist[ZHISTBUCKETS];
+    int		histbytes[ZHISTBUCKETS];
+    int		numblocks, numfree, freebytes;
+    int		largestfree, run, largestrun;
+    int		i, size;
+
+    memset (hist, 0, sizeof(hist));
+    memset (histbytes, 0, sizeof(histbytes));
+    numblocks = numfree = freebytes = 0;
+    largestfree = run = largestrun = 0;
+
+    for (block = zone->blocklist.next ;
+	 block != &zone->blocklist ;
+	 block = block->next)
     {
-		
-	if (block->next == &mainzone->blocklist)
+	numblocks++;
+
+	if (block->tag >= lowtag && block->tag <= hightag)
 	{
-	    // all blocks have been hit
-	    break;
+#ifdef ZONE_CALLSITES
+	    Z_Printf (f, "  %p %8i tag %i user %p %s:%i\n",
+		      block, block->size, block->tag, block->user,
+		      block->file ? block->file : "?", block->line);
+#else
+	    Z_Printf (f, "  %p %8i tag %i user %p\n",
+		      block, block->size, block->tag, block->user);
+#endif
+	}
+
+	// what Z_Malloc could get here, purging on the way
+
+	if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+	{
+	    run += block->size;
+	    if (run > largestrun)
+		largestrun = run;
+	}
+	else
+	{
+	    run = 0;
+	}
+
+	if (block->tag != PU_FREE)
+	    continue;
+
+	numfree++;
+	freebytes += block->size;
+	if (block->size > largestfree)
+	    largestfree = block->size;
+
+	for (i = 0, size = block->size >> 6;
+	     size && i < ZHISTBUCKETS - 1;
+	     i++, size >>= 1);
+
+	hist[i]++;
+	histbytes[i] += block->size;
+    }
+
+    Z_Printf (f, "%s zone: %i bytes, %i blocks, %i free in %i blocks\n",
+	      name, zone->size, numblocks, freebytes, numfree);
+    Z_Printf (f, "  largest free block %i, largest free+purgable run %i\n",
+	      largestfree, largestrun);
+
+    for (i = 0; i < ZHISTBUCKETS; i++)
+    {
+	if (hist[i])
+	{
+	    Z_Printf (f, "  free %s%8i: %6i blocks %9i bytes\n",
+		      i == ZHISTBUCKETS - 1 ? ">=" : "< ",
+		      i == ZHISTBUCKETS - 1 ? 32 << i : 64 << i,
+		      hist[i], histbytes[i]);
 	}
     }
 }
 
 
+#ifdef ZONE_CALLSITES
+
+#define ZMAXSITES	128
+
+//
+// Z_DumpSites
+// Bytes held per allocation call site, over both zones.
+//
+static void Z_DumpSiteZone (memzone_t* zone, char** files, int* lines,
+			    int* bytes, int* numsites)
+{
+    memblock_t*	block;
+    int		i;
+
+    for (block = zone->blocklist.next ;
+	 block != &zone->blocklist ;
+	 block = block->next)
+    {
+	if (block->tag == PU_FREE)
+	    continue;
+
+	for (i = 0; i < *numsites; i++)
+	{
+	    if (files[i] == block->file && lines[i] == block->line)
+		break;
+	}
+
+	if (i == *numsites)
+	{
+	    if (*numsites == ZMAXSITES)
+		continue;
+	    files[i] = block->file;
+	    lines[i] = block->line;
+	    bytes[i] = 0;
+	    (*numsites)++;
+	}
+
+	bytes[i] += block->size;
+    }
+}
+
+static void Z_DumpSites (int f)
+{
+    static char*	files[ZMAXSITES];
+    static int		lines[ZMAXSITES];
+    static int		bytes[ZMAXSITES];
+    int			numsites;
+    int			i;
+
+    numsites = 0;
+    Z_DumpSiteZone (mainzone, files, lines, bytes, &numsites);
+    if (fastzone)
+	Z_DumpSiteZone (fastzone, files, lines, bytes, &numsites);
+
+    Z_Printf (f, "call sites:\n");
+
+    for (i = 0; i < numsites; i++)
+    {
+	Z_Printf (f, "  %9i %s:%i\n", bytes[i],
+		  files[i] ? files[i] : "?", lines[i]);
+    }
+}
+
+#endif
+
+
+//
+// Z_DumpHeap
+// Per-tag totals and both zones, listing the blocks tagged lowtag
+// to hightag.
+//
+static void Z_Dump (int f, int lowtag, int hightag)
+{
+    int		i;
+
+    Z_Printf (f, "tag           bytes       high\n");
+
+    for (i = 0; i < PU_NUM_TAGS; i++)
+    {
+	if (ztagnames[i])
+	{
+	    Z_Printf (f, "%-12s %9i %9i\n",
+		      ztagnames[i] + 1, ztagbytes[i], ztaghigh[i]);
+	}
+    }
+
+    Z_Printf (f, "purged %i blocks, %i bytes\n", zpurges, zpurgebytes);
+
+    Z_DumpZone (f, mainzone, "main", lowtag, hightag);
+    if (fastzone)
+	Z_DumpZone (f, fastzone, "fast", lowtag, hightag);
+
+#ifdef ZONE_CALLSITES
+    Z_DumpSites (f);
+#endif
+}
+
+void
+Z_DumpHeap
+( int		lowtag,
+  int		hightag )
+{
+    Z_Dump (-1, lowtag, hightag);
+}
+
+
 //
 // Z_FileDumpHeap
 //
 void Z_FileDumpHeap (int f)
 {
+    Z_Dump (f, PU_STATIC, PU_NUM_TAGS);
+}
+
+
+//
+// Z_WriteDumpFile
+// Z_FileDumpHeap into zonedump.txt next to the WADs.
+//
+void Z_WriteDumpFile (void)
+{
+    char	path[D_MAX_PATH];
+    int		f;
+
+    DD_GETPATH (path, ZDUMPFILE);
+
+    d_open (path, &f, "+w");
+    if (f < 0)
+    {
+	printf ("Z_WriteDumpFile: can't create %s\n", path);
+	return;
+    }
+
+    Z_FileDumpHeap (f);
+    d_close (f);
+
+    printf ("Z_WriteDumpFile: wrote %s\n", path);
+}
+
+
+//
+// Z_PollDump
+// Once per frame: acts on zdump set from the console.
+//
+void Z_PollDump (void)
+{
+    if (zdump == 1)
+	Z_DumpHeap (PU_NUM_TAGS, 0);
+    else if (zdump)
+	Z_WriteDumpFile ();
 
+    zdump = 0;
 }
 
 
@@ -353,13 +847,13 @@ void Z_FileDumpHeap (int f)
 //
 // Z_CheckHeap
 //
-void Z_CheckHeap (void)
+static void Z_CheckZone (memzone_t* zone)
 {
     memblock_t*	block;
 	
-    for (block = mainzone->blocklist.next ; ; block = block->next)
+    for (block = zone->blocklist.next ; ; block = block->next)
     {
-	if (block->next == &mainzone->blocklist)
+	if (block->next == &zone->blocklist)
 	{
 	    // all blocks have been hit
 	    break;
@@ -376,6 +870,14 @@ void Z_CheckHeap (void)
     }
 }
 
+void Z_CheckHeap (void)
+{
+    Z_CheckZone (mainzone);
+
+    if (fastzone)
+	Z_CheckZone (fastzone);
+}
+
 
 
 
@@ -396,6 +898,8 @@ void Z_ChangeTag2(void *ptr, int tag, char *file, int line)
         I_Error("%s:%i: Z_ChangeTag: an owner is required "
                 "for purgable blocks", file, line);
 
+    Z_Account(block->tag, -block->size);
+    Z_Account(tag, block->size);
     block->tag = tag;
 }
 
@@ -437,6 +941,29 @@ int Z_FreeMemory (void)
     return free;
 }
 
+//
+// Z_FreeStats
+// Free and purgable bytes as Z_FreeMemory counts them, and the
+// largest block that is free without purging anything.
+//
+void Z_FreeStats (int *freebytes, int *largest)
+{
+    memblock_t*		block;
+
+    *freebytes = 0;
+    *largest = 0;
+
+    for (block = mainzone->blocklist.next ;
+         block != &mainzone->blocklist;
+         block = block->next)
+    {
+        if (block->tag == PU_FREE || block->tag >= PU_PURGELEVEL)
+            *freebytes += block->size;
+        if (block->tag == PU_FREE && block->size > *largest)
+            *largest = block->size;
+    }
+}
+
 unsigned int Z_ZoneSize(void)
 {
     return mainzone->size;
@@ -26,6 +26,10 @@
 
 #include <stdio.h>
 
+// Define to record the file and line of every allocation, listed by
+// Z_DumpHeap and Z_FileDumpHeap.  Costs 8 bytes per block.
+//#define ZONE_CALLSITES
+
 //
 // ZONE MEMORY
 // PU - purge tags.
@@ -48,18 +52,33 @@ enum
 
     PU_NUM_TAGS
 };
+
+//
+// Memory tiers for Z_MallocTier.
+//
+
+enum
+{
+    Z_TIER_BULK,                    // the main zone, in SDRAM
+    Z_TIER_FAST,                    // on-chip RAM, if there is room
+};
         
 
 void	Z_Init (void);
-void*	Z_Malloc (int size, int tag, void *ptr);
+void*	Z_Malloc2 (int size, int tag, void *ptr, char *file, int line);
+void*	Z_MallocTier2 (int size, int tag, void *ptr, int tier,
+		       char *file, int line);
 void    Z_Free (void *ptr);
 void    Z_FreeTags (int lowtag, int hightag);
 void    Z_DumpHeap (int lowtag, int hightag);
 void    Z_FileDumpHeap (int f);
+void    Z_WriteDumpFile (void);
+void    Z_PollDump (void);
 void    Z_CheckHeap (void);
 void    Z_ChangeTag2 (void *ptr, int tag, char *file, int line);
 void    Z_ChangeUser(void *ptr, void **user);
 int     Z_FreeMemory (void);
+void    Z_FreeStats (int *freebytes, int *largest);
 unsigned int Z_ZoneSize(void);
 
 //
@@ -69,5 +88,15 @@ unsigned int Z_ZoneSize(void);
 #define Z_ChangeTag(p,t)                                       \
     Z_ChangeTag2((p), (t), __FILE__, __LINE__)
 
+#ifdef ZONE_CALLSITES
+#define Z_Malloc(s,t,p)                                        \
+    Z_Malloc2((s), (t), (p), __FILE__, __LINE__)
+#define Z_MallocTier(s,t,p,r)                                  \
+    Z_MallocTier2((s), (t), (p), (r), __FILE__, __LINE__)
+#else
+#define Z_Malloc(s,t,p)         Z_Malloc2((s), (t), (p), NULL, 0)
+#define Z_MallocTier(s,t,p,r)   Z_MallocTier2((s), (t), (p), (r), NULL, 0)
+#endif
+
 
 #endif
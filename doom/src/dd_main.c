@@ -37,12 +37,38 @@
 #define DD_CDTRACK_PATH(path, name) \
     DD_GETPATH(path, "music/", game_subdir_ext, "/", name, ".wav")
 
+/*
+ * Lump animations are converted at load into one delta stream: every
+ * frame is stored as the spans of each row that differ from the frame
+ * before it. Per row: a span count, then per span the pixels skipped
+ * since the last span, a length with DD_ANIM_CLEAR set for a run that
+ * turns transparent, and the pixels of an opaque run.
+ */
+#define DD_ANIM_MAXSTREAM (512 * 1024)
+#define DD_ANIM_MAXWIDTH 255
+#define DD_ANIM_MAXRUN 127
+#define DD_ANIM_CLEAR 0x80
+/* Longest gap counted as playing time, so the animation
+   holds its place while the demo screen is not shown */
+#define DD_ANIM_MAXSTEP 250
+
 typedef struct {
     int start;
     int end;
     int frame;
     uint32_t delay;
     uint32_t tsf;
+    uint32_t clock;
+    /* converted frames, NULL to draw the lumps */
+    byte *stream;
+    int pos;
+    int decoded;
+    pix_t *canvas;
+    byte *mask;
+    int width;
+    int height;
+    int xoff;
+    int yoff;
 } dd_animation_t;
 
 extern gamestate_t gamestate;
@@ -68,12 +94,18 @@ static const char *__DD_GetDecorSubdir (void);
 static void __DD_LoadAnimation (dd_animation_t *anim, char *start, char *end, int delay);
 static void __DD_TickleAnimation (dd_animation_t *anim);
 static void __DD_DrawAnimationTile (dd_animation_t *anim);
+static void __DD_BuildAnimation (dd_animation_t *anim);
 static void __DD_UpdateNoBlitPSX (void);
 static void __DD_LoadAltPkgPSX (void);
 static const TRACKLIST *__DD_SetupSoundtrackListDefault (int *cnt);
 static const TRACKLIST *__DD_SetupSoundtrackList (int f, int *cnt);
 static gameaction_t alt_gameaction = ga_nothing;
-static dd_animation_t fire_anim = {-1, -1, -1, 0, 0};
+static dd_animation_t fire_anim = {
+    .start = -1,
+    .end = -1,
+    .frame = -1,
+    .stream = NULL,
+};
 
 /*---------------------------------------------------------------------*
  *  public functions                                                   *
@@ -205,8 +237,10 @@ static const char *__DD_GetDecorSubdir (void)
 
 static void __DD_UpdateNoBlitPSX (void)
 {
+    static lumpref_t loadingref;
+
     if (alt_gameaction == ga_cachelevel) {
-        patch_t *ld = W_CacheLumpName("LOADING", PU_CACHE);
+        patch_t *ld = W_CacheLumpRef(&loadingref, "LOADING", PU_CACHE);
         V_DrawPatchC(ld, 0);
     }
     if (gamestate == GS_DEMOSCREEN) {
@@ -221,6 +255,232 @@ static void __DD_LoadAnimation (dd_animation_t *anim, char *start, char *end, in
     anim->end = W_CheckNumForName(end);
     anim->frame = anim->start;
     anim->delay = delay;
+    anim->clock = 0;
+    anim->tsf = 0;
+
+    if (anim->start >= 0 && anim->end >= anim->start) {
+        __DD_BuildAnimation(anim);
+    }
+}
+
+static void __DD_DecodeAnimationPatch (dd_animation_t *anim, patch_t *patch, pix_t *pix, byte *mask)
+{
+    column_t *column;
+    byte *source;
+    int col, row, count;
+
+    memset(mask, 0, anim->width * anim->height);
+
+    for (col = 0; col < anim->width; col++) {
+        column = (column_t *)((byte *)patch + READ_LE_U32_P(patch->columnofs + col));
+
+        while (column->topdelta != 0xff) {
+            source = (byte *)column + 3;
+            row = column->topdelta;
+            count = column->length;
+
+            for (; count > 0 && row < anim->height; count--, row++) {
+                pix[row * anim->width + col] = pixel(*source++);
+                mask[row * anim->width + col] = 1;
+            }
+            column = (column_t *)((byte *)column + column->length + 4);
+        }
+    }
+}
+
+/* Writes the spans of one row that differ from the canvas and takes
+   them over into it, returns the number of bytes written */
+static int __DD_EncodeAnimationRow (dd_animation_t *anim, int row, pix_t *pix, byte *mask, byte *out)
+{
+    pix_t *cpix = anim->canvas + row * anim->width;
+    byte *cmask = anim->mask + row * anim->width;
+    byte *p = out + 1;
+    int x = 0, last = 0, len, spans = 0;
+    byte clear;
+
+    pix += row * anim->width;
+    mask += row * anim->width;
+
+    while (x < anim->width) {
+        if (mask[x] == cmask[x] && (!mask[x] || pix[x] == cpix[x])) {
+            x++;
+            continue;
+        }
+        clear = mask[x] ? 0 : DD_ANIM_CLEAR;
+        len = 0;
+        while (x + len < anim->width && len < DD_ANIM_MAXRUN &&
+               (mask[x + len] ? 0 : DD_ANIM_CLEAR) == clear &&
+               (mask[x + len] != cmask[x + len] ||
+               (mask[x + len] && pix[x + len] != cpix[x + len]))) {
+            len++;
+        }
+        *p++ = x - last;
+        *p++ = len | clear;
+        if (!clear) {
+            memcpy(p, pix + x, len * sizeof(pix_t));
+            p += len * sizeof(pix_t);
+        }
+        memcpy(cpix + x, pix + x, len * sizeof(pix_t));
+        memcpy(cmask + x, mask + x, len);
+        x += len;
+        last = x;
+        spans++;
+    }
+    out[0] = spans;
+    return p - out;
+}
+
+static void __DD_ResetAnimation (dd_animation_t *anim)
+{
+    memset(anim->mask, 0, anim->width * anim->height);
+    anim->pos = 0;
+    anim->decoded = 0;
+}
+
+static void __DD_FreeAnimation (dd_animation_t *anim)
+{
+    if (anim->stream) {
+        Z_Free(anim->stream);
+    }
+    if (anim->canvas) {
+        Z_Free(anim->canvas);
+    }
+    anim->stream = NULL;
+    anim->canvas = NULL;
+    anim->mask = NULL;
+}
+
+/* Converts the lumps start..end into the delta stream. The animation
+   keeps drawing the lumps if they differ in size, are too wide, or do
+   not fit into DD_ANIM_MAXSTREAM */
+static void __DD_BuildAnimation (dd_animation_t *anim)
+{
+    patch_t *patch;
+    pix_t *pix;
+    byte *mask, *stream;
+    int lump, row, size = 0, lumpbytes = 0, rowmax, w, h;
+
+    patch = W_CacheLumpNum(anim->start, PU_CACHE);
+    w = READ_LE_U16(patch->width);
+    h = READ_LE_U16(patch->height);
+    anim->xoff = READ_LE_I16(patch->leftoffset);
+    anim->yoff = READ_LE_I16(patch->topoffset);
+
+    if (w <= 0 || w > DD_ANIM_MAXWIDTH || h <= 0 || h > SCREENHEIGHT ||
+        Z_FreeMemory() < 2 * DD_ANIM_MAXSTREAM) {
+        return;
+    }
+    anim->width = w;
+    anim->height = h;
+
+    /* canvas and mask, then the frame being converted */
+    anim->canvas = (pix_t *)Z_Malloc(2 * w * h * (sizeof(pix_t) + 1), PU_STATIC, NULL);
+    anim->mask = (byte *)(anim->canvas + w * h);
+    pix = (pix_t *)(anim->mask + w * h);
+    mask = (byte *)(pix + w * h);
+
+    stream = (byte *)Z_Malloc(DD_ANIM_MAXSTREAM, PU_STATIC, NULL);
+    /* a row can at worst alternate one pixel changed, one not */
+    rowmax = 1 + w * (2 + sizeof(pix_t));
+    __DD_ResetAnimation(anim);
+
+    for (lump = anim->start; lump <= anim->end; lump++) {
+        patch = W_CacheLumpNum(lump, PU_CACHE);
+
+        if (READ_LE_U16(patch->width) != w || READ_LE_U16(patch->height) != h ||
+            READ_LE_I16(patch->leftoffset) != anim->xoff ||
+            READ_LE_I16(patch->topoffset) != anim->yoff ||
+            size + h * rowmax > DD_ANIM_MAXSTREAM) {
+            W_ReleaseLumpNum(lump);
+            Z_Free(stream);
+            __DD_FreeAnimation(anim);
+            dprintf("%s() : drawing lumps\n", __func__);
+            return;
+        }
+        __DD_DecodeAnimationPatch(anim, patch, pix, mask);
+        lumpbytes += W_LumpLength(lump);
+        W_ReleaseLumpNum(lump);
+
+        for (row = 0; row < h; row++) {
+            size += __DD_EncodeAnimationRow(anim, row, pix, mask, stream + size);
+        }
+    }
+
+    anim->stream = (byte *)Z_Malloc(size, PU_STATIC, NULL);
+    memcpy(anim->stream, stream, size);
+    Z_Free(stream);
+    __DD_ResetAnimation(anim);
+
+    dprintf("%s() : %d frames, %d bytes of %d in lumps\n", __func__,
+            anim->end - anim->start + 1, size, lumpbytes);
+}
+
+/* Applies the deltas up to the current frame */
+static void __DD_DecodeAnimation (dd_animation_t *anim)
+{
+    byte *p = anim->stream + anim->pos;
+    pix_t *cpix;
+    byte *cmask;
+    int row, spans, len, x;
+
+    for (; anim->decoded <= anim->frame - anim->start; anim->decoded++) {
+        for (row = 0; row < anim->height; row++) {
+            cpix = anim->canvas + row * anim->width;
+            cmask = anim->mask + row * anim->width;
+            x = 0;
+            for (spans = *p++; spans; spans--) {
+                x += *p++;
+                len = *p & DD_ANIM_MAXRUN;
+                if (*p++ & DD_ANIM_CLEAR) {
+                    memset(cmask + x, 0, len);
+                } else {
+                    memcpy(cpix + x, p, len * sizeof(pix_t));
+                    memset(cmask + x, 1, len);
+                    p += len * sizeof(pix_t);
+                }
+                x += len;
+            }
+        }
+    }
+    anim->pos = p - anim->stream;
+}
+
+/* Copies the canvas to the screen a row of opaque runs at a time,
+   0 if the tiles do not fit across the screen */
+static int __DD_BlitAnimation (dd_animation_t *anim)
+{
+    pix_t *src, *dest;
+    byte *mask;
+    int x, y, row, run, len, tiles, i;
+
+    tiles = SCREENWIDTH / anim->width;
+    x = -anim->xoff;
+    y = SCREENHEIGHT - anim->height - anim->yoff;
+
+    if (x < 0 || x + tiles * anim->width > SCREENWIDTH) {
+        return 0;
+    }
+
+    for (row = 0; row < anim->height; row++) {
+        if (y + row < 0 || y + row >= SCREENHEIGHT) {
+            continue;
+        }
+        src = anim->canvas + row * anim->width;
+        mask = anim->mask + row * anim->width;
+        dest = I_VideoBuffer + (y + row) * SCREENWIDTH + x;
+
+        for (run = 0; run < anim->width; run += len) {
+            for (len = 0; run + len < anim->width && mask[run + len] == mask[run]; len++);
+            if (!mask[run]) {
+                continue;
+            }
+            for (i = 0; i < tiles; i++) {
+                memcpy(dest + i * anim->width + run, src + run, len * sizeof(pix_t));
+            }
+        }
+    }
+    V_MarkRect(x, y, tiles * anim->width, anim->height);
+    return 1;
 }
 
 static void __DD_DrawAnimationTile (dd_animation_t *anim)
@@ -229,6 +489,15 @@ static void __DD_DrawAnimationTile (dd_animation_t *anim)
     if (anim->frame > anim->end)
         return;
 
+    if (anim->stream) {
+        __DD_DecodeAnimation(anim);
+        if (__DD_BlitAnimation(anim)) {
+            return;
+        }
+        /* the placement never changes, so stay with the lumps */
+        __DD_FreeAnimation(anim);
+    }
+
     patch_t *patch = W_CacheLumpNum(anim->frame, PU_CACHE);
 
     x = 0;
@@ -243,15 +512,23 @@ static void __DD_DrawAnimationTile (dd_animation_t *anim)
     }
 }
 
+/* The frame follows the time spent on the demo screen, however
+   long the previous frame took to draw */
 static void __DD_TickleAnimation (dd_animation_t *anim)
 {
+    uint32_t now, step;
+
     if (anim->frame > anim->end) {
         return;
     }
-    if (anim->tsf + anim->delay < d_time()) {
-        anim->tsf = d_time();
-        anim->frame++;
+    now = d_time();
+    step = now - anim->tsf;
+    if (anim->tsf == 0 || step > DD_ANIM_MAXSTEP) {
+        step = 0;
     }
+    anim->tsf = now;
+    anim->clock += step;
+    anim->frame = anim->start + anim->clock / anim->delay;
 }
 
 static void __DD_LoadAltPkgPSX (void)
@@ -271,7 +271,8 @@ int			spanstop[SCREENHEIGHT];
 lighttable_t**		planezlight;
 fixed_t			planeheight;
 
-fixed_t			yslope[SCREENHEIGHT];
+fixed_t*		yslope = yslopetab + MAXLOOKROWS;
+fixed_t			yslopetab[YSLOPETABSIZE];
 fixed_t			distscale[SCREENWIDTH];
 fixed_t			basexscale;
 fixed_t			baseyscale;
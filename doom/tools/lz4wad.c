@@ -0,0 +1,445 @@
+//
+// Copyright(C) 1993-1996 Id Software, Inc.
+// Copyright(C) 2005-2014 Simon Howard
+//
+// This program is free software; you can redistribute it and/or
+// modify it under the terms of the GNU General Public License
+// as published by the Free Software Foundation; either version 2
+// of the License, or (at your option) any later version.
+//
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License for more details.
+//
+// DESCRIPTION:
+//	Host tool: packs an IWAD/PWAD into the LZ4 container read by
+//	w_file_lz4.c.  Build with any C compiler:
+//
+//	    cc -O2 -o lz4wad lz4wad.c
+//	    lz4wad doom2.wad doom2.lzw
+//
+//	The packed file can be used anywhere a WAD is expected.
+//
+//	Layout (all little endian):
+//	    header   "LZWD", numblocks, indexofs, unpacked length
+//	    data     packed or stored blocks
+//	    index    numblocks x { position, size, zposition, zsize,
+//	                           lzsize }
+//
+//	Blocks cover the unpacked WAD without holes, one per lump, plus
+//	the header, the directory and any gaps.  The packed data of a
+//	block is an LZ4 stream of lzsize bytes followed by the rest of
+//	the block stored raw.
+//
+//	The engine reads the packed data into the end of the lump buffer
+//	and decodes it in place, so the stream is cut where the bytes it
+//	saved peak: up to there the output can never overtake the unread
+//	input, and the raw tail is already in its final place.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef unsigned char byte;
+
+#define HASHBITS	12
+#define MINMATCH	4
+#define LASTLITERALS	5
+#define MFLIMIT		12
+#define MAXOFFSET	65535
+
+typedef struct
+{
+    int		position;
+    int		size;
+    int		zposition;
+    int		zsize;
+    int		lzsize;
+} block_t;
+
+static int ReadLong(const byte *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | (p[3] << 24);
+}
+
+static void WriteLong(byte *p, int v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static byte *WriteLength(byte *op, int len)
+{
+    while (len >= 255)
+    {
+        *op++ = 255;
+        len -= 255;
+    }
+    *op++ = len;
+    return op;
+}
+
+//
+// Encode
+// Greedy LZ4 block compressor.  dst must hold len + len/255 + 16
+// bytes.  Returns the length of the stream up to the sequence where
+// it saved the most, and the bytes that prefix unpacks to in
+// *outlen.  Returns 0 if nothing was saved.
+//
+static int Encode(const byte *src, int len, byte *dst, int *outlen)
+{
+    static int hash[1 << HASHBITS];
+    const byte *ip = src;
+    const byte *anchor = src;
+    int mflimit = len - MFLIMIT;
+    int matchlimit = len - LASTLITERALS;
+    byte *op = dst;
+    byte *token;
+    unsigned int seq, h;
+    int ref, litlen, mlen;
+    int cut, best;
+
+    memset(hash, 0xff, sizeof(hash));
+    cut = 0;
+    best = 0;
+    *outlen = 0;
+
+    while (ip - src < mflimit)
+    {
+        seq = ip[0] | (ip[1] << 8) | (ip[2] << 16) | ((unsigned int)ip[3] << 24);
+        h = (seq * 2654435761u) >> (32 - HASHBITS);
+        ref = hash[h];
+        hash[h] = ip - src;
+
+        if (ref < 0 || (ip - src) - ref > MAXOFFSET
+         || memcmp(src + ref, ip, MINMATCH))
+        {
+            ++ip;
+            continue;
+        }
+
+        mlen = MINMATCH;
+        while ((ip - src) + mlen < matchlimit && src[ref + mlen] == ip[mlen])
+        {
+            ++mlen;
+        }
+
+        litlen = ip - anchor;
+        token = op++;
+        *token = (litlen >= 15 ? 15 : litlen) << 4;
+        if (litlen >= 15)
+        {
+            op = WriteLength(op, litlen - 15);
+        }
+        memcpy(op, anchor, litlen);
+        op += litlen;
+
+        *op++ = ((ip - src) - ref) & 0xff;
+        *op++ = ((ip - src) - ref) >> 8;
+
+        *token |= (mlen - MINMATCH >= 15 ? 15 : mlen - MINMATCH);
+        if (mlen - MINMATCH >= 15)
+        {
+            op = WriteLength(op, mlen - MINMATCH - 15);
+        }
+
+        ip += mlen;
+        anchor = ip;
+
+        if ((ip - src) - (op - dst) > best)
+        {
+            best = (ip - src) - (op - dst);
+            cut = op - dst;
+            *outlen = ip - src;
+        }
+    }
+
+    // last literals
+
+    litlen = src + len - anchor;
+    token = op++;
+    *token = (litlen >= 15 ? 15 : litlen) << 4;
+    if (litlen >= 15)
+    {
+        op = WriteLength(op, litlen - 15);
+    }
+    memcpy(op, anchor, litlen);
+    op += litlen;
+
+    if (len - (op - dst) > best)
+    {
+        cut = op - dst;
+        *outlen = len;
+    }
+
+    return cut;
+}
+
+//
+// Decode
+// Same decoder as LZ4_Decode in w_file_lz4.c.
+//
+static int Decode(const byte *src, int srclen, byte *dst, int dstlen)
+{
+    const byte *ip = src;
+    const byte *iend = src + srclen;
+    byte *op = dst;
+    byte *oend = dst + dstlen;
+    const byte *match;
+    unsigned int token, len, b;
+
+    while (ip < iend)
+    {
+        token = *ip++;
+
+        len = token >> 4;
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        if (len > (unsigned int)(iend - ip) || len > (unsigned int)(oend - op))
+            return -1;
+        memmove(op, ip, len);
+        op += len;
+        ip += len;
+
+        if (ip >= iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        match = op - (ip[0] | (ip[1] << 8));
+        ip += 2;
+        if (match < dst || match == op)
+            return -1;
+
+        len = token & 15;
+        if (len == 15)
+        {
+            do
+            {
+                if (ip >= iend)
+                    return -1;
+                b = *ip++;
+                len += b;
+            } while (b == 255);
+        }
+        len += 4;
+        if (len > (unsigned int)(oend - op))
+            return -1;
+
+        while (len--)
+            *op++ = *match++;
+    }
+
+    return op - dst;
+}
+
+static int CompareBlocks(const void *a, const void *b)
+{
+    const block_t *ba = a, *bb = b;
+
+    if (ba->position != bb->position)
+        return ba->position < bb->position ? -1 : 1;
+    return bb->size - ba->size;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *f;
+    byte *wad, *packed, *trial;
+    block_t *ranges, *blocks;
+    int length, numlumps, infotableofs;
+    int numranges, numblocks, i, pos, end;
+    int zpos, zsize, lzsize, lzout, numpacked;
+    byte header[20];
+
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s <in.wad> <out.lzw>\n", argv[0]);
+        return 1;
+    }
+
+    f = fopen(argv[1], "rb");
+    if (f == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    wad = malloc(length);
+    if (fread(wad, 1, length, f) != (size_t)length)
+    {
+        fprintf(stderr, "%s: read error\n", argv[1]);
+        return 1;
+    }
+    fclose(f);
+
+    if (length < 12 || (memcmp(wad, "IWAD", 4) && memcmp(wad, "PWAD", 4)))
+    {
+        fprintf(stderr, "%s: not a WAD file\n", argv[1]);
+        return 1;
+    }
+
+    numlumps = ReadLong(wad + 4);
+    infotableofs = ReadLong(wad + 8);
+    if (numlumps < 0 || infotableofs < 12
+     || infotableofs + numlumps * 16 > length)
+    {
+        fprintf(stderr, "%s: bad directory\n", argv[1]);
+        return 1;
+    }
+
+    // Collect the header, directory and lump ranges
+
+    ranges = malloc(sizeof(block_t) * (numlumps + 2));
+    numranges = 0;
+
+    ranges[numranges].position = 0;
+    ranges[numranges++].size = 12;
+    if (numlumps > 0)
+    {
+        ranges[numranges].position = infotableofs;
+        ranges[numranges++].size = numlumps * 16;
+    }
+
+    for (i = 0; i < numlumps; ++i)
+    {
+        pos = ReadLong(wad + infotableofs + i * 16);
+        end = pos + ReadLong(wad + infotableofs + i * 16 + 4);
+
+        if (end > pos && pos >= 0 && end <= length)
+        {
+            ranges[numranges].position = pos;
+            ranges[numranges++].size = end - pos;
+        }
+    }
+
+    qsort(ranges, numranges, sizeof(block_t), CompareBlocks);
+
+    // Merge overlapping ranges and fill the gaps, so the blocks cover
+    // the whole file in order
+
+    blocks = malloc(sizeof(block_t) * (numranges * 2 + 1));
+    numblocks = 0;
+    pos = 0;
+
+    for (i = 0; i < numranges; ++i)
+    {
+        end = ranges[i].position + ranges[i].size;
+
+        if (end <= pos)
+        {
+            continue;
+        }
+        if (ranges[i].position > pos)
+        {
+            blocks[numblocks].position = pos;
+            blocks[numblocks++].size = ranges[i].position - pos;
+        }
+        else if (ranges[i].position < pos)
+        {
+            // Overlaps the previous block: extend that instead
+
+            blocks[numblocks - 1].size = end - blocks[numblocks - 1].position;
+            pos = end;
+            continue;
+        }
+        blocks[numblocks].position = ranges[i].position;
+        blocks[numblocks++].size = ranges[i].size;
+        pos = end;
+    }
+    if (pos < length)
+    {
+        blocks[numblocks].position = pos;
+        blocks[numblocks++].size = length - pos;
+    }
+
+    // Pack each block
+
+    f = fopen(argv[2], "wb");
+    if (f == NULL)
+    {
+        perror(argv[2]);
+        return 1;
+    }
+
+    packed = malloc(length + length / 255 + 16);
+    trial = malloc(length);
+    zpos = 16;
+    numpacked = 0;
+    fseek(f, zpos, SEEK_SET);
+
+    for (i = 0; i < numblocks; ++i)
+    {
+        const byte *src = wad + blocks[i].position;
+        int size = blocks[i].size;
+
+        lzsize = Encode(src, size, packed, &lzout);
+        zsize = lzsize + size - lzout;
+
+        if (lzsize > 0)
+        {
+            // Check the in place decode the engine will do
+
+            memcpy(trial + size - zsize, packed, lzsize);
+            memcpy(trial + lzout, src + lzout, size - lzout);
+
+            if (Decode(trial + size - zsize, lzsize, trial, lzout) != lzout
+             || memcmp(trial, src, size))
+            {
+                fprintf(stderr, "%s: block at %i does not decode in place\n",
+                        argv[1], blocks[i].position);
+                return 1;
+            }
+
+            fwrite(packed, 1, lzsize, f);
+            ++numpacked;
+        }
+        fwrite(src + lzout, 1, size - lzout, f);
+
+        blocks[i].zposition = zpos;
+        blocks[i].zsize = zsize;
+        blocks[i].lzsize = lzsize;
+        zpos += zsize;
+    }
+
+    // Index and header
+
+    for (i = 0; i < numblocks; ++i)
+    {
+        WriteLong(header, blocks[i].position);
+        WriteLong(header + 4, blocks[i].size);
+        WriteLong(header + 8, blocks[i].zposition);
+        WriteLong(header + 12, blocks[i].zsize);
+        WriteLong(header + 16, blocks[i].lzsize);
+        fwrite(header, 1, 20, f);
+    }
+
+    memcpy(header, "LZWD", 4);
+    WriteLong(header + 4, numblocks);
+    WriteLong(header + 8, zpos);
+    WriteLong(header + 12, length);
+    fseek(f, 0, SEEK_SET);
+    fwrite(header, 1, 16, f);
+    fclose(f);
+
+    printf("%s: %i lumps, %i blocks (%i packed), %i -> %i bytes (%i%%)\n",
+           argv[2], numlumps, numblocks, numpacked, length,
+           zpos + numblocks * 20,
+           (int)((zpos + numblocks * 20) * 100.0 / length));
+
+    return 0;
+}